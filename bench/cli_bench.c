@@ -0,0 +1,284 @@
+/**
+ * lime-apt Command Benchmark
+ *
+ * Runs lime-apt end to end against the stub tools in fake_apt.c, which
+ * go first on PATH, and times how fast it turns apt's output into its
+ * own: search, update and upgrade formatting, the smart install path
+ * and install-deb. The state paths point into a scratch directory, and
+ * the package index is kept unreachable so every query goes to apt.
+ * Commands that need root run in a user namespace when not started as
+ * root.
+ *
+ * Usage: cli-bench <lime-apt> <fake-apt>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_RUNS 16
+
+typedef struct {
+    const char *name;
+    const char *scale;          // BENCH_* settings for the stubs
+    char *args[40];             // lime-apt arguments
+    int root;                   // Needs (namespaced) root
+    int items;                  // Results, sources or packages handled
+    const char *unit;
+    int runs;
+} Scenario;
+
+static char lime_apt[PATH_MAX];
+static char scratch[] = "/tmp/lime-apt-bench-XXXXXX";
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+// Become root in a new user namespace, as unshare -r does
+static int enter_user_namespace(void)
+{
+    uid_t uid = geteuid();
+    gid_t gid = getegid();
+    if (unshare(CLONE_NEWUSER) != 0) return -1;
+
+    char map[64];
+    int fd = open("/proc/self/setgroups", O_WRONLY);
+    if (fd >= 0) {
+        if (write(fd, "deny", 4) != 4) {
+            close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    const char *files[] = {"/proc/self/uid_map", "/proc/self/gid_map"};
+    unsigned ids[] = {uid, gid};
+    for (int i = 0; i < 2; i++) {
+        int length = snprintf(map, sizeof(map), "0 %u 1\n", ids[i]);
+        fd = open(files[i], O_WRONLY);
+        if (fd < 0 || write(fd, map, length) != length) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    return geteuid() == 0 ? 0 : -1;
+}
+
+// Set up the scratch state and put the stubs first on PATH
+static int prepare_environment(const char *fake_apt)
+{
+    char path[PATH_MAX + 64];
+    char target[PATH_MAX];
+    if (!mkdtemp(scratch) || !realpath(fake_apt, target)) return -1;
+
+    const char *dirs[] = {"bin", "lists", "queue", "archives", NULL};
+    for (int i = 0; dirs[i]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", scratch, dirs[i]);
+        if (mkdir(path, 0755) != 0) return -1;
+    }
+    const char *tools[] = {"apt", "apt-get", "apt-cache", "dpkg", "dpkg-deb", "curl", NULL};
+    for (int i = 0; tools[i]; i++) {
+        snprintf(path, sizeof(path), "%s/bin/%s", scratch, tools[i]);
+        if (symlink(target, path) != 0) return -1;
+    }
+    const char *files[] = {"status", "extended_states", "bench.deb", NULL};
+    for (int i = 0; files[i]; i++) {
+        snprintf(path, sizeof(path), "%s/%s", scratch, files[i]);
+        FILE *file = fopen(path, "w");
+        if (!file) return -1;
+        fclose(file);
+    }
+
+    const char *old_path = getenv("PATH");
+    char *new_path = malloc(strlen(scratch) + (old_path ? strlen(old_path) : 0) + 8);
+    sprintf(new_path, "%s/bin:%s", scratch, old_path ? old_path : "/usr/bin:/bin");
+    setenv("PATH", new_path, 1);
+    free(new_path);
+
+    struct { const char *name; const char *dir; } state[] = {
+        {"LIME_APT_LISTS_DIR", "lists"}, {"LIME_APT_DPKG_STATUS", "status"},
+        {"LIME_APT_EXTENDED_STATES", "extended_states"}, {"LIME_APT_QUEUE_DIR", "queue"},
+        {"LIME_APT_ARCHIVES_DIR", "archives"}, {"LIME_APT_SOCKET", "no-daemon"},
+    };
+    for (size_t i = 0; i < sizeof(state) / sizeof(state[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", scratch, state[i].dir);
+        setenv(state[i].name, path, 1);
+    }
+    setenv("LIME_APT_CACHE_DIR", "/dev/null/no-index", 1);
+    unsetenv("LIME_APT_TRACE");
+    return 0;
+}
+
+// Run one command with its output drained through a pipe. Returns the
+// wall time in milliseconds, or -1 when it failed.
+static double run_once(char *const argv[], const char *scale, long *out_bytes)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        char settings[256];
+        snprintf(settings, sizeof(settings), "%s", scale);
+        for (char *token = strtok(settings, " "); token; token = strtok(NULL, " ")) putenv(strdup(token));
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    char buffer[65536];
+    ssize_t count;
+    long bytes = 0;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0 || (count < 0 && errno == EINTR)) {
+        if (count > 0) bytes += count;
+    }
+    close(fds[0]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *out_bytes = bytes;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed_ms(&start, &end) : -1;
+}
+
+static int run_scenario(const Scenario *scenario, int have_root)
+{
+    if (scenario->root && !have_root) {
+        printf("%-28s skipped (needs root or user namespaces)\n", scenario->name);
+        return 0;
+    }
+
+    char *argv[42];
+    int argc = 0;
+    argv[argc++] = lime_apt;
+    for (int i = 0; scenario->args[i]; i++) argv[argc++] = scenario->args[i];
+    argv[argc] = NULL;
+
+    double times[MAX_RUNS];
+    long bytes = 0;
+    for (int run = 0; run < scenario->runs; run++) {
+        times[run] = run_once(argv, scenario->scale, &bytes);
+        if (times[run] < 0) {
+            fprintf(stderr, "FAIL %s: lime-apt exited non-zero\n", scenario->name);
+            return 1;
+        }
+    }
+    qsort(times, scenario->runs, sizeof(double), compare_doubles);
+    double median = times[scenario->runs / 2];
+    printf("%-28s %8.1f ms median  %8.1f min  %10.0f %s/s  %8ld bytes out\n",
+           scenario->name, median, times[0], scenario->items / (median / 1e3), scenario->unit, bytes);
+    return 0;
+}
+
+// The stub on its own, as a floor for the formatter's share
+static void run_baseline(const char *name, const char *scale, char *const args[], int items, const char *unit)
+{
+    char tool[PATH_MAX + 16];
+    snprintf(tool, sizeof(tool), "%s/bin/%s", scratch, args[0]);
+    char *argv[8];
+    argv[0] = tool;
+    for (int i = 1; args[i - 1] && i < 8; i++) argv[i] = args[i];
+
+    double times[5];
+    long bytes;
+    for (int run = 0; run < 5; run++) times[run] = run_once(argv, scale, &bytes);
+    qsort(times, 5, sizeof(double), compare_doubles);
+    printf("%-28s %8.1f ms median  %8.1f min  %10.0f %s/s  %8ld bytes out\n",
+           name, times[2], times[0], items / (times[2] / 1e3), unit, bytes);
+}
+
+static void remove_scratch(void)
+{
+    char command[PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", scratch);
+    if (system(command) != 0) fprintf(stderr, "cli-bench: could not remove %s\n", scratch);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <lime-apt> <fake-apt>\n", argv[0]);
+        return 2;
+    }
+    if (!realpath(argv[1], lime_apt)) {
+        perror(argv[1]);
+        return 2;
+    }
+    int was_root = geteuid() == 0;
+    int have_root = was_root || enter_user_namespace() == 0;
+    if (prepare_environment(argv[2]) != 0) {
+        perror("cli-bench: preparing stubs");
+        return 2;
+    }
+    char deb[PATH_MAX + 16];
+    snprintf(deb, sizeof(deb), "%s/bench.deb", scratch);
+
+    Scenario scenarios[] = {
+        {"search (50k results)", "BENCH_RESULTS=50000 BENCH_LINE_LENGTH=80",
+         {"search", "bench", NULL}, 0, 50000, "results", 5},
+        {"search (2000-char lines)", "BENCH_RESULTS=5000 BENCH_LINE_LENGTH=2000",
+         {"search", "bench", NULL}, 0, 5000, "results", 5},
+        {"search --json (50k)", "BENCH_RESULTS=50000 BENCH_LINE_LENGTH=80",
+         {"search", "--json", "bench", NULL}, 0, 50000, "results", 5},
+        {"update (500 sources)", "BENCH_SOURCES=500",
+         {"update", NULL}, 1, 500, "sources", 9},
+        {"update --stats", "BENCH_SOURCES=500",
+         {"update", "--stats", NULL}, 1, 500, "sources", 9},
+        {"upgrade (3k packages)", "BENCH_PACKAGES=3000",
+         {"upgrade", "--connections", "0", NULL}, 1, 3000, "packages", 5},
+        {"install (20 apt packages)", "",
+         {"install", "--connections", "0", "bench-a", "bench-b", "bench-c", "bench-d", "bench-e",
+          "bench-f", "bench-g", "bench-h", "bench-i", "bench-j", "bench-k", "bench-l", "bench-m",
+          "bench-n", "bench-o", "bench-p", "bench-q", "bench-r", "bench-s", "bench-t", NULL},
+         1, 20, "packages", 9},
+        {"install (LimeOS .deb)", "",
+         {"install", "--connections", "0", "discord", NULL}, 1, 1, "packages", 9},
+        {"install-deb", "",
+         {"install-deb", deb, NULL}, 1, 1, "packages", 9},
+    };
+
+    int failures = 0;
+    printf("lime-apt against stub apt and dpkg (%s)\n",
+           was_root ? "as root" : have_root ? "in a user namespace" : "unprivileged");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failures += run_scenario(&scenarios[i], have_root);
+    }
+
+    printf("\nstub output alone\n");
+    char *search[] = {"apt", "search", "bench", NULL};
+    char *update[] = {"apt", "update", NULL};
+    char *upgrade[] = {"apt", "upgrade", NULL};
+    run_baseline("apt search (50k results)", "BENCH_RESULTS=50000 BENCH_LINE_LENGTH=80", search, 50000, "results");
+    run_baseline("apt search (2000-char lines)", "BENCH_RESULTS=5000 BENCH_LINE_LENGTH=2000", search, 5000, "results");
+    run_baseline("apt update (500 sources)", "BENCH_SOURCES=500", update, 500, "sources");
+    run_baseline("apt upgrade (3k packages)", "BENCH_PACKAGES=3000", upgrade, 3000, "packages");
+
+    remove_scratch();
+    unlink("/tmp/discord.deb");
+    return failures > 0;
+}
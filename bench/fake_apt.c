@@ -0,0 +1,185 @@
+/**
+ * lime-apt Benchmark Stub Tools
+ *
+ * One binary that stands in for apt, apt-get, apt-cache, dpkg, dpkg-deb
+ * and curl, chosen by the name it is started under. Each replays
+ * synthetic output shaped like the real tool's, at a scale set from the
+ * environment:
+ *
+ *   BENCH_RESULTS      apt search results (default 50000)
+ *   BENCH_LINE_LENGTH  search description length (default 80)
+ *   BENCH_SOURCES      apt update sources (default 500)
+ *   BENCH_PACKAGES     packages an upgrade touches (default 3000)
+ *
+ * apt-cache knows every package named bench-*, so anything else falls
+ * through to the LimeOS package database.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int get_scale(const char *name, int fallback)
+{
+    const char *value = getenv(name);
+    return value && *value ? atoi(value) : fallback;
+}
+
+// Skip apt's options, including "-o Name=Value" pairs. Returns the index
+// of the first argument that is not one, or argc.
+static int skip_options(int argc, char *argv[], int start)
+{
+    int i = start;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-t") == 0) i++;
+        i++;
+    }
+    return i < argc ? i : argc;
+}
+
+static void print_search(int results, int line_length)
+{
+    char *description = malloc(line_length + 1);
+    const char *words = "Synthetic benchmark package description with some realistic words ";
+    size_t words_length = strlen(words);
+    for (int i = 0; i < line_length; i++) description[i] = words[i % words_length];
+    description[line_length] = '\0';
+
+    printf("Sorting...\nFull Text Search...\n");
+    for (int i = 0; i < results; i++) {
+        printf("bench-pkg-%05d/stable%s %d.%d.%d-%d amd64%s\n  %s\n\n", i, i % 7 == 0 ? ",now" : "",
+               i % 9, i % 31, i % 113, i % 4 + 1, i % 7 == 0 ? " [installed]" : "", description);
+    }
+    free(description);
+}
+
+static void print_update(int sources)
+{
+    for (int i = 0; i < sources; i++) {
+        const char *scheme = i % 5 == 0 ? "https" : "http";
+        if (i % 3 == 0) {
+            printf("Get:%d %s://mirror%d.example.org/debian suite%d/main amd64 Packages [%d,%03d kB]\n",
+                   i + 1, scheme, i % 8, i, i % 9 + 1, i % 1000);
+        } else {
+            printf("Hit:%d %s://mirror%d.example.org/debian suite%d InRelease\n", i + 1, scheme, i % 8, i);
+        }
+    }
+    printf("Fetched %d.%d MB in 1s (%d.%d MB/s)\n", sources / 10, sources % 10, sources / 10, sources % 10);
+    printf("Reading package lists...\nBuilding dependency tree...\nReading state information...\n");
+    printf("%d packages can be upgraded. Run 'apt list --upgradable' to see them.\n", sources / 3);
+}
+
+// An install or upgrade of the named packages, or of "count" synthetic
+// ones when names is NULL
+static void print_transaction(char *names[], int count, int upgrade)
+{
+    char name[64];
+    printf("Reading package lists...\nBuilding dependency tree...\nReading state information...\n");
+    printf("The following packages will be %s:\n", upgrade ? "upgraded" : "installed");
+    for (int i = 0; i < count; i++) {
+        const char *package = names ? names[i] : (snprintf(name, sizeof(name), "bench-pkg-%05d", i), name);
+        printf("%s%s%s", i % 6 == 0 ? "  " : "", package, i % 6 == 5 || i == count - 1 ? "\n" : " ");
+    }
+    printf("%d upgraded, %d newly installed, 0 to remove and 0 not upgraded.\n",
+           upgrade ? count : 0, upgrade ? 0 : count);
+    printf("Need to get %d kB of archives.\n", count * 120);
+
+    for (int i = 0; i < count; i++) {
+        const char *package = names ? names[i] : (snprintf(name, sizeof(name), "bench-pkg-%05d", i), name);
+        printf("Get:%d http://mirror.example.org/debian stable/main amd64 %s amd64 1.%d-1 [%d kB]\n",
+               i + 1, package, i % 50, i % 400 + 4);
+    }
+    printf("Fetched %d kB in 2s (%d kB/s)\n", count * 120, count * 60);
+    printf("(Reading database ... 245123 files and directories currently installed.)\n");
+    for (int i = 0; i < count; i++) {
+        const char *package = names ? names[i] : (snprintf(name, sizeof(name), "bench-pkg-%05d", i), name);
+        printf("Preparing to unpack .../%s_1.%d-1_amd64.deb ...\n", package, i % 50);
+        if (upgrade) printf("Unpacking %s (1.%d-1) over (1.%d-0) ...\n", package, i % 50, i % 50);
+        else printf("Unpacking %s (1.%d-1) ...\n", package, i % 50);
+    }
+    for (int i = 0; i < count; i++) {
+        const char *package = names ? names[i] : (snprintf(name, sizeof(name), "bench-pkg-%05d", i), name);
+        printf("Setting up %s (1.%d-1) ...\n", package, i % 50);
+    }
+    printf("Processing triggers for man-db (2.11.2-2) ...\n");
+    printf("Processing triggers for libc-bin (2.36-9+deb12u4) ...\n");
+}
+
+static int run_apt(int argc, char *argv[])
+{
+    int command = skip_options(argc, argv, 1);
+    if (command == argc) return 0;
+    const char *name = argv[command];
+
+    if (strcmp(name, "search") == 0) {
+        print_search(get_scale("BENCH_RESULTS", 50000), get_scale("BENCH_LINE_LENGTH", 80));
+    } else if (strcmp(name, "update") == 0) {
+        print_update(get_scale("BENCH_SOURCES", 500));
+    } else if (strcmp(name, "upgrade") == 0 || strcmp(name, "full-upgrade") == 0) {
+        print_transaction(NULL, get_scale("BENCH_PACKAGES", 3000), 1);
+    } else if (strcmp(name, "install") == 0) {
+        // Packages follow the command; options may be mixed in
+        char **packages = malloc(argc * sizeof(char*));
+        int count = 0;
+        for (int i = command + 1; i < argc; i++) {
+            if (argv[i][0] != '-') packages[count++] = argv[i];
+        }
+        if (count > 0) print_transaction(packages, count, 0);
+        free(packages);
+    }
+    return 0;
+}
+
+static int run_apt_cache(int argc, char *argv[])
+{
+    if (argc < 3 || strcmp(argv[1], "show") != 0) return 0;
+    if (strncmp(argv[2], "bench-", 6) != 0) return 100;
+    printf("Package: %s\nVersion: 1.0-1\nArchitecture: amd64\n\n", argv[2]);
+    return 0;
+}
+
+static int run_dpkg(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "--print-architecture") == 0) {
+        printf("amd64\n");
+    } else if (argc >= 3 && strcmp(argv[1], "-i") == 0) {
+        printf("Selecting previously unselected package bench-deb.\n");
+        printf("(Reading database ... 245123 files and directories currently installed.)\n");
+        printf("Preparing to unpack %s ...\n", argv[2]);
+        printf("Unpacking bench-deb (1.0-1) ...\n");
+        printf("Setting up bench-deb (1.0-1) ...\n");
+        printf("Processing triggers for desktop-file-utils (0.26-1) ...\n");
+    }
+    return 0;
+}
+
+static int run_dpkg_deb(int argc, char *argv[])
+{
+    if (argc >= 4 && strcmp(argv[1], "-f") == 0) printf("bench-deb\n");
+    return 0;
+}
+
+// Writes a small archive wherever -o points
+static int run_curl(int argc, char *argv[])
+{
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-o") != 0) continue;
+        FILE *file = fopen(argv[i + 1], "w");
+        if (!file) return 23;
+        fputs("!<arch>\n", file);
+        fclose(file);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *program = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    if (strcmp(program, "apt") == 0 || strcmp(program, "apt-get") == 0) return run_apt(argc, argv);
+    if (strcmp(program, "apt-cache") == 0) return run_apt_cache(argc, argv);
+    if (strcmp(program, "dpkg") == 0) return run_dpkg(argc, argv);
+    if (strcmp(program, "dpkg-deb") == 0) return run_dpkg_deb(argc, argv);
+    if (strcmp(program, "curl") == 0) return run_curl(argc, argv);
+    fprintf(stderr, "fake-apt: started as unknown tool %s\n", program);
+    return 1;
+}
@@ -0,0 +1,188 @@
+/**
+ * lime-apt Output Formatter Benchmark
+ *
+ * Feeds recorded apt output from memory through the search, update and
+ * install formatters and reports the cost per line, with nothing but the
+ * formatter in the loop: no apt, no pipe, no terminal. What they print
+ * goes to /dev/null. Each case runs in batches long enough to time and
+ * the fastest batch is reported, in text mode and then as --json.
+ *
+ * Usage: format-bench <transcript-dir>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "format.h"
+#include "output.h"
+
+#define BATCHES 7
+#define BATCH_NS 50000000.0
+
+typedef struct {
+    char *data;
+    size_t size;
+} Transcript;
+
+typedef struct {
+    const char *name;
+    const Transcript *transcript;
+    void (*run)(const Transcript *transcript);
+} Case;
+
+static FILE *report;
+
+static double now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static int load_transcript(const char *dir, const char *name, Transcript *out_transcript)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    out_transcript->data = malloc(size > 0 ? size : 1);
+    out_transcript->size = fread(out_transcript->data, 1, size > 0 ? size : 0, file);
+    fclose(file);
+    return 0;
+}
+
+static int count_lines(const Transcript *transcript)
+{
+    int lines = 0;
+    for (size_t i = 0; i < transcript->size; i++) lines += transcript->data[i] == '\n';
+    if (transcript->size > 0 && transcript->data[transcript->size - 1] != '\n') lines++;
+    return lines;
+}
+
+static int feed_search(char *line, void *context)
+{
+    return add_search_output_line(context, line);
+}
+
+static int feed_update(char *line, void *context)
+{
+    add_update_output_line(context, line);
+    return 0;
+}
+
+static int feed_install(char *line, void *context)
+{
+    add_install_output_line(context, line);
+    return 0;
+}
+
+static void run_search(const Transcript *transcript)
+{
+    SearchOutput output;
+    init_search_output(&output, 0);
+    feed_output_lines(transcript->data, transcript->size, feed_search, &output);
+    finish_search_output(&output);
+}
+
+static void run_update(const Transcript *transcript)
+{
+    UpdateOutput output;
+    init_update_output(&output, 0);
+    feed_output_lines(transcript->data, transcript->size, feed_update, &output);
+    finish_update_output(&output);
+}
+
+static void run_update_stats(const Transcript *transcript)
+{
+    UpdateOutput output;
+    init_update_output(&output, 1);
+    feed_output_lines(transcript->data, transcript->size, feed_update, &output);
+    finish_update_output(&output);
+}
+
+static void run_install(const Transcript *transcript)
+{
+    InstallOutput output;
+    init_install_output(&output, "upgrade");
+    feed_output_lines(transcript->data, transcript->size, feed_install, &output);
+    finish_install_output(&output);
+}
+
+static void run_case(const Case *bench, const char *mode)
+{
+    // Size the batches from one warm-up pass
+    double start = now_ns();
+    bench->run(bench->transcript);
+    double once = now_ns() - start;
+    long rounds = once > 0 ? (long)(BATCH_NS / once) : 1;
+    if (rounds < 1) rounds = 1;
+
+    double best = 0;
+    for (int batch = 0; batch < BATCHES; batch++) {
+        start = now_ns();
+        for (long round = 0; round < rounds; round++) bench->run(bench->transcript);
+        double elapsed = now_ns() - start;
+        if (batch == 0 || elapsed < best) best = elapsed;
+    }
+    fflush(stdout);
+
+    int lines = count_lines(bench->transcript);
+    double ns_per_line = best / ((double)rounds * lines);
+    double mb_per_second = bench->transcript->size * (double)rounds / best * 1e3;
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s", bench->name, mode);
+    fprintf(report, "%-24s %6d lines  %8.1f ns/line  %12.0f lines/s  %8.1f MB/s\n",
+            name, lines, ns_per_line, 1e9 / ns_per_line, mb_per_second);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <transcript-dir>\n", argv[0]);
+        return 2;
+    }
+    Transcript search, update, install;
+    if (load_transcript(argv[1], "search.txt", &search) != 0 ||
+        load_transcript(argv[1], "update.txt", &update) != 0 ||
+        load_transcript(argv[1], "install.txt", &install) != 0) {
+        return 2;
+    }
+
+    // Keep the real stdout for the report and let the formatters print
+    // into /dev/null; --json later moves stdout to stderr, so that goes too
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) {
+        perror("format-bench: redirecting output");
+        return 2;
+    }
+    setvbuf(report, NULL, _IOLBF, 0);
+    init_output();
+
+    Case cases[] = {
+        {"search", &search, run_search},
+        {"update", &update, run_update},
+        {"update --stats", &update, run_update_stats},
+        {"upgrade", &install, run_install},
+    };
+    size_t count = sizeof(cases) / sizeof(cases[0]);
+
+    fprintf(report, "apt output formatters on recorded transcripts\n");
+    for (size_t i = 0; i < count; i++) run_case(&cases[i], "");
+    enable_json_output();
+    for (size_t i = 0; i < count; i++) run_case(&cases[i], " --json");
+
+    free(search.data);
+    free(update.data);
+    free(install.data);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * lime-apt Version Comparison Benchmark
+ *
+ * Checks compare_debian_versions() against known dpkg orderings, then
+ * times it over a synthetic set of realistic version strings.
+ * Exits non-zero if any vector disagrees with dpkg.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "version.h"
+
+#define VERSION_COUNT 4096
+#define ROUNDS        200
+
+// Expected sign of compare(left, right), as given by
+// dpkg --compare-versions
+typedef struct {
+    const char *left;
+    const char *right;
+    int expected;
+} VersionVector;
+
+static const VersionVector VECTORS[] = {
+    {"1.0", "1.0", 0},
+    {"1.0", "1.1", -1},
+    {"1.1", "1.0", 1},
+    {"1.9", "1.10", -1},
+    {"1.0", "1.0.0", -1},
+    {"001", "1", 0},
+    {"1.01", "1.1", 0},
+    {"1.0a", "1.0", 1},
+    {"1.0a", "1.0b", -1},
+    {"1.0+", "1.0", 1},
+    {"1.0+", "1.0a", 1},
+    {"1.0.", "1.0+", 1},
+
+    // Tilde sorts before everything, including the end of the string
+    {"1.0~rc1", "1.0", -1},
+    {"1.0~rc1", "1.0~rc2", -1},
+    {"1.0~~", "1.0~~a", -1},
+    {"1.0~~a", "1.0~", -1},
+    {"1.0~", "1.0", -1},
+    {"1.0", "1.0a", -1},
+    {"2.30~pre1", "2.30", -1},
+
+    // Epochs win over everything else
+    {"1:0.9", "2.0", 1},
+    {"0:1.0", "1.0", 0},
+    {"2:0", "1:99", 1},
+    {"1:1.0-1", "1:1.0-1", 0},
+    {"10:1", "9:1", 1},
+
+    // Revisions, split at the last hyphen
+    {"1.0-1", "1.0-2", -1},
+    {"1.0", "1.0-0", 0},
+    {"1.0-1", "1.0", 1},
+    {"1.2-3-4", "1.2-3-5", -1},
+    {"1.2-3-4", "1.2-4-1", -1},
+    {"5.2.15-2+b9", "5.2.15-2+b10", -1},
+    {"5.2.15-2", "5.2.15-2+b1", -1},
+    {"2:9.0.1378-2+deb12u2", "2:9.0.1378-2", 1},
+    {"2:9.0.1378-2+deb12u2", "2:9.0.1378-2+deb12u10", -1},
+    {"1.0-1~bpo12+1", "1.0-1", -1},
+    {"1.0-1ubuntu1", "1.0-1", 1},
+    {"1.0-1build1", "1.0-1ubuntu1", -1},
+    {"3.0.11-1~deb12u2", "3.0.11-1", -1},
+    {"7.88.1-10+deb12u5", "7.88.1-10+deb12u12", -1},
+    {"252.30-1~deb12u2", "252.31-1~deb12u1", -1},
+};
+
+static int sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+static int check_vectors(void)
+{
+    int failures = 0;
+    size_t count = sizeof(VECTORS) / sizeof(VECTORS[0]);
+    for (size_t i = 0; i < count; i++) {
+        const VersionVector *vector = &VECTORS[i];
+        int forward = sign(compare_debian_versions(vector->left, vector->right));
+        int backward = sign(compare_debian_versions(vector->right, vector->left));
+        if (forward != vector->expected || backward != -vector->expected) {
+            fprintf(stderr, "FAIL %s vs %s: got %d/%d, expected %d\n",
+                    vector->left, vector->right, forward, backward, vector->expected);
+            failures++;
+        }
+    }
+    printf("conformance: %zu vectors, %d failure(s)\n", count, failures);
+    return failures;
+}
+
+// Versions shaped like the ones in a Debian archive
+static void generate_versions(char versions[][48], int count)
+{
+    static const char *suffixes[] = {"", "+b1", "+deb12u2", "+deb12u10", "~bpo12+1", "ubuntu1", "~rc1"};
+    unsigned seed = 12345;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned r = seed >> 8;
+        int epoch = r % 7 == 0 ? (int)(r % 3) + 1 : 0;
+        char prefix[8] = "";
+        if (epoch) snprintf(prefix, sizeof(prefix), "%d:", epoch);
+        snprintf(versions[i], 48, "%s%u.%u.%u-%u%s", prefix, r % 10, (r >> 4) % 40, (r >> 10) % 200,
+                 (r >> 18) % 5 + 1, suffixes[(r >> 21) % 7]);
+    }
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+    if (check_vectors() != 0) return 1;
+
+    static char versions[VERSION_COUNT][48];
+    size_t lengths[VERSION_COUNT];
+    generate_versions(versions, VERSION_COUNT);
+    for (int i = 0; i < VERSION_COUNT; i++) lengths[i] = strlen(versions[i]);
+
+    // Time version ordering against plain strcmp as a floor
+    struct timespec start, end;
+    volatile long sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 1; i < VERSION_COUNT; i++) {
+            sink += compare_debian_versions_n(versions[i - 1], lengths[i - 1], versions[i], lengths[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double version_ns = elapsed_ns(&start, &end) / ((double)ROUNDS * (VERSION_COUNT - 1));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 1; i < VERSION_COUNT; i++) {
+            sink += strcmp(versions[i - 1], versions[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double strcmp_ns = elapsed_ns(&start, &end) / ((double)ROUNDS * (VERSION_COUNT - 1));
+
+    printf("compare_debian_versions: %.1f ns/compare\n", version_ns);
+    printf("strcmp (baseline):       %.1f ns/compare\n", strcmp_ns);
+    return 0;
+}
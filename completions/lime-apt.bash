@@ -0,0 +1,37 @@
+# bash completion for lime-apt
+
+_lime_apt()
+{
+    local cur=${COMP_WORDS[COMP_CWORD]}
+    local commands="install install-deb remove purge update upgrade full-upgrade dist-upgrade
+                    search show list rdepends why apply autoremove clean"
+
+    if [ "$COMP_CWORD" -eq 1 ]; then
+        COMPREPLY=($(compgen -W "$commands" -- "$cur"))
+        return
+    fi
+
+    case ${COMP_WORDS[1]} in
+        install|show|rdepends)
+            case $cur in
+                -*) ;;
+                ./*|/*|~*) COMPREPLY=($(compgen -f -- "$cur")) ;;
+                *) COMPREPLY=($(lime-apt complete "$cur" 2>/dev/null)) ;;
+            esac
+            ;;
+        remove|purge|why)
+            [[ $cur == -* ]] || COMPREPLY=($(lime-apt complete --installed "$cur" 2>/dev/null))
+            ;;
+        install-deb)
+            COMPREPLY=($(compgen -f -X '!*.deb' -- "$cur") $(compgen -d -- "$cur"))
+            ;;
+        apply)
+            case $cur in
+                -*) COMPREPLY=($(compgen -W "--dry-run" -- "$cur")) ;;
+                *) COMPREPLY=($(compgen -f -- "$cur")) ;;
+            esac
+            ;;
+    esac
+}
+
+complete -F _lime_apt lime-apt
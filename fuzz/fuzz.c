@@ -0,0 +1,31 @@
+/**
+ * lime-apt Formatter Fuzz Targets
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+#include "output.h"
+
+void quiet_formatter_output(void)
+{
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("fuzz: redirecting stdout");
+        exit(1);
+    }
+    init_output();
+
+    // --json keeps the records on the old stdout and moves stdout onto
+    // stderr, so quiet stderr for the switch and then give it back
+    const char *json = getenv("FUZZ_JSON");
+    if (json && *json && *json != '0') {
+        fflush(stderr);
+        int saved = dup(STDERR_FILENO);
+        dup2(STDOUT_FILENO, STDERR_FILENO);
+        enable_json_output();
+        dup2(saved, STDERR_FILENO);
+        close(saved);
+    }
+}
@@ -0,0 +1,25 @@
+/**
+ * lime-apt Formatter Fuzz Targets
+ *
+ * Each target feeds arbitrary bytes to one apt output formatter, split
+ * into lines as the formatter reads them from apt's pipe. They build as
+ * libFuzzer targets (make fuzz), or with replay.c as plain programs
+ * that run saved inputs under any compiler's sanitizers.
+ *
+ * Set FUZZ_JSON=1 to exercise the --json records instead of the text.
+ */
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+// Send what the formatters print to /dev/null, leaving stderr for the
+// fuzzer's own reports
+void quiet_formatter_output(void);
+
+#endif // FUZZ_H
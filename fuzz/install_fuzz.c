@@ -0,0 +1,29 @@
+/**
+ * lime-apt apt install Formatter Fuzz Target
+ */
+
+#include "fuzz.h"
+#include "format.h"
+
+static int feed_install(char *line, void *context)
+{
+    add_install_output_line(context, line);
+    return 0;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    quiet_formatter_output();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    InstallOutput output;
+    init_install_output(&output, "install");
+    feed_output_lines((const char *)data, size, feed_install, &output);
+    finish_install_output(&output);
+    return 0;
+}
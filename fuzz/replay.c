@@ -0,0 +1,72 @@
+/**
+ * lime-apt Fuzz Input Replay
+ *
+ * Stands in for libFuzzer's main() where it is not available: runs a
+ * target once over each file named, or each file in a directory named,
+ * such as a corpus or a crash to reproduce.
+ *
+ * Usage: fuzz-<target> <file-or-dir>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fuzz.h"
+
+static int replay_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    // An exact-size heap copy, so the sanitizers see reads past the end
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    size_t length = fread(data, 1, size > 0 ? size : 0, file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(data, length);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    int inputs = 0;
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        struct stat info;
+        if (stat(argv[i], &info) != 0 || !S_ISDIR(info.st_mode)) {
+            failures += replay_file(argv[i]) != 0;
+            inputs++;
+            continue;
+        }
+
+        DIR *dir = opendir(argv[i]);
+        if (!dir) {
+            perror(argv[i]);
+            failures++;
+            continue;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (entry->d_name[0] == '.') continue;
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", argv[i], entry->d_name);
+            failures += replay_file(path) != 0;
+            inputs++;
+        }
+        closedir(dir);
+    }
+    fprintf(stderr, "replayed %d input(s)\n", inputs - failures);
+    return failures > 0;
+}
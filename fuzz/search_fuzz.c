@@ -0,0 +1,32 @@
+/**
+ * lime-apt apt search Formatter Fuzz Target
+ *
+ * The first byte picks the --limit (0 for none), the rest is apt's output.
+ */
+
+#include "fuzz.h"
+#include "format.h"
+
+static int feed_search(char *line, void *context)
+{
+    return add_search_output_line(context, line);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    quiet_formatter_output();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size == 0) return 0;
+
+    SearchOutput output;
+    init_search_output(&output, data[0] % 32);
+    feed_output_lines((const char *)data + 1, size - 1, feed_search, &output);
+    finish_search_output(&output);
+    return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * lime-apt apt update Formatter Fuzz Target
+ *
+ * Runs with --stats, so the per-source accounting sees every line too.
+ */
+
+#include "fuzz.h"
+#include "format.h"
+
+static int feed_update(char *line, void *context)
+{
+    add_update_output_line(context, line);
+    return 0;
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    (void)argc;
+    (void)argv;
+    quiet_formatter_output();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    UpdateOutput output;
+    init_update_output(&output, 1);
+    feed_output_lines((const char *)data, size, feed_update, &output);
+    finish_update_output(&output);
+    return 0;
+}
@@ -0,0 +1,500 @@
+/**
+ * lime-apt Autoremove Preview
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "autoremove.h"
+#include "paths.h"
+
+#define MAX_CONFIG_DEPTH 32
+
+typedef void (*NameCallback)(DpkgField name, void *context);
+typedef void (*StateCallback)(DpkgField name, DpkgField architecture, void *context);
+
+// Automatic marks being recorded by index id or by status position
+typedef struct {
+    const PackageIndex *index;
+    unsigned char *marks;
+} IndexMarks;
+
+typedef struct {
+    const DpkgStatus *status;
+    unsigned char *marks;
+} StatusMarks;
+
+// An installed virtual package name and one package providing it
+typedef struct {
+    DpkgField name;
+    size_t provider;
+} Provision;
+
+// APT::NeverAutoRemove patterns, matched against package names
+typedef struct {
+    regex_t *patterns;
+    int count;
+    int capacity;
+} KeepPatterns;
+
+// State for the mark phase
+typedef struct {
+    const DpkgStatus *status;
+    const Provision *provisions;
+    size_t provision_count;
+    unsigned char *marked;
+    size_t *stack;
+    size_t depth;
+} MarkContext;
+
+// Relationships that keep a package installed, strongest first
+static const char *const relation_fields[] = {"Pre-Depends", "Depends", "Recommends", "Suggests", NULL};
+static const char *const provides_fields[] = {"Provides", NULL};
+
+static int compare_fields(DpkgField left, DpkgField right)
+{
+    int result = memcmp(left.data, right.data, left.length < right.length ? left.length : right.length);
+    if (result != 0) return result;
+    return left.length < right.length ? -1 : left.length > right.length;
+}
+
+// Walk apt's extended_states, calling back with every package it marks
+// automatically installed. Returns -1 if the file cannot be read.
+static int read_auto_installed(StateCallback callback, void *context)
+{
+    int fd = open(get_extended_states_path(), O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    DpkgField name = {NULL, 0};
+    DpkgField architecture = {NULL, 0};
+    int auto_installed = 0;
+    const char *cursor = data;
+    const char *end = data + st.st_size;
+    while (cursor <= end) {
+        const char *line_end = cursor < end ? memchr(cursor, '\n', end - cursor) : NULL;
+        if (!line_end) line_end = end;
+        size_t length = line_end - cursor;
+
+        if (length == 0) {
+            if (auto_installed && name.length > 0) callback(name, architecture, context);
+            name.length = architecture.length = 0;
+            auto_installed = 0;
+            if (cursor == end) break;
+        } else if (length > 9 && memcmp(cursor, "Package: ", 9) == 0) {
+            name.data = cursor + 9;
+            name.length = length - 9;
+        } else if (length > 14 && memcmp(cursor, "Architecture: ", 14) == 0) {
+            architecture.data = cursor + 14;
+            architecture.length = length - 14;
+        } else if (length > 16 && memcmp(cursor, "Auto-Installed: ", 16) == 0) {
+            auto_installed = cursor[16] == '1';
+        }
+        cursor = line_end + 1;
+        if (cursor > end) {
+            // File without a trailing newline: close the last stanza
+            cursor = end;
+        }
+    }
+
+    munmap((void *)data, st.st_size);
+    return 0;
+}
+
+// Record one automatic package if the index has it
+static void mark_index_package(DpkgField name, DpkgField architecture, void *context)
+{
+    const PackageIndex *index = ((IndexMarks *)context)->index;
+    unsigned char *marks = ((IndexMarks *)context)->marks;
+    char key[256];
+    if (name.length >= sizeof(key)) return;
+    snprintf(key, sizeof(key), "%.*s", (int)name.length, name.data);
+    int id = find_index_package(index, key);
+    if (id < 0) return;
+
+    // Foreign-architecture marks belong to packages the index lacks
+    const char *indexed = get_index_string(index, index->packages[id].architecture);
+    if (architecture.length == 0 || strcmp(indexed, "all") == 0 ||
+        (strlen(indexed) == architecture.length && memcmp(indexed, architecture.data, architecture.length) == 0)) {
+        marks[id] = 1;
+    }
+}
+
+unsigned char *mark_auto_installed_packages(const PackageIndex *index)
+{
+    uint32_t package_count = index->header->package_count;
+    unsigned char *marks = calloc(package_count ? package_count : 1, 1);
+    IndexMarks context = {index, marks};
+    if (read_auto_installed(mark_index_package, &context) != 0) {
+        free(marks);
+        return NULL;
+    }
+    return marks;
+}
+
+// Position of the first status entry named "name", or status->count
+static size_t find_first_package(const DpkgStatus *status, DpkgField name)
+{
+    size_t low = 0;
+    size_t high = status->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (compare_fields(status->packages[middle].name, name) < 0) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Record one automatic package against the status entries it names
+static void mark_status_package(DpkgField name, DpkgField architecture, void *context)
+{
+    const DpkgStatus *status = ((StatusMarks *)context)->status;
+    unsigned char *marks = ((StatusMarks *)context)->marks;
+    for (size_t i = find_first_package(status, name);
+         i < status->count && compare_fields(status->packages[i].name, name) == 0; i++) {
+        DpkgField installed = status->packages[i].architecture;
+        if (architecture.length == 0 || compare_dpkg_field(installed, "all") == 0 ||
+            compare_fields(installed, architecture) == 0) {
+            marks[i] = 1;
+        }
+    }
+}
+
+// Split a relationship value ("a (>= 1) | b:any, c") into package
+// names. Every alternative is reported, since apt keeps any installed one.
+static void parse_relation_names(const char *cursor, const char *end, NameCallback callback, void *context)
+{
+    while (cursor < end) {
+        while (cursor < end && (isspace((unsigned char)*cursor) || *cursor == ',' || *cursor == '|')) cursor++;
+
+        // The name stops at a version, architecture qualifier or space
+        const char *name_end = cursor;
+        while (name_end < end && !isspace((unsigned char)*name_end) && *name_end != '(' &&
+               *name_end != ':' && *name_end != '[' && *name_end != ',' && *name_end != '|') {
+            name_end++;
+        }
+        if (name_end > cursor) {
+            DpkgField name = {cursor, (size_t)(name_end - cursor)};
+            callback(name, context);
+        }
+
+        // Skip the rest of this option
+        cursor = name_end;
+        while (cursor < end && *cursor != ',' && *cursor != '|') cursor++;
+    }
+}
+
+// Call back with every package name in the stanza's fields listed in
+// "keys", following continuation lines
+static void parse_stanza_relations(DpkgField stanza, const char *const keys[], NameCallback callback,
+                                   void *context)
+{
+    const char *cursor = stanza.data;
+    const char *end = stanza.data + stanza.length;
+    while (cursor < end) {
+        const char *line_end = memchr(cursor, '\n', end - cursor);
+        if (!line_end) line_end = end;
+        for (int k = 0; keys[k]; k++) {
+            size_t key_length = strlen(keys[k]);
+            if ((size_t)(line_end - cursor) <= key_length || cursor[key_length] != ':' ||
+                strncasecmp(cursor, keys[k], key_length) != 0) {
+                continue;
+            }
+            while (line_end + 1 < end && (line_end[1] == ' ' || line_end[1] == '\t')) {
+                const char *next = memchr(line_end + 1, '\n', end - line_end - 1);
+                line_end = next ? next : end;
+            }
+            parse_relation_names(cursor + key_length + 1, line_end, callback, context);
+            break;
+        }
+        cursor = line_end + 1;
+    }
+}
+
+static int compare_provisions(const void *a, const void *b)
+{
+    const Provision *left = a;
+    const Provision *right = b;
+    int result = compare_fields(left->name, right->name);
+    return result != 0 ? result : (left->provider > right->provider) - (left->provider < right->provider);
+}
+
+// Growable list of the installed Provides, filled one provider at a time
+typedef struct {
+    Provision *provisions;
+    size_t count;
+    size_t capacity;
+    size_t provider;
+} ProvisionList;
+
+static void collect_provision(DpkgField name, void *context)
+{
+    ProvisionList *list = context;
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->provisions = realloc(list->provisions, list->capacity * sizeof(Provision));
+    }
+    list->provisions[list->count].name = name;
+    list->provisions[list->count].provider = list->provider;
+    list->count++;
+}
+
+static void mark_package(MarkContext *mark, size_t position)
+{
+    if (mark->marked[position] || !mark->status->packages[position].installed) return;
+    mark->marked[position] = 1;
+    mark->stack[mark->depth++] = position;
+}
+
+// Keep every installed package, real or providing, a relationship names
+static void mark_relation(DpkgField name, void *context)
+{
+    MarkContext *mark = context;
+    const DpkgStatus *status = mark->status;
+    for (size_t i = find_first_package(status, name);
+         i < status->count && compare_fields(status->packages[i].name, name) == 0; i++) {
+        mark_package(mark, i);
+    }
+
+    size_t low = 0;
+    size_t high = mark->provision_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (compare_fields(mark->provisions[middle].name, name) < 0) low = middle + 1;
+        else high = middle;
+    }
+    for (size_t i = low; i < mark->provision_count && compare_fields(mark->provisions[i].name, name) == 0; i++) {
+        mark_package(mark, mark->provisions[i].provider);
+    }
+}
+
+static void add_keep_pattern(KeepPatterns *keep, const char *pattern, size_t length)
+{
+    char expression[512];
+    if (length >= sizeof(expression)) return;
+    snprintf(expression, sizeof(expression), "%.*s", (int)length, pattern);
+    if (keep->count == keep->capacity) {
+        keep->capacity = keep->capacity ? keep->capacity * 2 : 16;
+        keep->patterns = realloc(keep->patterns, keep->capacity * sizeof(regex_t));
+    }
+    if (regcomp(&keep->patterns[keep->count], expression, REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0) {
+        keep->count++;
+    }
+}
+
+// Join a configuration scope and name with "::"
+static void join_config_key(char *key, size_t size, const char *scope, const char *name)
+{
+    snprintf(key, size, "%s%s%s", scope, *scope && *name ? "::" : "", name);
+}
+
+// Collect the APT::NeverAutoRemove values of one apt.conf file: nested
+// "name { ... };" scopes, "name::sub value;" lines and bare list values
+static void read_keep_patterns(const char *path, KeepPatterns *keep)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *data = malloc(size > 0 ? size : 1);
+    size = (long)fread(data, 1, size > 0 ? size : 0, file);
+    fclose(file);
+
+    char scope[512] = "";
+    size_t scope_lengths[MAX_CONFIG_DEPTH];
+    int depth = 0;
+    char name[256] = "";
+    const char *cursor = data;
+    const char *end = data + size;
+    while (cursor < end) {
+        char c = *cursor;
+        if (isspace((unsigned char)c)) {
+            cursor++;
+        } else if (c == '#' || (c == '/' && cursor + 1 < end && cursor[1] == '/')) {
+            // Comments, and directives such as #clear and #include
+            const char *line_end = memchr(cursor, '\n', end - cursor);
+            cursor = line_end ? line_end + 1 : end;
+        } else if (c == '/' && cursor + 1 < end && cursor[1] == '*') {
+            const char *close = memmem(cursor + 2, end - cursor - 2, "*/", 2);
+            cursor = close ? close + 2 : end;
+        } else if (c == '{') {
+            if (depth < MAX_CONFIG_DEPTH) {
+                scope_lengths[depth++] = strlen(scope);
+                char joined[sizeof(scope) + sizeof(name) + 2];
+                join_config_key(joined, sizeof(joined), scope, name);
+                size_t joined_length = strlen(joined);
+                if (joined_length < sizeof(scope)) memcpy(scope, joined, joined_length + 1);
+            }
+            name[0] = '\0';
+            cursor++;
+        } else if (c == '}') {
+            if (depth > 0) scope[scope_lengths[--depth]] = '\0';
+            name[0] = '\0';
+            cursor++;
+        } else if (c == ';') {
+            name[0] = '\0';
+            cursor++;
+        } else if (c == '"') {
+            const char *close = memchr(cursor + 1, '"', end - cursor - 1);
+            if (!close) break;
+            char key[sizeof(scope) + sizeof(name) + 2];
+            join_config_key(key, sizeof(key), scope, name);
+            size_t key_length = strlen(key);
+            if (key_length >= 2 && strcmp(key + key_length - 2, "::") == 0) key[key_length - 2] = '\0';
+            if (strcasecmp(key, "APT::NeverAutoRemove") == 0) add_keep_pattern(keep, cursor + 1, close - cursor - 1);
+            name[0] = '\0';
+            cursor = close + 1;
+        } else {
+            const char *start = cursor;
+            while (cursor < end && !isspace((unsigned char)*cursor) && !strchr("{};\"", *cursor)) cursor++;
+            snprintf(name, sizeof(name), "%.*s", (int)(cursor - start), start);
+        }
+    }
+    free(data);
+}
+
+// apt reads apt.conf.d files named only with [A-Za-z0-9_.-] that have
+// no extension or ".conf"
+static int is_config_file_name(const char *file_name)
+{
+    if (file_name[0] == '.' || file_name[strspn(file_name, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                                                           "0123456789_.-")] != '\0') {
+        return 0;
+    }
+    const char *extension = strrchr(file_name, '.');
+    return !extension || strcmp(extension, ".conf") == 0;
+}
+
+static void load_keep_patterns(KeepPatterns *keep)
+{
+    memset(keep, 0, sizeof(*keep));
+    const char *config_dir = get_apt_config_dir();
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/apt.conf", config_dir);
+    read_keep_patterns(path, keep);
+
+    snprintf(path, sizeof(path), "%s/apt.conf.d", config_dir);
+    DIR *dir = opendir(path);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_config_file_name(entry->d_name)) continue;
+        snprintf(path, sizeof(path), "%s/apt.conf.d/%s", config_dir, entry->d_name);
+        read_keep_patterns(path, keep);
+    }
+    closedir(dir);
+}
+
+static void free_keep_patterns(KeepPatterns *keep)
+{
+    for (int i = 0; i < keep->count; i++) regfree(&keep->patterns[i]);
+    free(keep->patterns);
+}
+
+// Whether apt never removes this package automatically: it matches
+// APT::NeverAutoRemove, or it belongs to the running kernel
+static int is_kept_package(const KeepPatterns *keep, const char *release, DpkgField name)
+{
+    size_t release_length = release ? strlen(release) : 0;
+    if (release_length > 0 && name.length > release_length &&
+        name.data[name.length - release_length - 1] == '-' &&
+        memcmp(name.data + name.length - release_length, release, release_length) == 0) {
+        return 1;
+    }
+    if (keep->count == 0) return 0;
+
+    char key[256];
+    if (name.length >= sizeof(key)) return 0;
+    snprintf(key, sizeof(key), "%.*s", (int)name.length, name.data);
+    for (int i = 0; i < keep->count; i++) {
+        if (regexec(&keep->patterns[i], key, 0, NULL, 0) == 0) return 1;
+    }
+    return 0;
+}
+
+int find_autoremovable_packages(const DpkgStatus *status, RemovableCallback callback, void *context)
+{
+    size_t count = status->count;
+    unsigned char *auto_installed = calloc(count ? count : 1, 1);
+    StatusMarks states = {status, auto_installed};
+    if (read_auto_installed(mark_status_package, &states) != 0) {
+        free(auto_installed);
+        return -1;
+    }
+
+    // Virtual names, resolved through what is installed rather than
+    // through the candidate versions apt would upgrade to
+    ProvisionList provides = {0};
+    for (size_t i = 0; i < count; i++) {
+        if (!status->packages[i].installed) continue;
+        provides.provider = i;
+        parse_stanza_relations(status->packages[i].stanza, provides_fields, collect_provision, &provides);
+    }
+    qsort(provides.provisions, provides.count, sizeof(Provision), compare_provisions);
+
+    KeepPatterns keep;
+    load_keep_patterns(&keep);
+    struct utsname system;
+    const char *release = uname(&system) == 0 ? system.release : NULL;
+
+    // Mark from the roots: manual, essential and never-removed packages.
+    // Like apt's defaults, Recommends and Suggests keep packages too.
+    MarkContext mark = {status, provides.provisions, provides.count, NULL, NULL, 0};
+    mark.marked = calloc(count ? count : 1, 1);
+    mark.stack = malloc((count ? count : 1) * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        const DpkgPackage *package = &status->packages[i];
+        if (!package->installed) continue;
+        if (!auto_installed[i] || package->essential || is_kept_package(&keep, release, package->name)) {
+            mark_package(&mark, i);
+        }
+    }
+    while (mark.depth > 0) {
+        const DpkgPackage *package = &status->packages[mark.stack[--mark.depth]];
+        parse_stanza_relations(package->stanza, relation_fields, mark_relation, &mark);
+    }
+
+    // Sweep: installed, automatic and unreachable
+    int removable = 0;
+    for (size_t i = 0; i < count; i++) {
+        const DpkgPackage *installed = &status->packages[i];
+        if (!installed->installed || mark.marked[i]) continue;
+        RemovablePackage package;
+        package.name = installed->name;
+        package.version = installed->version;
+        package.installed_size = installed->installed_size;
+        callback(&package, context);
+        removable++;
+    }
+
+    free_keep_patterns(&keep);
+    free(provides.provisions);
+    free(mark.stack);
+    free(mark.marked);
+    free(auto_installed);
+    return removable;
+}
@@ -0,0 +1,39 @@
+/**
+ * lime-apt Autoremove Preview
+ *
+ * Computes what "apt autoremove" would remove without taking the dpkg
+ * lock: mark everything reachable from the installed packages that are
+ * manual, essential, matched by APT::NeverAutoRemove or part of the
+ * running kernel, following the Pre-Depends, Depends, Recommends and
+ * Suggests of the installed versions in the dpkg status, then sweep the
+ * installed packages left unmarked.
+ */
+
+#ifndef AUTOREMOVE_H
+#define AUTOREMOVE_H
+
+#include <stdint.h>
+
+#include "index.h"
+#include "dpkg.h"
+
+// An installed package nothing needs any more
+typedef struct {
+    DpkgField name;
+    DpkgField version;
+    unsigned long installed_size;   // KiB
+} RemovablePackage;
+
+// Receives each removable package, in name order
+typedef void (*RemovableCallback)(const RemovablePackage *package, void *context);
+
+// One byte per package id, non-zero when apt's extended_states marks it
+// automatically installed. Returns NULL if the file cannot be read.
+// Caller frees.
+unsigned char *mark_auto_installed_packages(const PackageIndex *index);
+
+// Mark and sweep. Returns the number of removable packages, or -1 if
+// apt's extended_states is unavailable.
+int find_autoremovable_packages(const DpkgStatus *status, RemovableCallback callback, void *context);
+
+#endif // AUTOREMOVE_H
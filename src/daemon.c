@@ -0,0 +1,385 @@
+/**
+ * lime-apt Query Daemon
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <grp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "daemon.h"
+#include "dpkg.h"
+#include "index.h"
+#include "paths.h"
+
+#define DAEMON_PROTOCOL "lime-apt/2"
+#define MAX_REQUEST_SIZE 65536
+#define PATH_COUNT 5
+#define REPLY_ACCEPTED 0
+#define REPLY_DECLINED -1
+
+// Environment that shapes a command's output, or that of the apt tools
+// it falls back to. The worker takes the client's values.
+static const char *const forwarded_environment[] = {
+    "TERM", "COLUMNS", "LINES", "NO_COLOR", "LANG", "LANGUAGE", "LC_ALL", "LC_CTYPE", "LC_MESSAGES",
+};
+#define ENV_COUNT (int)(sizeof(forwarded_environment) / sizeof(forwarded_environment[0]))
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+// What the daemon holds for its workers to inherit
+typedef struct {
+    PackageIndex index;
+    int have_index;
+    DpkgStatus status;
+    int have_status;
+    int stale;
+} ResidentState;
+
+static volatile sig_atomic_t stopping;
+
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stopping = 1;
+}
+
+// The locations an answer depends on. Client and daemon must agree on
+// them, or the client's environment points somewhere else.
+static void get_state_paths(const char *out_paths[PATH_COUNT])
+{
+    out_paths[0] = get_lists_dir();
+    out_paths[1] = get_cache_dir();
+    out_paths[2] = get_dpkg_status_path();
+    out_paths[3] = get_extended_states_path();
+    out_paths[4] = get_archives_dir();
+}
+
+// Check the client's environment fields: "NAME=value" when set, "NAME"
+// when not, in forwarded_environment order
+static int check_environment_fields(char *const fields[])
+{
+    for (int i = 0; i < ENV_COUNT; i++) {
+        size_t name_length = strlen(forwarded_environment[i]);
+        if (strncmp(fields[i], forwarded_environment[i], name_length) != 0 ||
+            (fields[i][name_length] != '\0' && fields[i][name_length] != '=')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void apply_environment_fields(char *const fields[])
+{
+    for (int i = 0; i < ENV_COUNT; i++) {
+        const char *value = strchr(fields[i], '=');
+        if (value) setenv(forwarded_environment[i], value + 1, 1);
+        else unsetenv(forwarded_environment[i]);
+    }
+}
+
+static int connect_daemon(void)
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", get_socket_path());
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Swap in fresh copies of the index and the dpkg database. A stale or
+// missing index is not held, so queries handle it as they would alone.
+static void load_resident_state(ResidentState *state)
+{
+    if (state->have_index) {
+        set_resident_index(NULL);
+        close_package_index(&state->index);
+    }
+    if (state->have_status) {
+        set_resident_dpkg_status(NULL);
+        close_dpkg_status(&state->status);
+    }
+
+    state->have_index = open_package_index(&state->index) == 0;
+    if (state->have_index) set_resident_index(&state->index);
+    else close_package_index(&state->index);
+
+    state->have_status = open_dpkg_status(&state->status) == 0;
+    if (state->have_status) set_resident_dpkg_status(&state->status);
+    state->stale = 0;
+}
+
+// Consume inotify events; the dpkg directory only matters for the
+// status file itself
+static void read_state_events(int inotify_fd, int dpkg_watch, ResidentState *state)
+{
+    const char *status_path = get_dpkg_status_path();
+    const char *status_name = strrchr(status_path, '/') ? strrchr(status_path, '/') + 1 : status_path;
+    char buffer[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *cursor = buffer; cursor < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+            if (event->wd != dpkg_watch || (event->len && strcmp(event->name, status_name) == 0)) {
+                state->stale = 1;
+            }
+            cursor += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static int watch_state_directories(int inotify_fd)
+{
+    inotify_add_watch(inotify_fd, get_lists_dir(), WATCH_MASK);
+    inotify_add_watch(inotify_fd, get_cache_dir(), WATCH_MASK);
+
+    // dpkg replaces its status file by renaming a new one over it
+    char directory[4096] = ".";
+    const char *status_path = get_dpkg_status_path();
+    const char *slash = strrchr(status_path, '/');
+    if (slash == status_path) strcpy(directory, "/");
+    else if (slash) snprintf(directory, sizeof(directory), "%.*s", (int)(slash - status_path), status_path);
+    return inotify_add_watch(inotify_fd, directory, WATCH_MASK);
+}
+
+// Worker side of one connection: check the request, run it as the
+// caller on the caller's descriptors, and report the exit code
+static void serve_query(int connection, DaemonFilter filter, DaemonHandler handler)
+{
+    signal(SIGCHLD, SIG_DFL);
+
+    char *request = malloc(MAX_REQUEST_SIZE);
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec io = { request, MAX_REQUEST_SIZE - 1 };
+    struct msghdr message = { 0 };
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+
+    int fds[3] = { -1, -1, -1 };
+    struct cmsghdr *header = length > 0 ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header && header->cmsg_type == SCM_RIGHTS && header->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    }
+
+    // Protocol, the client's state paths and environment, then its argv
+    char **fields = malloc((length > 0 ? length + 2 : 2) * sizeof(char*));
+    int field_count = 0;
+    if (length > 0) {
+        request[length] = '\0';
+        for (char *cursor = request; cursor < request + length; cursor += strlen(cursor) + 1) {
+            fields[field_count++] = cursor;
+        }
+    }
+    const char *paths[PATH_COUNT];
+    get_state_paths(paths);
+    int accepted = fds[2] >= 0 && field_count >= PATH_COUNT + ENV_COUNT + 3 &&
+                   strcmp(fields[0], DAEMON_PROTOCOL) == 0;
+    for (int i = 0; accepted && i < PATH_COUNT; i++) {
+        accepted = strcmp(fields[i + 1], paths[i]) == 0;
+    }
+    char **environment = accepted ? fields + PATH_COUNT + 1 : NULL;
+    accepted = accepted && check_environment_fields(environment);
+    int argc = accepted ? field_count - PATH_COUNT - ENV_COUNT - 1 : 0;
+    char **argv = accepted ? environment + ENV_COUNT : fields;
+    argv[argc] = NULL;
+
+    // Without root there are no rights to drop, so only answer the
+    // daemon's own user; anyone else runs the query themselves
+    struct ucred peer;
+    socklen_t peer_length = sizeof(peer);
+    accepted = accepted && filter(argc, argv) &&
+               getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer, &peer_length) == 0 &&
+               (geteuid() == 0 || peer.uid == geteuid());
+
+    int reply = accepted ? REPLY_ACCEPTED : REPLY_DECLINED;
+    if (send(connection, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply) || !accepted) _exit(0);
+
+    pid_t worker = fork();
+    if (worker == 0) {
+        for (int i = 0; i < 3; i++) dup2(fds[i], i);
+        close(connection);
+
+        // Answer with the caller's rights, not the daemon's
+        if (geteuid() == 0 && peer.uid != 0 &&
+            (setgroups(0, NULL) != 0 || setgid(peer.gid) != 0 || setuid(peer.uid) != 0)) {
+            _exit(1);
+        }
+        apply_environment_fields(environment);
+        exit(handler(argc, argv));
+    }
+    for (int i = 0; i < 3; i++) close(fds[i]);
+
+    int status = 0;
+    int exit_code = 1;
+    if (worker > 0) {
+        while (waitpid(worker, &status, 0) < 0 && errno == EINTR);
+        exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+    send(connection, &exit_code, sizeof(exit_code), MSG_NOSIGNAL);
+    _exit(0);
+}
+
+int run_daemon(DaemonFilter filter, DaemonHandler handler)
+{
+    const char *path = get_socket_path();
+    int running = connect_daemon();
+    if (running >= 0) {
+        close(running);
+        fprintf(stderr, "lime-aptd: already serving on %s\n", path);
+        return 1;
+    }
+
+    unlink(path);
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, 64) != 0) {
+        fprintf(stderr, "lime-aptd: cannot listen on %s: %s\n", path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+    // Queries are read-only and run with the caller's rights, or are
+    // declined for other users when the daemon is not root
+    chmod(path, 0666);
+
+    // Watch before loading, so no change slips in between
+    mkdir(get_cache_dir(), 0755);
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int dpkg_watch = watch_state_directories(inotify_fd);
+    ResidentState state;
+    memset(&state, 0, sizeof(state));
+    load_resident_state(&state);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = listener };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event);
+    event.data.fd = inotify_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &event);
+
+    fprintf(stderr, "lime-aptd: serving %u packages on %s\n",
+            state.have_index ? state.index.header->package_count : 0, path);
+    while (!stopping) {
+        struct epoll_event events[8];
+        int ready = epoll_wait(epoll_fd, events, 8, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.fd == inotify_fd) {
+                read_state_events(inotify_fd, dpkg_watch, &state);
+                continue;
+            }
+            int connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+            if (connection < 0) continue;
+
+            // Reload lazily: apt rewrites many lists in one update
+            if (state.stale) load_resident_state(&state);
+            fflush(NULL);
+            if (fork() == 0) {
+                close(listener);
+                close(inotify_fd);
+                close(epoll_fd);
+                serve_query(connection, filter, handler);
+            }
+            close(connection);
+        }
+    }
+
+    unlink(path);
+    close(epoll_fd);
+    close(inotify_fd);
+    close(listener);
+    return 0;
+}
+
+int forward_to_daemon(int argc, char *argv[], int *out_exit_code)
+{
+    int fd = connect_daemon();
+    if (fd < 0) return -1;
+
+    char *request = malloc(MAX_REQUEST_SIZE);
+    const char *paths[PATH_COUNT];
+    get_state_paths(paths);
+    size_t length = 0;
+    int fits = 1;
+    for (int i = -1; i < PATH_COUNT + ENV_COUNT + argc && fits; i++) {
+        const char *field = i < 0 ? DAEMON_PROTOCOL : (i < PATH_COUNT ? paths[i] : NULL);
+        const char *value = NULL;
+        if (i >= PATH_COUNT + ENV_COUNT) {
+            field = argv[i - PATH_COUNT - ENV_COUNT];
+        } else if (i >= PATH_COUNT) {
+            field = forwarded_environment[i - PATH_COUNT];
+            value = getenv(field);
+        }
+
+        // Environment fields carry "=value" when the variable is set
+        size_t field_length = strlen(field);
+        size_t value_length = value ? strlen(value) + 1 : 0;
+        fits = length + field_length + value_length + 1 < MAX_REQUEST_SIZE;
+        if (!fits) break;
+        memcpy(request + length, field, field_length);
+        length += field_length;
+        if (value) {
+            request[length] = '=';
+            memcpy(request + length + 1, value, value_length - 1);
+            length += value_length;
+        }
+        request[length++] = '\0';
+    }
+
+    // Hand over stdin, stdout and stderr so the answer lands right here
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec io = { request, length };
+    struct msghdr message = { 0 };
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    int reply = REPLY_DECLINED;
+    int sent = fits && sendmsg(fd, &message, MSG_NOSIGNAL) == (ssize_t)length;
+    free(request);
+    if (!sent || recv(fd, &reply, sizeof(reply), 0) != sizeof(reply) || reply != REPLY_ACCEPTED) {
+        close(fd);
+        return -1;
+    }
+
+    // Accepted: the command's output is already on its way
+    if (recv(fd, out_exit_code, sizeof(*out_exit_code), 0) != sizeof(*out_exit_code)) *out_exit_code = 1;
+    close(fd);
+    return 0;
+}
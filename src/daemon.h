@@ -0,0 +1,32 @@
+/**
+ * lime-apt Query Daemon
+ *
+ * lime-aptd keeps the package index and the dpkg database loaded and
+ * answers read-only queries over a Unix socket. The CLI sends its
+ * command line and the environment that shapes output along with its
+ * stdin, stdout and stderr; the daemon forks a worker that inherits the
+ * warm state, takes on the caller's user and environment and runs the
+ * command straight onto the caller's terminal. A daemon not started as
+ * root answers only its own user.
+ * inotify on the lists, cache and dpkg directories marks the state
+ * stale, and it is reloaded before the next query.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+// Decides whether the daemon may answer a command line
+typedef int (*DaemonFilter)(int argc, char *argv[]);
+
+// Runs a command line in a worker, returning its exit code
+typedef int (*DaemonHandler)(int argc, char *argv[]);
+
+// Serve queries until SIGTERM or SIGINT. Returns the process exit code.
+int run_daemon(DaemonFilter filter, DaemonHandler handler);
+
+// Have a running daemon answer the command line. Returns 0 with the
+// command's exit code in *out_exit_code, or -1 when no daemon took the
+// query and it should run here.
+int forward_to_daemon(int argc, char *argv[], int *out_exit_code);
+
+#endif // DAEMON_H
@@ -0,0 +1,228 @@
+/**
+ * lime-apt dpkg Status Reader
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dpkg.h"
+#include "paths.h"
+#include "timing.h"
+
+int compare_dpkg_field(DpkgField field, const char *value)
+{
+    size_t length = strlen(value);
+    int result = memcmp(field.data, value, field.length < length ? field.length : length);
+    if (result != 0) return result;
+    return field.length < length ? -1 : field.length > length;
+}
+
+static int compare_fields(DpkgField left, DpkgField right)
+{
+    int result = memcmp(left.data, right.data, left.length < right.length ? left.length : right.length);
+    if (result != 0) return result;
+    return left.length < right.length ? -1 : left.length > right.length;
+}
+
+static int compare_packages(const void *a, const void *b)
+{
+    const DpkgPackage *left = a;
+    const DpkgPackage *right = b;
+    int result = compare_fields(left->name, right->name);
+    return result != 0 ? result : compare_fields(left->architecture, right->architecture);
+}
+
+// Trim the value of a "Field: value" line
+static DpkgField get_field_value(const char *line, const char *line_end, size_t key_length)
+{
+    const char *value = line + key_length;
+    while (value < line_end && *value == ' ') value++;
+    const char *value_end = line_end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\r')) value_end--;
+
+    DpkgField field = {value, (size_t)(value_end - value)};
+    return field;
+}
+
+// The status field is "want flag state"; only the state matters here
+static int is_installed_state(DpkgField status)
+{
+    static const char state[] = " installed";
+    size_t length = sizeof(state) - 1;
+    return status.length >= length &&
+           memcmp(status.data + status.length - length, state, length) == 0;
+}
+
+// Parse every stanza, keeping only slices of the fields we need
+static size_t parse_status(const char *data, size_t size, DpkgPackage **out_packages)
+{
+    DpkgPackage *packages = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    DpkgPackage current;
+    memset(&current, 0, sizeof(current));
+
+    const char *cursor = data;
+    const char *end = data + size;
+    while (cursor <= end) {
+        const char *line_end = cursor < end ? memchr(cursor, '\n', end - cursor) : NULL;
+        if (!line_end) line_end = end;
+
+        // A blank line (or the end of the file) closes the stanza
+        if (line_end == cursor) {
+            if (current.name.length > 0) {
+                current.stanza.length = cursor - current.stanza.data;
+                current.installed = is_installed_state(current.status);
+                if (count == capacity) {
+                    capacity = capacity ? capacity * 2 : 1024;
+                    packages = realloc(packages, capacity * sizeof(DpkgPackage));
+                }
+                packages[count++] = current;
+            }
+            memset(&current, 0, sizeof(current));
+            if (cursor == end) break;
+            cursor = line_end + 1;
+            continue;
+        }
+
+        if (!current.stanza.data) current.stanza.data = cursor;
+
+        // Continuation lines start with a space; skip them cheaply
+        size_t length = line_end - cursor;
+        if (cursor[0] == 'P' && length > 8 && memcmp(cursor, "Package:", 8) == 0) {
+            current.name = get_field_value(cursor, line_end, 8);
+        }
+        else if (cursor[0] == 'V' && length > 8 && memcmp(cursor, "Version:", 8) == 0) {
+            current.version = get_field_value(cursor, line_end, 8);
+        }
+        else if (cursor[0] == 'A' && length > 13 && memcmp(cursor, "Architecture:", 13) == 0) {
+            current.architecture = get_field_value(cursor, line_end, 13);
+        }
+        else if (cursor[0] == 'S' && length > 7 && memcmp(cursor, "Status:", 7) == 0) {
+            current.status = get_field_value(cursor, line_end, 7);
+        }
+        else if (cursor[0] == 'S' && length > 8 && memcmp(cursor, "Section:", 8) == 0) {
+            current.section = get_field_value(cursor, line_end, 8);
+        }
+        else if (cursor[0] == 'I' && length > 15 && memcmp(cursor, "Installed-Size:", 15) == 0) {
+            DpkgField value = get_field_value(cursor, line_end, 15);
+            for (size_t i = 0; i < value.length && value.data[i] >= '0' && value.data[i] <= '9'; i++) {
+                current.installed_size = current.installed_size * 10 + (unsigned long)(value.data[i] - '0');
+            }
+        }
+        else if ((cursor[0] == 'E' && length > 10 && memcmp(cursor, "Essential:", 10) == 0) ||
+                 (cursor[0] == 'P' && length > 10 && memcmp(cursor, "Protected:", 10) == 0) ||
+                 (cursor[0] == 'I' && length > 10 && memcmp(cursor, "Important:", 10) == 0)) {
+            current.essential |= compare_dpkg_field(get_field_value(cursor, line_end, 10), "yes") == 0;
+        }
+
+        cursor = line_end + 1;
+        if (cursor > end) {
+            // File without a trailing newline: close the last stanza
+            cursor = end;
+        }
+    }
+
+    qsort(packages, count, sizeof(DpkgPackage), compare_packages);
+    *out_packages = packages;
+    return count;
+}
+
+// Held by lime-aptd so its workers skip parsing and sorting
+static DpkgStatus resident_status;
+static int have_resident_status;
+
+void set_resident_dpkg_status(const DpkgStatus *status)
+{
+    have_resident_status = status != NULL;
+    if (status) resident_status = *status;
+    else memset(&resident_status, 0, sizeof(resident_status));
+}
+
+int open_dpkg_status(DpkgStatus *out_status)
+{
+    if (have_resident_status) {
+        *out_status = resident_status;
+        return 0;
+    }
+    memset(out_status, 0, sizeof(*out_status));
+
+    int fd = open(get_dpkg_status_path(), O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // An empty database is valid: nothing is installed
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -2;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    out_status->data = data;
+    out_status->size = st.st_size;
+    int span = begin_span("Parsing dpkg status");
+    out_status->count = parse_status(data, st.st_size, &out_status->packages);
+    add_span_bytes(span, st.st_size);
+    end_span(span);
+    return 0;
+}
+
+void close_dpkg_status(DpkgStatus *status)
+{
+    if (have_resident_status && status->packages == resident_status.packages) {
+        memset(status, 0, sizeof(*status));
+        return;
+    }
+    if (status->data) munmap((void *)status->data, status->size);
+    free(status->packages);
+    memset(status, 0, sizeof(*status));
+}
+
+const DpkgPackage *find_dpkg_package(const DpkgStatus *status, const char *name)
+{
+    // Split an optional ":arch" qualifier off the name
+    const char *colon = strchr(name, ':');
+    DpkgField key = {name, colon ? (size_t)(colon - name) : strlen(name)};
+    const char *architecture = colon ? colon + 1 : NULL;
+
+    // Find the first entry with this name
+    size_t low = 0;
+    size_t high = status->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (compare_fields(status->packages[middle].name, key) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    const DpkgPackage *found = NULL;
+    for (size_t i = low; i < status->count && compare_fields(status->packages[i].name, key) == 0; i++) {
+        const DpkgPackage *package = &status->packages[i];
+        if (architecture && compare_dpkg_field(package->architecture, architecture) != 0) continue;
+        if (package->installed) return package;
+        if (!found) found = package;
+    }
+    return found;
+}
+
+int is_dpkg_installed(const DpkgStatus *status, const char *name)
+{
+    const DpkgPackage *package = find_dpkg_package(status, name);
+    return package && package->installed;
+}
@@ -0,0 +1,62 @@
+/**
+ * lime-apt dpkg Status Reader
+ *
+ * Zero-copy view of the dpkg status database. The file is mapped
+ * read-only and every field is a slice into the mapping, so answering
+ * "is X installed, and at what version" costs one pass over the file
+ * and no allocation per package.
+ */
+
+#ifndef DPKG_H
+#define DPKG_H
+
+#include <stddef.h>
+
+// A field value inside the mapping. Not NUL-terminated.
+typedef struct {
+    const char *data;
+    size_t length;
+} DpkgField;
+
+// One stanza of the status file
+typedef struct {
+    DpkgField name;
+    DpkgField version;
+    DpkgField architecture;
+    DpkgField section;
+    DpkgField status;           // "want flag state", e.g. "install ok installed"
+    DpkgField stanza;           // The whole stanza, for fields not parsed here
+    unsigned long installed_size;   // KiB, from Installed-Size
+    int installed;              // State is "installed"
+    int essential;              // Essential, Protected or Important: yes
+} DpkgPackage;
+
+// A mapped status file, with its packages sorted by name
+typedef struct {
+    const char *data;
+    size_t size;
+    DpkgPackage *packages;
+    size_t count;
+} DpkgStatus;
+
+// Map and parse the status file. Returns 0 on success, -1 if it cannot
+// be opened, -2 if it cannot be mapped.
+int open_dpkg_status(DpkgStatus *out_status);
+
+void close_dpkg_status(DpkgStatus *status);
+
+// Answer every later open with this parsed database instead of the
+// file, or with the file again when NULL
+void set_resident_dpkg_status(const DpkgStatus *status);
+
+// Look up "name" or "name:arch". When a name is present for several
+// architectures the installed one wins. Returns NULL if absent.
+const DpkgPackage *find_dpkg_package(const DpkgStatus *status, const char *name);
+
+// Whether "name" is fully installed
+int is_dpkg_installed(const DpkgStatus *status, const char *name);
+
+// Compare a field with a C string, strcmp-style
+int compare_dpkg_field(DpkgField field, const char *value);
+
+#endif // DPKG_H
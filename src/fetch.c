@@ -0,0 +1,237 @@
+/**
+ * lime-apt Parallel Archive Fetcher
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fetch.h"
+#include "paths.h"
+#include "sha256.h"
+#include "timing.h"
+
+// Mirror part of a URL ("scheme://host/...")
+static void get_url_host(const char *url, char *buffer, size_t buffer_size)
+{
+    const char *host = strstr(url, "://");
+    host = host ? host + 3 : url;
+    size_t length = strcspn(host, "/");
+    snprintf(buffer, buffer_size, "%.*s", (int)length, host);
+}
+
+// Parse "'url' file_name size HASH:hex". Returns 0 on success.
+static int parse_uri_line(const char *line, FetchItem *out_item)
+{
+    if (line[0] != '\'') return -1;
+    const char *url_end = strchr(line + 1, '\'');
+    if (!url_end) return -1;
+
+    char rest[4096];
+    snprintf(rest, sizeof(rest), "%s", url_end + 1);
+    char *save;
+    char *file_name = strtok_r(rest, " \t", &save);
+    char *size = strtok_r(NULL, " \t", &save);
+    char *hash = strtok_r(NULL, " \t", &save);
+    if (!file_name || !size) return -1;
+
+    memset(out_item, 0, sizeof(*out_item));
+    out_item->url = strndup(line + 1, url_end - line - 1);
+    out_item->file_name = strdup(file_name);
+    out_item->size = strtoull(size, NULL, 10);
+    if (hash && strncmp(hash, "SHA256:", 7) == 0 && strlen(hash + 7) == 64) {
+        memcpy(out_item->sha256, hash + 7, 65);
+    }
+    return 0;
+}
+
+static void get_partial_path(const FetchItem *item, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "%s/partial/%s", get_archives_dir(), item->file_name);
+}
+
+static void collect_uri_line(Supervisor *supervisor, int job, const char *line, void *context)
+{
+    (void)supervisor;
+    (void)job;
+    ArchiveFetch *fetch = context;
+    FetchItem item;
+    if (parse_uri_line(line, &item) != 0) return;
+
+    if (fetch->count == fetch->capacity) {
+        fetch->capacity = fetch->capacity ? fetch->capacity * 2 : 64;
+        fetch->items = realloc(fetch->items, fetch->capacity * sizeof(FetchItem));
+        fetch->hosts = realloc(fetch->hosts, fetch->capacity * sizeof(int));
+    }
+
+    // Number the mirrors so transfers can be limited per mirror
+    char host[256];
+    get_url_host(item.url, host, sizeof(host));
+    int h = 0;
+    while (h < fetch->host_count && strcmp(fetch->host_table[h].name, host) != 0) h++;
+    if (h == fetch->host_count) {
+        fetch->host_table = realloc(fetch->host_table, (h + 1) * sizeof(FetchHost));
+        memcpy(fetch->host_table[h].name, host, sizeof(host));
+        fetch->host_table[h].group = -1;
+        fetch->host_count++;
+    }
+    fetch->hosts[fetch->count] = h;
+    fetch->items[fetch->count++] = item;
+}
+
+// Check a finished download against apt's size and hash, then move it
+// into the cache
+static int accept_transfer(Supervisor *supervisor, int job, void *context)
+{
+    ArchiveFetch *fetch = context;
+    const FetchItem *item = &fetch->items[job - fetch->first_job];
+    char partial_path[4200];
+    get_partial_path(item, partial_path, sizeof(partial_path));
+
+    struct stat st;
+    int ok = stat(partial_path, &st) == 0 && (uint64_t)st.st_size == item->size;
+    if (ok && item->sha256[0]) {
+        char hex[65];
+        ok = hash_file_sha256(partial_path, hex) == 0 && strcmp(hex, item->sha256) == 0;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", get_archives_dir(), item->file_name);
+    if (ok && rename(partial_path, path) == 0) {
+        add_span_bytes(supervisor->jobs[job].span, item->size);
+        return 0;
+    }
+    unlink(partial_path);
+    return -1;
+}
+
+// Take apt's archive cache lock the way apt does, so no apt run writes
+// partial/ while our transfers do. Returns the descriptor, or -1 when
+// the cache is locked or cannot be opened.
+static int lock_archives(void)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/lock", get_archives_dir());
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (fd < 0) return -1;
+    struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    if (fcntl(fd, F_SETLK, &lock) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void unlock_archives(ArchiveFetch *fetch)
+{
+    if (fetch->lock_fd < 0) return;
+    close(fetch->lock_fd);
+    fetch->lock_fd = -1;
+}
+
+static void report_transfer(Supervisor *supervisor, int job, void *context)
+{
+    ArchiveFetch *fetch = context;
+    JobState state = supervisor->jobs[job].state;
+    if (state == JOB_WAITING || state == JOB_RUNNING) return;
+
+    const FetchItem *item = &fetch->items[job - fetch->first_job];
+    int ok = state == JOB_SUCCEEDED;
+    if (ok) {
+        fetch->fetched++;
+        fetch->bytes += item->size;
+    }
+    fetch->done++;
+    // The cache is complete; apt may lock it again
+    if (fetch->done == fetch->count) unlock_archives(fetch);
+    if (fetch->callback) fetch->callback(item, ok, fetch->done, fetch->count, fetch->context);
+}
+
+// apt has answered: queue one transfer per archive, with curl, or wget
+// where curl is missing
+static int queue_transfers(Supervisor *supervisor, int job, void *context)
+{
+    ArchiveFetch *fetch = context;
+    char partial_dir[4096];
+    snprintf(partial_dir, sizeof(partial_dir), "%s/partial", get_archives_dir());
+    mkdir(get_archives_dir(), 0755);
+    mkdir(partial_dir, 0755);
+
+    // Hold the cache for the whole transfer phase; if apt has it, leave
+    // the downloads to apt
+    if (fetch->count > 0) {
+        fetch->lock_fd = lock_archives();
+        if (fetch->lock_fd < 0) return -1;
+    }
+
+    for (int h = 0; h < fetch->host_count; h++) {
+        fetch->host_table[h].group = add_job_group(supervisor, fetch->connections);
+    }
+
+    JobHooks hooks = { NULL, accept_transfer, report_transfer, fetch };
+    fetch->first_job = supervisor->count;
+    for (int i = 0; i < fetch->count; i++) {
+        char partial_path[4200];
+        get_partial_path(&fetch->items[i], partial_path, sizeof(partial_path));
+        char *argv[] = {
+            "sh", "-c", "curl -fsL --retry 2 -o \"$1\" \"$2\" || wget -q -t 3 -O \"$1\" \"$2\"",
+            "sh", partial_path, fetch->items[i].url, NULL
+        };
+        int transfer = add_job(supervisor, fetch->items[i].file_name, argv,
+                               fetch->host_table[fetch->hosts[i]].group, &hooks);
+        add_job_dependency(supervisor, transfer, job);
+        for (int t = 0; t < fetch->then_count; t++) add_job_ordering(supervisor, fetch->then_jobs[t], transfer);
+    }
+    return 0;
+}
+
+static void note_listing_failure(Supervisor *supervisor, int job, void *context)
+{
+    ArchiveFetch *fetch = context;
+    if (supervisor->jobs[job].state == JOB_FAILED || supervisor->jobs[job].state == JOB_SKIPPED) {
+        fetch->listing_failed = 1;
+    }
+}
+
+int queue_archive_fetch(Supervisor *supervisor, ArchiveFetch *fetch, char *const apt_args[], int connections,
+                        FetchCallback callback, void *context)
+{
+    memset(fetch, 0, sizeof(*fetch));
+    fetch->connections = connections > 0 ? connections : 1;
+    fetch->lock_fd = -1;
+    fetch->callback = callback;
+    fetch->context = context;
+
+    JobHooks hooks = { collect_uri_line, queue_transfers, note_listing_failure, fetch };
+    fetch->listing_job = add_job(supervisor, "Resolving archives", apt_args, -1, &hooks);
+    return fetch->listing_job;
+}
+
+void hold_until_fetched(Supervisor *supervisor, ArchiveFetch *fetch, int job)
+{
+    for (int t = 0; t < fetch->then_count; t++) {
+        if (fetch->then_jobs[t] == job) return;
+    }
+    // The transfers are queued once the listing finishes; until then it
+    // holds the job back itself
+    add_job_ordering(supervisor, job, fetch->listing_job);
+    fetch->then_jobs = realloc(fetch->then_jobs, (fetch->then_count + 1) * sizeof(int));
+    fetch->then_jobs[fetch->then_count++] = job;
+}
+
+void free_archive_fetch(ArchiveFetch *fetch)
+{
+    unlock_archives(fetch);
+    for (int i = 0; i < fetch->count; i++) {
+        free(fetch->items[i].url);
+        free(fetch->items[i].file_name);
+    }
+    free(fetch->items);
+    free(fetch->hosts);
+    free(fetch->host_table);
+    free(fetch->then_jobs);
+    memset(fetch, 0, sizeof(*fetch));
+}
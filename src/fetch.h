@@ -0,0 +1,72 @@
+/**
+ * lime-apt Parallel Archive Fetcher
+ *
+ * Downloads the archives an apt operation needs before apt runs, the
+ * way apt-fast does: apt-get --print-uris lists them with sizes and
+ * hashes, several transfers per mirror run at once, and every finished
+ * file is checked and moved into apt's archive cache, so apt can then
+ * install with --no-download. The work runs as supervisor jobs, so it
+ * overlaps with whatever else the supervisor is running. apt's archive
+ * cache lock is held from the first transfer until the last one ends.
+ */
+
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stdint.h>
+
+#include "supervisor.h"
+
+// One archive apt wants downloaded
+typedef struct {
+    char *url;
+    char *file_name;            // Name apt expects in the archive cache
+    uint64_t size;
+    char sha256[65];            // Empty when apt gave another hash
+} FetchItem;
+
+// Called as each transfer finishes, with ok non-zero on success
+typedef void (*FetchCallback)(const FetchItem *item, int ok, int done, int total, void *context);
+
+// A mirror and the job group limiting transfers to it
+typedef struct {
+    char name[256];
+    int group;
+} FetchHost;
+
+// One queued fetch and its progress
+typedef struct {
+    int count;                  // Archives apt asked for
+    int listing_failed;         // apt could not plan the operation
+    int done;
+    int fetched;
+    uint64_t bytes;
+    FetchItem *items;
+    int capacity;
+    int *hosts;                 // Host of each item
+    FetchHost *host_table;
+    int host_count;
+    int first_job;              // Job of items[0]; the rest follow in order
+    int connections;
+    int listing_job;
+    int *then_jobs;             // Held back until every transfer has finished
+    int then_count;
+    int lock_fd;                // apt's archive cache lock while transfers run, or -1
+    FetchCallback callback;
+    void *context;
+} ArchiveFetch;
+
+// Queue a job asking apt which archives the command in apt_args (an
+// apt-get command line including --print-uris) needs and, once it has
+// answered, a download job for each, at most "connections" at a time
+// per mirror. Returns the id of the listing job.
+int queue_archive_fetch(Supervisor *supervisor, ArchiveFetch *fetch, char *const apt_args[], int connections,
+                        FetchCallback callback, void *context);
+
+// Hold a job back until every transfer has finished, for jobs that run
+// apt or dpkg on the archive cache while the fetch holds its lock
+void hold_until_fetched(Supervisor *supervisor, ArchiveFetch *fetch, int job);
+
+void free_archive_fetch(ArchiveFetch *fetch);
+
+#endif // FETCH_H
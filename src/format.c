@@ -0,0 +1,478 @@
+/**
+ * lime-apt apt Output Formatters
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "format.h"
+#include "output.h"
+#include "json.h"
+
+// Print a single search result (or its NDJSON record). "relevance" is
+// the ranking tier name, or NULL when results come unranked from apt.
+void print_search_result(const SearchMatch *match, const char *relevance)
+{
+    if (is_json_output()) {
+        begin_json_record("package");
+        add_json_string("name", match->name);
+        add_json_string("version", match->version);
+        add_json_bool("installed", match->installed);
+        add_json_string("description", match->description);
+        add_json_string("source", match->external ? "limeos" : "apt");
+        if (relevance) add_json_string("relevance", relevance);
+        end_json_record();
+        return;
+    }
+    
+    printf(BOLD WHITE "  %s" RESET, match->name);
+    printf(DIM " %s" RESET, match->version);
+    if (match->installed) {
+        printf(GREEN " [installed]" RESET);
+    }
+    if (match->external) {
+        printf(CYAN " [LimeOS]" RESET);
+    }
+    printf("\n");
+    if (strlen(match->description) > 0) {
+        printf(DIM "    %s" RESET "\n", match->description);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Print the closing line of a search. "total" is the number of matches
+// when known, which can exceed the number shown under --limit.
+void print_search_summary(int pkg_count, int total, int limited)
+{
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "search");
+        add_json_int("count", pkg_count);
+        add_json_int("total", total);
+        add_json_bool("limited", limited);
+        end_json_record();
+        return;
+    }
+    
+    if (limited && total > pkg_count) {
+        printf(DIM "  Showing top %d of %d package(s)" RESET "\n", pkg_count, total);
+    } else if (limited) {
+        printf(DIM "  Showing first %d package(s)" RESET "\n", pkg_count);
+    } else if (pkg_count > 0) {
+        printf(DIM "  Found %d package(s)" RESET "\n", pkg_count);
+    } else {
+        printf(YELLOW "  No packages found" RESET "\n");
+    }
+}
+
+static void print_apt_search_result(const char *name, const char *version, int installed,
+                                    const char *description)
+{
+    SearchMatch match = { name, version, description, installed, 0 };
+    print_search_result(&match, NULL);
+}
+
+void init_search_output(SearchOutput *output, int limit)
+{
+    memset(output, 0, sizeof(*output));
+    output->limit = limit;
+}
+
+// Print the result waiting in "output". Returns 1 once the limit is hit.
+static int flush_search_result(SearchOutput *output)
+{
+    print_apt_search_result(output->name, output->version, output->installed, output->description);
+    output->pending = 0;
+    if (++output->count == output->limit) {
+        output->limited = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int add_search_output_line(SearchOutput *output, char *line)
+{
+    if (output->limited) return 1;
+    
+    // Skip apt status messages
+    if (strstr(line, "Sorting...") || strstr(line, "Full Text Search...")) {
+        return 0;
+    }
+    
+    // Check if this is a package line (contains /)
+    if (strchr(line, '/') && !isspace((unsigned char)line[0])) {
+        // Print previous package if it had no description line
+        if (output->pending && flush_search_result(output)) return 1;
+        
+        // Check the status before the line is split up below
+        output->installed = strstr(line, "[installed") != NULL;
+        output->version[0] = '\0';
+        output->description[0] = '\0';
+        
+        // Parse new package: name/repo,repo version arch [status]
+        char *slash = strchr(line, '/');
+        *slash = '\0';
+        snprintf(output->name, sizeof(output->name), "%.*s", (int)sizeof(output->name) - 1, line);
+        
+        // Find version (after space)
+        char *rest = slash + 1;
+        char *space = strchr(rest, ' ');
+        if (space) {
+            space++;
+            // Skip to version
+            while (*space && !isdigit((unsigned char)*space) && *space != '+') space++;
+            size_t ver_len = strcspn(space, " ");
+            if (space[ver_len] == ' ' && ver_len < sizeof(output->version)) {
+                memcpy(output->version, space, ver_len);
+                output->version[ver_len] = '\0';
+            }
+        }
+        
+        output->pending = output->name[0] != '\0';
+    }
+    else if (output->pending && isspace((unsigned char)line[0])) {
+        // The description line completes the record, so print it now
+        char *desc = line;
+        while (*desc && isspace((unsigned char)*desc)) desc++;
+        snprintf(output->description, sizeof(output->description), "%.*s",
+                 (int)sizeof(output->description) - 1, desc);
+        return flush_search_result(output);
+    }
+    return 0;
+}
+
+int finish_search_output(SearchOutput *output)
+{
+    // Print last package
+    if (output->pending) {
+        print_apt_search_result(output->name, output->version, output->installed, output->description);
+        output->pending = 0;
+        output->count++;
+    }
+    
+    print_search_summary(output->count, output->count, output->limited);
+    return output->limited;
+}
+
+// Report a "Hit:"/"Get:" line as an NDJSON record
+static void print_repository_event(const char *status, const char *line)
+{
+    if (!is_json_output()) return;
+    
+    // Skip the "Hit:12 " prefix to get the source description
+    const char *source = strchr(line, ' ');
+    source = source ? source + 1 : line;
+    
+    begin_json_record("repository");
+    add_json_string("status", status);
+    add_json_string("source", source);
+    end_json_record();
+}
+
+void init_update_output(UpdateOutput *output, int show_stats)
+{
+    memset(output, 0, sizeof(*output));
+    output->show_stats = show_stats;
+    if (show_stats) init_update_stats(&output->stats);
+    
+    print_status("Connecting to repositories");
+}
+
+void add_update_output_line(UpdateOutput *output, char *line)
+{
+    if (output->show_stats) add_update_line(&output->stats, line);
+    
+    if (strncmp(line, "Hit:", 4) == 0) {
+        output->hit_count++;
+        if (strstr(line, "ppa.launchpad")) output->ppa_count++;
+        print_repository_event("hit", line);
+        print_status("Checking repositories");
+    }
+    else if (strncmp(line, "Get:", 4) == 0) {
+        output->get_count++;
+        print_repository_event("get", line);
+        print_status("Fetching package lists");
+    }
+    else if (strstr(line, "Reading package lists")) {
+        print_status("Reading package lists");
+    }
+    else if (strstr(line, "Building dependency tree")) {
+        print_status("Building dependency tree");
+    }
+    else if (strstr(line, "Reading state information")) {
+        print_status("Reading state information");
+    }
+    else if (strstr(line, "packages can be upgraded")) {
+        // Extract number
+        sscanf(line, "%d", &output->upgradable);
+    }
+    else if (strncmp(line, "Fetched", 7) == 0) {
+        print_status("Download complete");
+    }
+}
+
+void finish_update_output(UpdateOutput *output)
+{
+    int checked = output->hit_count + output->get_count;
+    if (output->show_stats) finish_update_stats(&output->stats);
+    
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "update");
+        add_json_int("checked", checked);
+        add_json_int("updated", output->get_count);
+        add_json_int("ppas", output->ppa_count);
+        add_json_int("upgradable", output->upgradable);
+        end_json_record();
+    } else {
+        printf(CLEAR_LINE); // Clear status line
+        
+        // Print summary
+        print_status_done("Repositories synchronized");
+        
+        char summary[256];
+        snprintf(summary, sizeof(summary), "%d repositories checked, %d updated", 
+                 checked, output->get_count);
+        print_info(summary);
+        
+        if (output->ppa_count > 0) {
+            snprintf(summary, sizeof(summary), "%d PPA(s) included", output->ppa_count);
+            print_info(summary);
+        }
+        
+        if (output->upgradable > 0) {
+            printf("\n" YELLOW "  %s %d package(s) can be upgraded" RESET "\n", ARROW, output->upgradable);
+            printf(DIM "    Run 'lime-apt upgrade' to update them" RESET "\n");
+        }
+    }
+    
+    if (output->show_stats) {
+        print_update_stats(&output->stats);
+        free_update_stats(&output->stats);
+    }
+}
+
+// Report a dpkg progress line ("Keyword name (version) ...") as an NDJSON record
+static void print_package_event(const char *action, const char *line, const char *keyword)
+{
+    if (!is_json_output()) return;
+    
+    const char *text = line;
+    if (keyword) {
+        text = strstr(line, keyword) + strlen(keyword);
+        while (*text == ' ') text++;
+    }
+    
+    // Package name runs up to the first space or ':arch' qualifier
+    size_t name_len = strcspn(text, " :");
+    const char *version = NULL;
+    size_t version_len = 0;
+    const char *open = strchr(text + name_len, '(');
+    if (open) {
+        const char *close = strchr(open, ')');
+        if (close) {
+            version = open + 1;
+            version_len = close - version;
+        }
+    }
+    
+    begin_json_record("package");
+    add_json_string("action", action);
+    add_json_string_n("name", text, name_len);
+    add_json_string_n("version", version, version_len);
+    end_json_record();
+}
+
+// apt's complaints when another process holds one of its locks
+static int is_lock_error(const char *line)
+{
+    return strstr(line, "Could not get lock") != NULL ||
+           strstr(line, "Unable to acquire the dpkg frontend lock") != NULL ||
+           strstr(line, "Unable to lock the administration directory") != NULL;
+}
+
+void init_install_output(InstallOutput *output, const char *action_type)
+{
+    memset(output, 0, sizeof(*output));
+    output->action_type = action_type;
+    
+    print_status("Reading package information");
+}
+
+void add_install_output_line(InstallOutput *output, char *line)
+{
+    char msg[256];
+    
+    // Handle "already the newest version" message
+    if (strstr(line, "is already the newest version") || 
+        strstr(line, "already the newest version")) {
+        output->already_newest++;
+        // Extract package name
+        char *space = strchr(line, ' ');
+        if (space) {
+            size_t len = space - line;
+            if (len < sizeof(output->newest_pkg) - 1) {
+                memcpy(output->newest_pkg, line, len);
+                output->newest_pkg[len] = '\0';
+            }
+        }
+        print_package_event("unchanged", line, NULL);
+    }
+    else if (strstr(line, "Selecting previously unselected") || 
+             strstr(line, "Preparing to unpack")) {
+        print_status("Preparing packages");
+    }
+    else if (strstr(line, "Unpacking")) {
+        output->installed++;
+        print_package_event("unpack", line, "Unpacking");
+        snprintf(msg, sizeof(msg), "Unpacking (%d)", output->installed);
+        print_status(msg);
+    }
+    else if (strstr(line, "Setting up")) {
+        output->configured++;
+        print_package_event("configure", line, "Setting up");
+        snprintf(msg, sizeof(msg), "Configuring (%d)", output->configured);
+        print_status(msg);
+    }
+    else if (strstr(line, "Removing")) {
+        output->removed++;
+        print_package_event("remove", line, "Removing");
+        snprintf(msg, sizeof(msg), "Removing (%d)", output->removed);
+        print_status(msg);
+    }
+    else if (strstr(line, "upgraded") && strstr(line, "newly installed")) {
+        // Parse the summary line: "X upgraded, Y newly installed, Z to remove"
+        int up = 0, inst = 0, rem = 0;
+        sscanf(line, "%d upgraded, %d newly installed, %d to remove", &up, &inst, &rem);
+        output->upgraded = up;
+        output->installed = inst;
+        output->removed = rem;
+    }
+    else if (strstr(line, "Processing triggers")) {
+        print_status("Processing triggers");
+    }
+    else if (strstr(line, "packages were automatically installed")) {
+        output->autoremove_available = 1;
+    }
+    else if (is_lock_error(line)) {
+        output->lock_failed = 1;
+    }
+}
+
+int finish_install_output(InstallOutput *output)
+{
+    int installed = output->installed;
+    int configured = output->configured;
+    int upgraded = output->upgraded;
+    int removed = output->removed;
+    
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", output->action_type);
+        add_json_int("installed", configured > 0 ? configured : installed);
+        add_json_int("upgraded", upgraded);
+        add_json_int("removed", removed);
+        add_json_int("unchanged", output->already_newest);
+        add_json_bool("autoremove_available", output->autoremove_available);
+        end_json_record();
+        return output->lock_failed;
+    }
+    
+    printf(CLEAR_LINE);
+    if (output->lock_failed) return output->lock_failed;
+    
+    // Print summary based on what happened
+    if (output->already_newest > 0 && installed == 0 && upgraded == 0) {
+        print_status_done("Already up to date");
+        if (strlen(output->newest_pkg) > 0) {
+            printf(DIM "  %s is the newest version" RESET "\n", output->newest_pkg);
+        }
+    } else {
+        // Show what was done
+        char msg[256];
+        if (installed > 0 || configured > 0) {
+            snprintf(msg, sizeof(msg), "%d package(s) installed", configured > 0 ? configured : installed);
+            print_status_done(msg);
+        }
+        if (upgraded > 0) {
+            snprintf(msg, sizeof(msg), "%d package(s) upgraded", upgraded);
+            print_status_done(msg);
+        }
+        if (removed > 0) {
+            snprintf(msg, sizeof(msg), "%d package(s) removed", removed);
+            print_status_done(msg);
+        }
+        if (installed == 0 && upgraded == 0 && removed == 0 && configured == 0 && output->already_newest == 0) {
+            print_status_done("Nothing to do");
+        }
+    }
+    
+    if (output->autoremove_available) {
+        printf(DIM "  Run 'lime-apt autoremove' to clean up unused packages" RESET "\n");
+    }
+    return 0;
+}
+
+// Read a stream line by line as the formatters expect. Returns 0 at
+// the end of the stream.
+static int read_output_line(FILE *pipe, char *line)
+{
+    if (!fgets(line, FORMAT_LINE_MAX, pipe)) return 0;
+    line[strcspn(line, "\n")] = 0;
+    return 1;
+}
+
+int format_search_output(FILE *pipe, int limit)
+{
+    char line[FORMAT_LINE_MAX];
+    SearchOutput output;
+    init_search_output(&output, limit);
+    while (read_output_line(pipe, line)) {
+        if (add_search_output_line(&output, line)) break;
+    }
+    return finish_search_output(&output);
+}
+
+void format_update_output(FILE *pipe, int show_stats)
+{
+    char line[FORMAT_LINE_MAX];
+    UpdateOutput output;
+    init_update_output(&output, show_stats);
+    while (read_output_line(pipe, line)) add_update_output_line(&output, line);
+    finish_update_output(&output);
+}
+
+int format_install_output(FILE *pipe, const char *action_type)
+{
+    char line[FORMAT_LINE_MAX];
+    InstallOutput output;
+    init_install_output(&output, action_type);
+    while (read_output_line(pipe, line)) add_install_output_line(&output, line);
+    return finish_install_output(&output);
+}
+
+size_t feed_output_lines(const char *data, size_t size,
+                         int (*handler)(char *line, void *context), void *context)
+{
+    char line[FORMAT_LINE_MAX];
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < size) {
+        // Up to and including the newline, at most what fgets() would take
+        size_t length = size - offset;
+        if (length > FORMAT_LINE_MAX - 1) length = FORMAT_LINE_MAX - 1;
+        const char *newline = memchr(data + offset, '\n', length);
+        if (newline) length = newline - (data + offset) + 1;
+
+        memcpy(line, data + offset, length);
+        line[length] = '\0';
+        offset += length;
+        line[strcspn(line, "\n")] = 0;
+        count++;
+        if (handler(line, context)) break;
+    }
+    return count;
+}
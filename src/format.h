@@ -0,0 +1,95 @@
+/**
+ * lime-apt apt Output Formatters
+ *
+ * Turn apt's search, update and install output into lime-apt's own,
+ * one line at a time. Each formatter keeps its state in a struct and
+ * is fed lines without their newline, so the same code runs on apt's
+ * pipe, on a recorded transcript in memory, or under a fuzzer. Lines
+ * longer than FORMAT_LINE_MAX - 1 bytes arrive in pieces, exactly as
+ * fgets() delivers them.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "search.h"
+#include "repostats.h"
+
+#define FORMAT_LINE_MAX 2048
+
+// Print a single search result (or its NDJSON record). "relevance" is
+// the ranking tier name, or NULL when results come unranked from apt.
+void print_search_result(const SearchMatch *match, const char *relevance);
+
+// Print the closing line of a search. "total" is the number of matches
+// when known, which can exceed the number shown under --limit.
+void print_search_summary(int pkg_count, int total, int limited);
+
+typedef struct {
+    int limit;                  // 0 for no limit
+    char name[256];
+    char version[128];
+    char description[1024];
+    int installed;
+    int count;
+    int pending;                // A result waits for its description
+    int limited;
+} SearchOutput;
+
+// apt search: prints each result as soon as its record is complete
+void init_search_output(SearchOutput *output, int limit);
+// Returns 1 once "limit" results are out and apt can be stopped
+int add_search_output_line(SearchOutput *output, char *line);
+// Print the last result and the summary. Returns 1 if the limit cut
+// the results short.
+int finish_search_output(SearchOutput *output);
+
+typedef struct {
+    int hit_count;
+    int get_count;
+    int ppa_count;
+    int upgradable;
+    int show_stats;
+    UpdateStats stats;
+} UpdateOutput;
+
+// apt update: a status line while it runs and a summary, with
+// show_stats where the time and bytes went per source
+void init_update_output(UpdateOutput *output, int show_stats);
+void add_update_output_line(UpdateOutput *output, char *line);
+void finish_update_output(UpdateOutput *output);
+
+typedef struct {
+    const char *action_type;
+    int lock_failed;
+    int installed;
+    int upgraded;
+    int removed;
+    int configured;
+    int already_newest;
+    char newest_pkg[256];
+    int autoremove_available;
+} InstallOutput;
+
+// apt install, upgrade, remove and autoremove: progress and a summary
+void init_install_output(InstallOutput *output, const char *action_type);
+void add_install_output_line(InstallOutput *output, char *line);
+// Returns non-zero if apt gave up on a lock another process holds
+int finish_install_output(InstallOutput *output);
+
+// The formatters run over a stream. The search one returns 1 if it
+// stopped early at the limit; the install one as finish_install_output().
+int format_search_output(FILE *pipe, int limit);
+void format_update_output(FILE *pipe, int show_stats);
+int format_install_output(FILE *pipe, const char *action_type);
+
+// Split a buffer into lines as fgets() into a FORMAT_LINE_MAX buffer
+// would, and hand each to "handler" until it returns non-zero. Returns
+// the number of lines handed over.
+size_t feed_output_lines(const char *data, size_t size,
+                         int (*handler)(char *line, void *context), void *context);
+
+#endif // FORMAT_H
@@ -0,0 +1,149 @@
+/**
+ * lime-apt Dependency Graph
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph.h"
+
+const IndexEdge *get_dependencies(const PackageIndex *index, uint32_t id, uint32_t *out_count)
+{
+    uint32_t start = index->dependency_offsets[id];
+    *out_count = index->dependency_offsets[id + 1] - start;
+    return index->dependencies + start;
+}
+
+const IndexEdge *get_reverse_dependencies(const PackageIndex *index, uint32_t id, uint32_t *out_count)
+{
+    uint32_t start = index->reverse_offsets[id];
+    *out_count = index->reverse_offsets[id + 1] - start;
+    return index->reverse_dependencies + start;
+}
+
+const char *get_dependency_kind_name(uint8_t kind)
+{
+    switch (kind) {
+        case DEPENDENCY_PRE_DEPENDS: return "Pre-Depends";
+        case DEPENDENCY_DEPENDS:     return "Depends";
+        case DEPENDENCY_RECOMMENDS:  return "Recommends";
+        case DEPENDENCY_SUGGESTS:    return "Suggests";
+    }
+    return "Unknown";
+}
+
+unsigned char *mark_installed_packages(const PackageIndex *index, const DpkgStatus *status)
+{
+    uint32_t package_count = index->header->package_count;
+    unsigned char *installed = calloc(package_count ? package_count : 1, 1);
+    char name[256];
+    for (size_t i = 0; i < status->count; i++) {
+        const DpkgPackage *package = &status->packages[i];
+        if (!package->installed || package->name.length >= sizeof(name)) continue;
+        snprintf(name, sizeof(name), "%.*s", (int)package->name.length, package->name.data);
+        int id = find_index_package(index, name);
+        if (id >= 0) installed[id] = 1;
+    }
+    return installed;
+}
+
+uint32_t collect_reverse_closure(const PackageIndex *index, uint32_t id, uint8_t weakest,
+                                 const unsigned char *only, uint32_t **out_ids)
+{
+    uint32_t package_count = index->header->package_count;
+    unsigned char *visited = calloc(package_count, 1);
+    uint32_t *queue = malloc(package_count * sizeof(uint32_t));
+    uint32_t head = 0;
+    uint32_t tail = 0;
+
+    // The queue doubles as the result, minus the starting package
+    visited[id] = 1;
+    queue[tail++] = id;
+    while (head < tail) {
+        uint32_t count;
+        const IndexEdge *edges = get_reverse_dependencies(index, queue[head++], &count);
+        for (uint32_t e = 0; e < count; e++) {
+            uint32_t dependent = edges[e].package;
+            if (edges[e].kind > weakest || visited[dependent]) continue;
+            if (only && !only[dependent]) continue;
+            visited[dependent] = 1;
+            queue[tail++] = dependent;
+        }
+    }
+
+    memmove(queue, queue + 1, (tail - 1) * sizeof(uint32_t));
+    free(visited);
+    *out_ids = queue;
+    return tail - 1;
+}
+
+// Whether any installed package depends on or recommends this one
+static int has_installed_dependents(const PackageIndex *index, uint32_t id, const unsigned char *installed)
+{
+    uint32_t count;
+    const IndexEdge *edges = get_reverse_dependencies(index, id, &count);
+    for (uint32_t e = 0; e < count; e++) {
+        if (edges[e].kind <= DEPENDENCY_RECOMMENDS && installed[edges[e].package]) return 1;
+    }
+    return 0;
+}
+
+int find_dependency_path(const PackageIndex *index, uint32_t id, const unsigned char *installed,
+                         const unsigned char *roots, uint32_t *out_path, uint8_t *out_kinds,
+                         int max_length)
+{
+    uint32_t package_count = index->header->package_count;
+    uint32_t *parent = malloc(package_count * sizeof(uint32_t));
+    uint8_t *parent_kind = malloc(package_count);
+    uint32_t *queue = malloc(package_count * sizeof(uint32_t));
+    unsigned char *visited = calloc(package_count, 1);
+    uint32_t head = 0;
+    uint32_t tail = 0;
+
+    // Breadth-first up the reverse edges, so the first root reached has
+    // the shortest explanation
+    long found = -1;
+    visited[id] = 1;
+    parent[id] = id;
+    queue[tail++] = id;
+    while (head < tail && found < 0) {
+        uint32_t current = queue[head++];
+        int is_root = roots ? roots[current] != 0 : !has_installed_dependents(index, current, installed);
+        if (is_root && (current != id || installed[id])) {
+            found = current;
+            break;
+        }
+
+        uint32_t count;
+        const IndexEdge *edges = get_reverse_dependencies(index, current, &count);
+        for (uint32_t e = 0; e < count; e++) {
+            uint32_t dependent = edges[e].package;
+            if (edges[e].kind > DEPENDENCY_RECOMMENDS || visited[dependent] || !installed[dependent]) continue;
+            visited[dependent] = 1;
+            parent[dependent] = current;
+            parent_kind[dependent] = edges[e].kind;
+            queue[tail++] = dependent;
+        }
+    }
+
+    // In a dependency cycle nothing qualifies as a root; explain the
+    // package through the farthest one reached instead
+    if (found < 0 && tail > 1) found = queue[tail - 1];
+
+    int length = 0;
+    if (found >= 0) {
+        for (uint32_t node = (uint32_t)found; length < max_length; node = parent[node]) {
+            out_path[length] = node;
+            out_kinds[length] = parent_kind[node];
+            length++;
+            if (node == id) break;
+        }
+    }
+
+    free(parent);
+    free(parent_kind);
+    free(queue);
+    free(visited);
+    return length;
+}
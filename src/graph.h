@@ -0,0 +1,45 @@
+/**
+ * lime-apt Dependency Graph
+ *
+ * Queries over the CSR dependency graph stored in the package index.
+ * Package ids are index positions, so a neighbour list is a slice of
+ * one flat edge array and traversals only touch the packages they visit.
+ */
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stdint.h>
+
+#include "index.h"
+#include "dpkg.h"
+
+// Packages a package depends on
+const IndexEdge *get_dependencies(const PackageIndex *index, uint32_t id, uint32_t *out_count);
+
+// Packages depending on a package
+const IndexEdge *get_reverse_dependencies(const PackageIndex *index, uint32_t id, uint32_t *out_count);
+
+// "Depends", "Recommends", ...
+const char *get_dependency_kind_name(uint8_t kind);
+
+// One byte per package id, non-zero when dpkg has it installed.
+// Caller frees.
+unsigned char *mark_installed_packages(const PackageIndex *index, const DpkgStatus *status);
+
+// Collect every package that transitively depends on "id" through
+// relationships at least as strong as "weakest". Writes ids in visiting
+// order (nearest first) and returns the count; caller frees *out_ids.
+uint32_t collect_reverse_closure(const PackageIndex *index, uint32_t id, uint8_t weakest,
+                                 const unsigned char *only, uint32_t **out_ids);
+
+// Find the shortest chain of installed packages ending in "id", starting
+// from a root (a package marked in "roots", or one nothing installed
+// depends on). Writes the chain root first, with out_kinds[i] the
+// relationship from path[i] to path[i + 1]. Returns its length, or 0 if
+// nothing installed leads to the package.
+int find_dependency_path(const PackageIndex *index, uint32_t id, const unsigned char *installed,
+                         const unsigned char *roots, uint32_t *out_path, uint8_t *out_kinds,
+                         int max_length);
+
+#endif // GRAPH_H
@@ -0,0 +1,1633 @@
+/**
+ * lime-apt Package Index
+ *
+ * Builds packages.idx from the Packages files in /var/lib/apt/lists and
+ * maps it back for queries. List files are parsed on one worker thread
+ * each, compressed ones streamed through their decompressor, and the
+ * per-list tables merged by name. Every list's parsed entries are kept
+ * as a segment file next to the index, so a rebuild only re-parses the
+ * lists that changed. Files are written to a temporary name and renamed
+ * into place, so readers never see a half-written index.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "index.h"
+#include "paths.h"
+#include "timing.h"
+#include "version.h"
+
+// Architecture of the packages this binary can install
+#if defined(__x86_64__)
+#define NATIVE_ARCHITECTURE "amd64"
+#elif defined(__aarch64__)
+#define NATIVE_ARCHITECTURE "arm64"
+#elif defined(__i386__)
+#define NATIVE_ARCHITECTURE "i386"
+#elif defined(__arm__)
+#define NATIVE_ARCHITECTURE "armhf"
+#elif defined(__riscv)
+#define NATIVE_ARCHITECTURE "riscv64"
+#elif defined(__powerpc64__)
+#define NATIVE_ARCHITECTURE "ppc64el"
+#elif defined(__s390x__)
+#define NATIVE_ARCHITECTURE "s390x"
+#else
+#define NATIVE_ARCHITECTURE "all"
+#endif
+
+#define TRIGRAM_SPACE (1u << 24)
+#define MAX_BUILD_THREADS 64
+
+extern char **environ;
+
+// Compressed list files apt may keep, and the tool that streams them out
+static const struct {
+    const char *suffix;
+    const char *command;
+} decompressors[] = {
+    { ".gz",  "gzip" },
+    { ".lz4", "lz4" },
+    { ".zst", "zstd" },
+};
+
+// A byte range inside a mapped list file
+typedef struct {
+    const char *data;
+    uint32_t length;
+} Slice;
+
+// One stanza as parsed from a list file
+typedef struct {
+    Slice name;
+    Slice version;
+    Slice architecture;
+    Slice section;
+    Slice description;
+    Slice long_description;
+    Slice stanza;
+    Slice relations[4];         // Indexed by DependencyKind
+    Slice provides;
+    uint64_t size;
+    uint64_t installed_size;
+    uint64_t sequence;          // List number, then position within it
+} BuildEntry;
+
+// Growable byte buffer for assembling index sections
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+// Where a list's contents live
+#define LIST_MAPPED     0       // The list file itself, mapped
+#define LIST_ALLOCATED  1       // Decompressed onto the heap
+#define LIST_IN_SEGMENT 2       // Inside its mapped segment
+
+// One list file and its entries, sorted by name, highest version first
+typedef struct {
+    char *data;
+    size_t size;
+    int storage;
+    void *segment;              // Mapped segment, when one was reused
+    size_t segment_size;
+    BuildEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} BuildList;
+
+// Work shared by the parsing threads
+typedef struct {
+    char **paths;
+    BuildList *lists;
+    int list_count;
+    int next;                   // Next list to claim
+    const char *segments_dir;
+} BuildJob;
+
+#define SEGMENT_MAGIC          "LIMESEG"
+#define SEGMENT_FORMAT_VERSION 1
+#define SEGMENT_DIR_NAME       "segments"
+#define SEGMENT_SUFFIX         ".seg"
+#define SEGMENT_FIELD_COUNT    12
+
+// Segment file header. A segment is reused while its list keeps the
+// same size and mtime, or, when only the mtime moved, the same hash.
+typedef struct {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t entry_count;
+    uint64_t list_size;
+    int64_t list_mtime_sec;
+    int64_t list_mtime_nsec;
+    uint64_t list_hash;         // Hash of the list file as stored
+    uint64_t entries_offset;    // SegmentEntry[entry_count]
+    uint64_t text_offset;       // Decompressed contents; empty for plain
+    uint64_t text_size;         // lists, whose entries point into the list
+    uint64_t file_size;
+} SegmentHeader;
+
+typedef struct {
+    uint32_t offset;            // Into the list's contents
+    uint32_t length;
+} SegmentSlice;
+
+// One parsed entry, in list order position
+typedef struct {
+    SegmentSlice fields[SEGMENT_FIELD_COUNT];   // As listed by get_entry_fields
+    uint64_t size;
+    uint64_t installed_size;
+    uint32_t position;
+    uint32_t reserved;
+} SegmentEntry;
+
+static void *grow_array(void *array, size_t *capacity, size_t needed, size_t element_size)
+{
+    if (needed <= *capacity) return array;
+    size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+    while (new_capacity < needed) new_capacity *= 2;
+    void *grown = realloc(array, new_capacity * element_size);
+    if (!grown) {
+        perror("lime-apt: out of memory");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+static size_t append_buffer(Buffer *buffer, const void *data, size_t length)
+{
+    buffer->data = grow_array(buffer->data, &buffer->capacity, buffer->size + length, 1);
+    size_t offset = buffer->size;
+    memcpy(buffer->data + offset, data, length);
+    buffer->size += length;
+    return offset;
+}
+
+static uint32_t append_string(Buffer *buffer, Slice value)
+{
+    size_t offset = append_buffer(buffer, value.data, value.length);
+    append_buffer(buffer, "", 1);
+    return (uint32_t)offset;
+}
+
+static void free_buffers(Buffer *const buffers[], size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        free(buffers[i]->data);
+        memset(buffers[i], 0, sizeof(Buffer));
+    }
+}
+
+static void align_buffer(Buffer *buffer)
+{
+    static const char zeros[8] = {0};
+    if (buffer->size % 8) append_buffer(buffer, zeros, 8 - buffer->size % 8);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Find the decompressor for a list file name, or -1 if it is plain
+static int find_decompressor(const char *file_name, size_t len)
+{
+    for (size_t i = 0; i < sizeof(decompressors) / sizeof(decompressors[0]); i++) {
+        size_t suffix_len = strlen(decompressors[i].suffix);
+        if (len > suffix_len && strcmp(file_name + len - suffix_len, decompressors[i].suffix) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Check if a list file holds packages for an architecture we can install
+static int is_packages_list(const char *file_name)
+{
+    size_t len = strlen(file_name);
+    int decompressor = find_decompressor(file_name, len);
+    if (decompressor >= 0) len -= strlen(decompressors[decompressor].suffix);
+    if (len < 9 || strncmp(file_name + len - 9, "_Packages", 9) != 0) return 0;
+
+    // Flat repositories have no binary-<arch> component; their stanzas
+    // are filtered by Architecture field instead
+    const char *binary = strstr(file_name, "binary-");
+    if (!binary) return 1;
+
+    const char *arch = binary + 7;
+    size_t arch_len = (file_name + len - 9) - arch;
+    return (arch_len == strlen(NATIVE_ARCHITECTURE) &&
+            strncmp(arch, NATIVE_ARCHITECTURE, arch_len) == 0) ||
+           (arch_len == 3 && strncmp(arch, "all", 3) == 0);
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// List the Packages files in name order and hash their names, sizes and
+// modification times. Returns the number of files found.
+static int collect_list_files(char ***out_paths, uint64_t *out_fingerprint)
+{
+    const char *lists_dir = get_lists_dir();
+    char **paths = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    DIR *dir = opendir(lists_dir);
+    if (!dir) {
+        *out_paths = NULL;
+        *out_fingerprint = 0;
+        return 0;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_packages_list(entry->d_name)) continue;
+        paths = grow_array(paths, &capacity, count + 1, sizeof(char*));
+        size_t path_len = strlen(lists_dir) + strlen(entry->d_name) + 2;
+        paths[count] = malloc(path_len);
+        snprintf(paths[count], path_len, "%s/%s", lists_dir, entry->d_name);
+        count++;
+    }
+    closedir(dir);
+
+    qsort(paths, count, sizeof(char*), compare_strings);
+
+    uint64_t fingerprint = 14695981039346656037ULL;
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) != 0) continue;
+        uint64_t stamp[3] = {
+            (uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec
+        };
+        fingerprint = hash_bytes(fingerprint, paths[i], strlen(paths[i]));
+        fingerprint = hash_bytes(fingerprint, stamp, sizeof(stamp));
+    }
+
+    *out_paths = paths;
+    *out_fingerprint = fingerprint;
+    return (int)count;
+}
+
+static void free_list_files(char **paths, int count)
+{
+    for (int i = 0; i < count; i++) free(paths[i]);
+    free(paths);
+}
+
+static int map_list_file(const char *path, BuildList *out_list)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    out_list->data = data;
+    out_list->size = st.st_size;
+    out_list->storage = LIST_MAPPED;
+    return 0;
+}
+
+// Stream a compressed list through its decompressor into memory, with
+// no temporary file. Descriptors are close-on-exec so decompressors
+// started by other threads never hold our pipe open.
+static int decompress_list_file(const char *path, const char *command, BuildList *out_list)
+{
+    int input = open(path, O_RDONLY | O_CLOEXEC);
+    if (input < 0) return -1;
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        close(input);
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    char *argv[] = { (char *)command, "-dc", NULL };
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, command, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned == 0) add_span_process(-1);
+    close(input);
+    close(pipe_fds[1]);
+    if (spawned != 0) {
+        close(pipe_fds[0]);
+        return -1;
+    }
+
+    char *data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+    for (;;) {
+        data = grow_array(data, &capacity, size + 65536, 1);
+        ssize_t n = read(pipe_fds[0], data + size, capacity - size);
+        if (n > 0) size += n;
+        else if (n == 0 || errno != EINTR) break;
+    }
+    close(pipe_fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || size == 0) {
+        free(data);
+        return -1;
+    }
+
+    out_list->data = data;
+    out_list->size = size;
+    out_list->storage = LIST_ALLOCATED;
+    return 0;
+}
+
+static int read_list_file(const char *path, BuildList *out_list)
+{
+    int decompressor = find_decompressor(path, strlen(path));
+    if (decompressor < 0) return map_list_file(path, out_list);
+    return decompress_list_file(path, decompressors[decompressor].command, out_list);
+}
+
+static void release_list_file(BuildList *list)
+{
+    if (list->data && list->storage == LIST_ALLOCATED) free(list->data);
+    else if (list->data && list->storage == LIST_MAPPED) munmap(list->data, list->size);
+    if (list->segment) munmap(list->segment, list->segment_size);
+    free(list->entries);
+}
+
+// Hash a list file's bytes as stored. Returns 0 on success.
+static int hash_list_file(const char *path, uint64_t *out_hash)
+{
+    BuildList list;
+    if (map_list_file(path, &list) != 0) return -1;
+    *out_hash = hash_bytes(14695981039346656037ULL, list.data, list.size);
+    munmap(list.data, list.size);
+    return 0;
+}
+
+static int slice_equals(Slice slice, const char *value)
+{
+    size_t len = strlen(value);
+    return slice.length == len && memcmp(slice.data, value, len) == 0;
+}
+
+static uint64_t parse_number(Slice value)
+{
+    uint64_t number = 0;
+    for (uint32_t i = 0; i < value.length && isdigit((unsigned char)value.data[i]); i++) {
+        number = number * 10 + (value.data[i] - '0');
+    }
+    return number;
+}
+
+// Parse one stanza. Returns 1 if it describes an installable package.
+static int parse_stanza(const char *start, const char *end, BuildEntry *out_entry)
+{
+    memset(out_entry, 0, sizeof(*out_entry));
+    Slice *continuation = NULL;
+
+    const char *line = start;
+    while (line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (!line_end) line_end = end;
+
+        if (*line == ' ' || *line == '\t') {
+            // Continuation lines only matter for the long description
+            if (continuation) {
+                if (!continuation->data) continuation->data = line;
+                continuation->length = (uint32_t)(line_end - continuation->data);
+            }
+        } else {
+            continuation = NULL;
+            const char *colon = memchr(line, ':', line_end - line);
+            if (colon) {
+                Slice key = { line, (uint32_t)(colon - line) };
+                const char *value = colon + 1;
+                while (value < line_end && *value == ' ') value++;
+                Slice slice = { value, (uint32_t)(line_end - value) };
+
+                if (slice_equals(key, "Package")) out_entry->name = slice;
+                else if (slice_equals(key, "Version")) out_entry->version = slice;
+                else if (slice_equals(key, "Architecture")) out_entry->architecture = slice;
+                else if (slice_equals(key, "Section")) out_entry->section = slice;
+                else if (slice_equals(key, "Size")) out_entry->size = parse_number(slice);
+                else if (slice_equals(key, "Installed-Size")) out_entry->installed_size = parse_number(slice);
+                else if (slice_equals(key, "Pre-Depends")) out_entry->relations[DEPENDENCY_PRE_DEPENDS] = slice;
+                else if (slice_equals(key, "Depends")) out_entry->relations[DEPENDENCY_DEPENDS] = slice;
+                else if (slice_equals(key, "Recommends")) out_entry->relations[DEPENDENCY_RECOMMENDS] = slice;
+                else if (slice_equals(key, "Suggests")) out_entry->relations[DEPENDENCY_SUGGESTS] = slice;
+                else if (slice_equals(key, "Provides")) out_entry->provides = slice;
+                else if (slice_equals(key, "Description")) {
+                    out_entry->description = slice;
+                    continuation = &out_entry->long_description;
+                }
+            }
+        }
+        line = line_end + 1;
+    }
+
+    if (!out_entry->name.length || !out_entry->version.length) return 0;
+    return slice_equals(out_entry->architecture, NATIVE_ARCHITECTURE) ||
+           slice_equals(out_entry->architecture, "all");
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const BuildEntry *left = a;
+    const BuildEntry *right = b;
+    uint32_t min_len = left->name.length < right->name.length ? left->name.length : right->name.length;
+    int result = memcmp(left->name.data, right->name.data, min_len);
+    if (result != 0) return result;
+    if (left->name.length != right->name.length) return left->name.length < right->name.length ? -1 : 1;
+
+    // Highest version first, so it becomes the candidate
+    result = compare_debian_versions_n(right->version.data, right->version.length,
+                                       left->version.data, left->version.length);
+    if (result != 0) return result;
+    return left->sequence < right->sequence ? -1 : (left->sequence > right->sequence);
+}
+
+// Parse every stanza of one list, keeping slices into its contents
+static void parse_list(BuildList *list, uint32_t list_number)
+{
+    const char *cursor = list->data;
+    const char *end = list->data + list->size;
+    uint32_t position = 0;
+    while (cursor < end) {
+        const char *stanza_end = memmem(cursor, end - cursor, "\n\n", 2);
+        if (!stanza_end) stanza_end = end;
+
+        BuildEntry entry;
+        if (parse_stanza(cursor, stanza_end, &entry)) {
+            entry.stanza.data = cursor;
+            entry.stanza.length = (uint32_t)(stanza_end - cursor);
+            entry.sequence = ((uint64_t)list_number << 32) | position++;
+            list->entries = grow_array(list->entries, &list->entry_capacity, list->entry_count + 1,
+                                       sizeof(BuildEntry));
+            list->entries[list->entry_count++] = entry;
+        }
+
+        cursor = stanza_end;
+        while (cursor < end && *cursor == '\n') cursor++;
+    }
+    qsort(list->entries, list->entry_count, sizeof(BuildEntry), compare_entries);
+}
+
+// The slices of an entry, in segment order
+static void get_entry_fields(BuildEntry *entry, Slice *out_fields[SEGMENT_FIELD_COUNT])
+{
+    out_fields[0] = &entry->name;
+    out_fields[1] = &entry->version;
+    out_fields[2] = &entry->architecture;
+    out_fields[3] = &entry->section;
+    out_fields[4] = &entry->description;
+    out_fields[5] = &entry->long_description;
+    out_fields[6] = &entry->stanza;
+    out_fields[7] = &entry->provides;
+    for (int kind = 0; kind < 4; kind++) out_fields[8 + kind] = &entry->relations[kind];
+}
+
+static void get_segment_path(const char *segments_dir, const char *list_path, char *out_path, size_t size)
+{
+    const char *name = strrchr(list_path, '/');
+    snprintf(out_path, size, "%s/%s%s", segments_dir, name ? name + 1 : list_path, SEGMENT_SUFFIX);
+}
+
+// Reuse a segment if its list is unchanged, taking the entries from it
+// and the contents from it or the list. Returns 0 on success.
+static int load_segment(const char *segment_path, const char *list_path, const struct stat *list_stat,
+                        uint32_t list_number, BuildList *list)
+{
+    int fd = open(segment_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    SegmentHeader header;
+    memcpy(&header, data, sizeof(header));
+    int valid = memcmp(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0 &&
+                header.format_version == SEGMENT_FORMAT_VERSION &&
+                header.file_size == (uint64_t)st.st_size &&
+                header.list_size == (uint64_t)list_stat->st_size &&
+                header.entries_offset % 8 == 0 &&
+                header.entries_offset <= header.file_size &&
+                (uint64_t)header.entry_count * sizeof(SegmentEntry) <= header.file_size - header.entries_offset &&
+                header.text_offset <= header.file_size &&
+                header.text_size <= header.file_size - header.text_offset;
+    int touched = valid && (header.list_mtime_sec != (int64_t)list_stat->st_mtim.tv_sec ||
+                            header.list_mtime_nsec != (int64_t)list_stat->st_mtim.tv_nsec);
+    uint64_t hash;
+    if (touched && (hash_list_file(list_path, &hash) != 0 || hash != header.list_hash)) valid = 0;
+    if (valid && header.text_size == 0 && map_list_file(list_path, list) != 0) valid = 0;
+    if (!valid) {
+        munmap(data, st.st_size);
+        return -1;
+    }
+
+    // Same bytes under a new mtime: restamp so the next build skips the hash
+    if (touched) {
+        header.list_mtime_sec = list_stat->st_mtim.tv_sec;
+        header.list_mtime_nsec = list_stat->st_mtim.tv_nsec;
+        int out = open(segment_path, O_WRONLY | O_CLOEXEC);
+        if (out >= 0) {
+            ssize_t written = pwrite(out, &header, sizeof(header), 0);
+            (void)written;
+            close(out);
+        }
+    }
+
+    list->segment = data;
+    list->segment_size = st.st_size;
+    if (header.text_size) {
+        list->data = (char *)data + header.text_offset;
+        list->size = header.text_size;
+        list->storage = LIST_IN_SEGMENT;
+    }
+
+    const SegmentEntry *stored = (const SegmentEntry *)((const char *)data + header.entries_offset);
+    list->entries = malloc((header.entry_count ? header.entry_count : 1) * sizeof(BuildEntry));
+    list->entry_count = header.entry_count;
+    list->entry_capacity = header.entry_count;
+    for (uint32_t i = 0; i < header.entry_count; i++) {
+        BuildEntry *entry = &list->entries[i];
+        Slice *fields[SEGMENT_FIELD_COUNT];
+        memset(entry, 0, sizeof(*entry));
+        get_entry_fields(entry, fields);
+        for (int f = 0; f < SEGMENT_FIELD_COUNT; f++) {
+            // A damaged segment must not point outside the contents;
+            // parse the list again instead
+            const SegmentSlice *slice = &stored[i].fields[f];
+            if ((uint64_t)slice->offset + slice->length > list->size) {
+                release_list_file(list);
+                memset(list, 0, sizeof(*list));
+                return -1;
+            }
+            fields[f]->data = list->data + slice->offset;
+            fields[f]->length = slice->length;
+        }
+        entry->size = stored[i].size;
+        entry->installed_size = stored[i].installed_size;
+        entry->sequence = ((uint64_t)list_number << 32) | stored[i].position;
+    }
+    return 0;
+}
+
+static int write_file_sections(const char *path, const Buffer *sections[], int section_count)
+{
+    char tmp_path[4200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return -1;
+
+    int ok = 1;
+    for (int i = 0; i < section_count && ok; i++) {
+        if (sections[i]->size && fwrite(sections[i]->data, 1, sections[i]->size, f) != sections[i]->size) {
+            ok = 0;
+        }
+    }
+    if (fclose(f) != 0) ok = 0;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Save a freshly parsed list as its segment. Failures only cost the
+// next build a re-parse.
+static void write_segment(const char *segment_path, const char *list_path, const struct stat *list_stat,
+                          BuildList *list)
+{
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header.format_version = SEGMENT_FORMAT_VERSION;
+    header.entry_count = (uint32_t)list->entry_count;
+    header.list_size = list_stat->st_size;
+    header.list_mtime_sec = list_stat->st_mtim.tv_sec;
+    header.list_mtime_nsec = list_stat->st_mtim.tv_nsec;
+    if (list->storage == LIST_MAPPED) {
+        header.list_hash = hash_bytes(14695981039346656037ULL, list->data, list->size);
+    } else if (hash_list_file(list_path, &header.list_hash) != 0) {
+        return;
+    }
+
+    Buffer entries = {0};
+    entries.data = grow_array(NULL, &entries.capacity, list->entry_count * sizeof(SegmentEntry) + 1, 1);
+    for (size_t i = 0; i < list->entry_count; i++) {
+        SegmentEntry stored;
+        Slice *fields[SEGMENT_FIELD_COUNT];
+        memset(&stored, 0, sizeof(stored));
+        get_entry_fields(&list->entries[i], fields);
+        for (int f = 0; f < SEGMENT_FIELD_COUNT; f++) {
+            stored.fields[f].offset = fields[f]->data ? (uint32_t)(fields[f]->data - list->data) : 0;
+            stored.fields[f].length = fields[f]->length;
+        }
+        stored.size = list->entries[i].size;
+        stored.installed_size = list->entries[i].installed_size;
+        stored.position = (uint32_t)list->entries[i].sequence;
+        append_buffer(&entries, &stored, sizeof(stored));
+    }
+
+    // Plain lists are mapped again on reuse; only decompressed text is kept
+    Buffer text = {0};
+    if (list->storage != LIST_MAPPED) {
+        text.data = list->data;
+        text.size = list->size;
+    }
+    header.entries_offset = sizeof(SegmentHeader);
+    header.text_offset = header.entries_offset + entries.size;
+    header.text_size = text.size;
+    header.file_size = header.text_offset + text.size;
+
+    Buffer header_buffer = { (char *)&header, sizeof(header), sizeof(header) };
+    const Buffer *sections[] = { &header_buffer, &entries, &text };
+    write_file_sections(segment_path, sections, 3);
+    free(entries.data);
+}
+
+// Load one list: from its segment when the list is unchanged, otherwise
+// read, parse and sort it afresh and save a new segment
+static void load_list(BuildJob *job, int i)
+{
+    BuildList *list = &job->lists[i];
+    const char *path = job->paths[i];
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+
+    char segment_path[4200];
+    get_segment_path(job->segments_dir, path, segment_path, sizeof(segment_path));
+    if (load_segment(segment_path, path, &st, (uint32_t)i, list) == 0) return;
+
+    if (read_list_file(path, list) != 0) return;
+    parse_list(list, (uint32_t)i);
+    write_segment(segment_path, path, &st, list);
+}
+
+// Claim lists one at a time until none are left, so a large list on
+// one thread does not hold up the rest
+static void *run_build_worker(void *argument)
+{
+    BuildJob *job = argument;
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->list_count) break;
+        load_list(job, i);
+    }
+    return NULL;
+}
+
+static int get_build_thread_count(int list_count)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = cpus > 0 ? (int)cpus : 1;
+    if (count > MAX_BUILD_THREADS) count = MAX_BUILD_THREADS;
+    return count < list_count ? count : list_count;
+}
+
+// Whether heap slot a's next entry sorts before slot b's
+static int heap_less(const BuildList *lists, const size_t *positions, int a, int b)
+{
+    return compare_entries(&lists[a].entries[positions[a]], &lists[b].entries[positions[b]]) < 0;
+}
+
+static void sift_down(int *heap, int heap_size, int slot, const BuildList *lists, const size_t *positions)
+{
+    for (;;) {
+        int smallest = slot;
+        int left = 2 * slot + 1;
+        int right = left + 1;
+        if (left < heap_size && heap_less(lists, positions, heap[left], heap[smallest])) smallest = left;
+        if (right < heap_size && heap_less(lists, positions, heap[right], heap[smallest])) smallest = right;
+        if (smallest == slot) return;
+        int swap = heap[slot];
+        heap[slot] = heap[smallest];
+        heap[smallest] = swap;
+        slot = smallest;
+    }
+}
+
+// Merge the sorted per-list tables through a min-heap, keeping only the
+// first (highest version) entry of each name. Returns the unique count.
+static size_t merge_build_lists(const BuildList *lists, int list_count, BuildEntry **out_entries)
+{
+    size_t total = 0;
+    for (int i = 0; i < list_count; i++) total += lists[i].entry_count;
+    BuildEntry *entries = malloc((total ? total : 1) * sizeof(BuildEntry));
+    size_t *positions = calloc(list_count, sizeof(size_t));
+    int *heap = malloc(list_count * sizeof(int));
+    int heap_size = 0;
+    for (int i = 0; i < list_count; i++) {
+        if (lists[i].entry_count) heap[heap_size++] = i;
+    }
+    for (int slot = heap_size / 2 - 1; slot >= 0; slot--) sift_down(heap, heap_size, slot, lists, positions);
+
+    size_t unique_count = 0;
+    while (heap_size > 0) {
+        int top = heap[0];
+        const BuildEntry *entry = &lists[top].entries[positions[top]++];
+        if (positions[top] == lists[top].entry_count) heap[0] = heap[--heap_size];
+        sift_down(heap, heap_size, 0, lists, positions);
+
+        if (unique_count > 0 &&
+            entries[unique_count - 1].name.length == entry->name.length &&
+            memcmp(entries[unique_count - 1].name.data, entry->name.data, entry->name.length) == 0) {
+            continue;
+        }
+        entries[unique_count++] = *entry;
+    }
+
+    free(positions);
+    free(heap);
+    *out_entries = entries;
+    return unique_count;
+}
+
+// Drop the segments of lists that are gone
+static void prune_segments(const char *segments_dir, char **paths, int list_count)
+{
+    DIR *dir = opendir(segments_dir);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        size_t suffix_length = strlen(SEGMENT_SUFFIX);
+        if (entry->d_name[0] == '.') continue;
+
+        int used = 0;
+        if (length > suffix_length && strcmp(entry->d_name + length - suffix_length, SEGMENT_SUFFIX) == 0) {
+            for (int i = 0; i < list_count && !used; i++) {
+                const char *name = strrchr(paths[i], '/');
+                name = name ? name + 1 : paths[i];
+                used = strlen(name) == length - suffix_length && memcmp(name, entry->d_name, length - suffix_length) == 0;
+            }
+        }
+        if (!used) unlinkat(dirfd(dir), entry->d_name, 0);
+    }
+    closedir(dir);
+}
+
+// Store a repeated small string (architecture, section) only once
+static uint32_t intern_string(Buffer *strings, Slice value, uint32_t *offsets, Slice *values, int *count)
+{
+    for (int i = 0; i < *count; i++) {
+        if (values[i].length == value.length && memcmp(values[i].data, value.data, value.length) == 0) {
+            return offsets[i];
+        }
+    }
+    uint32_t offset = append_string(strings, value);
+    if (*count < 256) {
+        values[*count] = value;
+        offsets[*count] = offset;
+        (*count)++;
+    }
+    return offset;
+}
+
+static void append_lowercase(Buffer *text, const char *data, size_t length)
+{
+    text->data = grow_array(text->data, &text->capacity, text->size + length, 1);
+    for (size_t i = 0; i < length; i++) {
+        text->data[text->size++] = (char)tolower((unsigned char)data[i]);
+    }
+}
+
+// Append the long description with its leading spaces and " ." paragraph
+// markers collapsed into single spaces
+static void append_long_description(Buffer *text, Slice value)
+{
+    const char *line = value.data;
+    const char *end = value.data + value.length;
+    while (line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (!line_end) line_end = end;
+        while (line < line_end && (*line == ' ' || *line == '\t')) line++;
+        if (!(line_end - line == 1 && *line == '.')) {
+            append_buffer(text, " ", 1);
+            append_lowercase(text, line, line_end - line);
+        }
+        line = line_end + 1;
+    }
+}
+
+static void append_varint(Buffer *buffer, uint32_t value)
+{
+    unsigned char bytes[5];
+    int length = 0;
+    do {
+        bytes[length] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[length] |= 0x80;
+        length++;
+    } while (value);
+    append_buffer(buffer, bytes, length);
+}
+
+// Iterate the trigrams of a package's text, skipping any that span the
+// name/description separator
+#define FOR_EACH_TRIGRAM(text, length, trigram) \
+    for (uint32_t _i = 0; _i + 2 < (length); _i++) \
+        if ((text)[_i] != '\n' && (text)[_i + 1] != '\n' && (text)[_i + 2] != '\n' && \
+            ((trigram) = ((uint32_t)(unsigned char)(text)[_i] << 16) | \
+                         ((uint32_t)(unsigned char)(text)[_i + 1] << 8) | \
+                         (uint32_t)(unsigned char)(text)[_i + 2], 1))
+
+// Build a trigram table and delta-coded posting lists over one text
+// per package, given as start offsets and lengths into "text"
+static int build_trigrams(const char *text, const uint32_t *starts, const uint32_t *lengths,
+                          uint32_t package_count, Buffer *out_trigrams, Buffer *out_postings)
+{
+    uint32_t *counts = calloc(TRIGRAM_SPACE, sizeof(uint32_t));
+    uint32_t *stamps = calloc(TRIGRAM_SPACE, sizeof(uint32_t));
+    if (!counts || !stamps) {
+        free(counts);
+        free(stamps);
+        return -1;
+    }
+
+    // Count how many packages contain each trigram, once per package
+    uint64_t total = 0;
+    for (uint32_t id = 0; id < package_count; id++) {
+        const char *package_text = text + starts[id];
+        uint32_t trigram;
+        FOR_EACH_TRIGRAM(package_text, lengths[id], trigram) {
+            if (stamps[trigram] == id + 1) continue;
+            stamps[trigram] = id + 1;
+            counts[trigram]++;
+            total++;
+        }
+    }
+
+    // Turn counts into start positions in one flat id array
+    uint32_t *ids = malloc((total ? total : 1) * sizeof(uint32_t));
+    uint64_t position = 0;
+    for (uint32_t trigram = 0; trigram < TRIGRAM_SPACE; trigram++) {
+        if (!counts[trigram]) continue;
+        IndexTrigram entry = { trigram, counts[trigram], 0 };
+        append_buffer(out_trigrams, &entry, sizeof(entry));
+        counts[trigram] = (uint32_t)position;
+        position += entry.count;
+    }
+
+    // Fill the lists; ids arrive in increasing order so they stay sorted
+    for (uint32_t id = 0; id < package_count; id++) {
+        const char *package_text = text + starts[id];
+        uint32_t trigram;
+        FOR_EACH_TRIGRAM(package_text, lengths[id], trigram) {
+            if (stamps[trigram] == ((id + 1) | 0x80000000u)) continue;
+            stamps[trigram] = (id + 1) | 0x80000000u;
+            ids[counts[trigram]++] = id;
+        }
+    }
+
+    // Encode each list as varint deltas
+    IndexTrigram *entries = (IndexTrigram *)out_trigrams->data;
+    size_t trigram_count = out_trigrams->size / sizeof(IndexTrigram);
+    uint64_t start = 0;
+    for (size_t i = 0; i < trigram_count; i++) {
+        entries[i].offset = out_postings->size;
+        uint32_t previous = 0;
+        for (uint32_t j = 0; j < entries[i].count; j++) {
+            uint32_t id = ids[start + j];
+            append_varint(out_postings, j == 0 ? id : id - previous);
+            previous = id;
+        }
+        start += entries[i].count;
+    }
+
+    free(ids);
+    free(counts);
+    free(stamps);
+    return 0;
+}
+
+// A virtual package name and one package providing it
+typedef struct {
+    Slice name;
+    uint32_t provider;
+} Provision;
+
+// Growable edge list used while building the graph
+typedef struct {
+    IndexEdge *edges;
+    size_t count;
+    size_t capacity;
+} EdgeList;
+
+static int compare_slices(Slice left, Slice right)
+{
+    int result = memcmp(left.data, right.data, left.length < right.length ? left.length : right.length);
+    if (result != 0) return result;
+    return left.length < right.length ? -1 : left.length > right.length;
+}
+
+static int compare_provisions(const void *a, const void *b)
+{
+    const Provision *left = a;
+    const Provision *right = b;
+    int result = compare_slices(left->name, right->name);
+    return result != 0 ? result : (left->provider > right->provider) - (left->provider < right->provider);
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    const IndexEdge *left = a;
+    const IndexEdge *right = b;
+    if (left->package != right->package) return left->package < right->package ? -1 : 1;
+    return (int)left->kind - (int)right->kind;
+}
+
+// Binary search the unique, name-sorted entries. Returns the id or -1.
+static long find_entry(const BuildEntry *entries, size_t count, Slice name)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int result = compare_slices(entries[middle].name, name);
+        if (result == 0) return (long)middle;
+        if (result < 0) low = middle + 1;
+        else high = middle;
+    }
+    return -1;
+}
+
+// Split a relationship field ("a (>= 1) | b:any, c") into package names.
+// Calls back with each name and whether it is one of several choices.
+static void parse_relation_names(Slice field, void (*callback)(Slice name, int alternative, void *context),
+                                 void *context)
+{
+    const char *cursor = field.data;
+    const char *end = field.data + field.length;
+    while (cursor < end) {
+        const char *group_end = memchr(cursor, ',', end - cursor);
+        if (!group_end) group_end = end;
+        int alternative = memchr(cursor, '|', group_end - cursor) != NULL;
+
+        const char *option = cursor;
+        while (option < group_end) {
+            const char *option_end = memchr(option, '|', group_end - option);
+            if (!option_end) option_end = group_end;
+            while (option < option_end && isspace((unsigned char)*option)) option++;
+
+            // The name stops at a version, architecture qualifier or space
+            const char *name_end = option;
+            while (name_end < option_end && *name_end != ' ' && *name_end != '(' &&
+                   *name_end != ':' && *name_end != '[' && *name_end != '\t') {
+                name_end++;
+            }
+            if (name_end > option) {
+                Slice name = { option, (uint32_t)(name_end - option) };
+                callback(name, alternative, context);
+            }
+            option = option_end + 1;
+        }
+        cursor = group_end + 1;
+    }
+}
+
+// State for turning one package's relationship fields into edges
+typedef struct {
+    const BuildEntry *entries;
+    size_t entry_count;
+    const Provision *provisions;
+    size_t provision_count;
+    Provision *pending;         // Provides being collected instead
+    size_t pending_count;
+    size_t pending_capacity;
+    uint32_t source;
+    uint8_t kind;
+    EdgeList *list;
+} RelationContext;
+
+static void append_edge(EdgeList *list, uint32_t package, uint8_t kind, uint8_t flags)
+{
+    list->edges = grow_array(list->edges, &list->capacity, list->count + 1, sizeof(IndexEdge));
+    IndexEdge edge = { package, kind, flags, 0 };
+    list->edges[list->count++] = edge;
+}
+
+static void collect_provision(Slice name, int alternative, void *context)
+{
+    (void)alternative;
+    RelationContext *relation = context;
+    relation->pending = grow_array(relation->pending, &relation->pending_capacity,
+                                   relation->pending_count + 1, sizeof(Provision));
+    Provision provision = { name, relation->source };
+    relation->pending[relation->pending_count++] = provision;
+}
+
+// Resolve a name to a real package, or else to everything providing it
+static void add_relation_edges(Slice name, int alternative, void *context)
+{
+    RelationContext *relation = context;
+    uint8_t flags = alternative ? INDEX_EDGE_ALTERNATIVE : 0;
+    long target = find_entry(relation->entries, relation->entry_count, name);
+    if (target >= 0) {
+        if ((uint32_t)target != relation->source) append_edge(relation->list, (uint32_t)target, relation->kind, flags);
+        return;
+    }
+
+    // First provider of this name, then every one after it
+    size_t low = 0;
+    size_t high = relation->provision_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (compare_slices(relation->provisions[middle].name, name) < 0) low = middle + 1;
+        else high = middle;
+    }
+    for (size_t i = low; i < relation->provision_count &&
+                         compare_slices(relation->provisions[i].name, name) == 0; i++) {
+        uint32_t provider = relation->provisions[i].provider;
+        if (provider != relation->source) {
+            append_edge(relation->list, provider, relation->kind, flags | INDEX_EDGE_VIRTUAL);
+        }
+    }
+}
+
+// Build the forward and reverse dependency graphs in CSR form. Must run
+// while the list mappings the entries point into are still open.
+static uint32_t build_dependency_graph(const BuildEntry *entries, size_t entry_count,
+                                       Buffer *out_offsets, Buffer *out_edges,
+                                       Buffer *out_reverse_offsets, Buffer *out_reverse_edges)
+{
+    RelationContext relation;
+    memset(&relation, 0, sizeof(relation));
+    relation.entries = entries;
+    relation.entry_count = entry_count;
+
+    // Virtual packages, sorted by name for lookups
+    for (size_t i = 0; i < entry_count; i++) {
+        relation.source = (uint32_t)i;
+        parse_relation_names(entries[i].provides, collect_provision, &relation);
+    }
+    qsort(relation.pending, relation.pending_count, sizeof(Provision), compare_provisions);
+    relation.provisions = relation.pending;
+    relation.provision_count = relation.pending_count;
+
+    // Forward edges, one sorted and deduplicated run per package. A
+    // package named twice keeps its strongest relationship.
+    EdgeList list = {0};
+    uint32_t *offsets = malloc((entry_count + 1) * sizeof(uint32_t));
+    relation.list = &list;
+    for (size_t i = 0; i < entry_count; i++) {
+        size_t start = list.count;
+        offsets[i] = (uint32_t)start;
+        relation.source = (uint32_t)i;
+        for (int kind = DEPENDENCY_PRE_DEPENDS; kind <= DEPENDENCY_SUGGESTS; kind++) {
+            relation.kind = (uint8_t)kind;
+            parse_relation_names(entries[i].relations[kind], add_relation_edges, &relation);
+        }
+
+        qsort(list.edges + start, list.count - start, sizeof(IndexEdge), compare_edges);
+        size_t kept = start;
+        for (size_t e = start; e < list.count; e++) {
+            if (kept > start && list.edges[kept - 1].package == list.edges[e].package) continue;
+            list.edges[kept++] = list.edges[e];
+        }
+        list.count = kept;
+    }
+    offsets[entry_count] = (uint32_t)list.count;
+
+    // Reverse edges by counting sort; sources come out in id order
+    uint32_t *reverse_offsets = calloc(entry_count + 1, sizeof(uint32_t));
+    IndexEdge *reverse_edges = malloc((list.count ? list.count : 1) * sizeof(IndexEdge));
+    for (size_t e = 0; e < list.count; e++) reverse_offsets[list.edges[e].package + 1]++;
+    for (size_t i = 0; i < entry_count; i++) reverse_offsets[i + 1] += reverse_offsets[i];
+    uint32_t *fill = malloc((entry_count + 1) * sizeof(uint32_t));
+    memcpy(fill, reverse_offsets, (entry_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < entry_count; i++) {
+        for (uint32_t e = offsets[i]; e < offsets[i + 1]; e++) {
+            IndexEdge edge = list.edges[e];
+            uint32_t target = edge.package;
+            edge.package = (uint32_t)i;
+            reverse_edges[fill[target]++] = edge;
+        }
+    }
+
+    append_buffer(out_offsets, offsets, (entry_count + 1) * sizeof(uint32_t));
+    append_buffer(out_edges, list.edges, list.count * sizeof(IndexEdge));
+    append_buffer(out_reverse_offsets, reverse_offsets, (entry_count + 1) * sizeof(uint32_t));
+    append_buffer(out_reverse_edges, reverse_edges, list.count * sizeof(IndexEdge));
+
+    uint32_t edge_count = (uint32_t)list.count;
+    free(relation.pending);
+    free(list.edges);
+    free(offsets);
+    free(reverse_offsets);
+    free(reverse_edges);
+    free(fill);
+    return edge_count;
+}
+
+// Whether [offset, offset + length) lies in a section of "size" bytes
+static int fits_in(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+// Check that the sections follow each other in the file, aligned and
+// large enough for their counts, as build_package_index() lays them out
+static int validate_index_sections(const IndexHeader *header)
+{
+    uint64_t package_count = header->package_count;
+    const struct {
+        uint64_t offset;
+        uint64_t needed;
+    } sections[] = {
+        {header->packages_offset, package_count * sizeof(IndexPackage)},
+        {header->strings_offset, 1},
+        {header->text_offset, 0},
+        {header->trigrams_offset, (uint64_t)header->trigram_count * sizeof(IndexTrigram)},
+        {header->postings_offset, 0},
+        {header->name_trigrams_offset, (uint64_t)header->name_trigram_count * sizeof(IndexTrigram)},
+        {header->name_postings_offset, 0},
+        {header->stanzas_offset, 0},
+        {header->dependency_offsets_offset, (package_count + 1) * sizeof(uint32_t)},
+        {header->dependencies_offset, (uint64_t)header->edge_count * sizeof(IndexEdge)},
+        {header->reverse_offsets_offset, (package_count + 1) * sizeof(uint32_t)},
+        {header->reverse_dependencies_offset, (uint64_t)header->edge_count * sizeof(IndexEdge)},
+        {header->file_size, 0},
+    };
+    size_t count = sizeof(sections) / sizeof(sections[0]);
+    if (header->packages_offset != sizeof(IndexHeader)) return -1;
+    for (size_t i = 0; i + 1 < count; i++) {
+        uint64_t start = sections[i].offset;
+        uint64_t end = sections[i + 1].offset;
+        if (start % 8 != 0 || end < start || end - start < sections[i].needed) return -1;
+    }
+    return 0;
+}
+
+// Check that a trigram table's posting lists stay inside their section
+// and hold increasing package ids
+static int validate_postings(const IndexTrigram *trigrams, uint32_t trigram_count,
+                             const unsigned char *postings, const unsigned char *postings_end,
+                             uint32_t package_count)
+{
+    for (uint32_t i = 0; i < trigram_count; i++) {
+        if (!fits_in(trigrams[i].offset, trigrams[i].count, postings_end - postings)) return -1;
+        const unsigned char *cursor = postings + trigrams[i].offset;
+        uint64_t id = 0;
+        for (uint32_t j = 0; j < trigrams[i].count; j++) {
+            uint32_t delta;
+            cursor = read_index_varint(cursor, postings_end, &delta);
+            if (!cursor || (j > 0 && delta == 0)) return -1;
+            id = j == 0 ? delta : id + delta;
+            if (id >= package_count) return -1;
+        }
+    }
+    return 0;
+}
+
+// Check the offsets stored inside the sections, so lookups cannot leave
+// the mapping. Run once on a freshly built index rather than on every
+// open, which would touch most of the mapping.
+static int validate_index_records(const PackageIndex *index)
+{
+    const IndexHeader *header = index->header;
+    uint64_t strings_size = header->text_offset - header->strings_offset;
+    uint64_t text_size = header->trigrams_offset - header->text_offset;
+    uint64_t postings_size = header->name_trigrams_offset - header->postings_offset;
+    uint64_t name_postings_size = header->stanzas_offset - header->name_postings_offset;
+    uint64_t stanzas_size = header->dependency_offsets_offset - header->stanzas_offset;
+
+    // Strings are read up to their NUL, so each section must end in one
+    if (index->strings[strings_size - 1] != '\0') return -1;
+    if (text_size > 0 && index->text[text_size - 1] != '\0') return -1;
+
+    for (uint32_t i = 0; i < header->package_count; i++) {
+        const IndexPackage *package = &index->packages[i];
+        if (package->name >= strings_size || package->version >= strings_size ||
+            package->architecture >= strings_size || package->section >= strings_size ||
+            package->description >= strings_size ||
+            !fits_in(package->text, package->text_length, text_size) ||
+            package->name_length > package->text_length ||
+            !fits_in(package->stanza, package->stanza_length, stanzas_size)) {
+            return -1;
+        }
+    }
+    if (validate_postings(index->trigrams, header->trigram_count, index->postings,
+                          index->postings + postings_size, header->package_count) != 0 ||
+        validate_postings(index->name_trigrams, header->name_trigram_count, index->name_postings,
+                          index->name_postings + name_postings_size, header->package_count) != 0) {
+        return -1;
+    }
+
+    // Each package's edges run from its offset to the next one's
+    const uint32_t *offsets[] = {index->dependency_offsets, index->reverse_offsets};
+    const IndexEdge *edges[] = {index->dependencies, index->reverse_dependencies};
+    for (int graph = 0; graph < 2; graph++) {
+        if (offsets[graph][0] != 0 || offsets[graph][header->package_count] != header->edge_count) return -1;
+        for (uint32_t i = 0; i < header->package_count; i++) {
+            if (offsets[graph][i + 1] < offsets[graph][i]) return -1;
+        }
+        for (uint32_t e = 0; e < header->edge_count; e++) {
+            if (edges[graph][e].package >= header->package_count) return -1;
+        }
+    }
+    return 0;
+}
+
+int build_package_index(void)
+{
+    char **paths;
+    uint64_t fingerprint;
+    int list_count = collect_list_files(&paths, &fingerprint);
+    if (list_count == 0) {
+        free_list_files(paths, list_count);
+        return -1;
+    }
+
+    // Load the lists in parallel, each from its segment when unchanged
+    const char *cache_dir = get_cache_dir();
+    char segments_dir[4096];
+    snprintf(segments_dir, sizeof(segments_dir), "%s/%s", cache_dir, SEGMENT_DIR_NAME);
+    mkdir(cache_dir, 0755);
+    mkdir(segments_dir, 0755);
+    int span = begin_span("Loading lists");
+    BuildList *lists = calloc(list_count, sizeof(BuildList));
+    BuildJob job = { paths, lists, list_count, 0, segments_dir };
+    int thread_count = get_build_thread_count(list_count);
+    pthread_t threads[MAX_BUILD_THREADS];
+    int created[MAX_BUILD_THREADS] = {0};
+    for (int t = 1; t < thread_count; t++) {
+        created[t] = pthread_create(&threads[t], NULL, run_build_worker, &job) == 0;
+    }
+
+    // This thread works too, so the lists still get loaded if no other
+    // thread could be started
+    run_build_worker(&job);
+    for (int t = 1; t < thread_count; t++) {
+        if (created[t]) pthread_join(threads[t], NULL);
+    }
+    prune_segments(segments_dir, paths, list_count);
+    for (int i = 0; i < list_count; i++) add_span_bytes(span, lists[i].size);
+    end_span(span);
+
+    span = begin_span("Merging lists");
+    BuildEntry *entries;
+    size_t unique_count = merge_build_lists(lists, list_count, &entries);
+    end_span(span);
+
+    // Lay out the package table, string pool and search text
+    Buffer header = {0};
+    Buffer packages = {0};
+    Buffer strings = {0};
+    Buffer text = {0};
+    Buffer trigrams = {0};
+    Buffer postings = {0};
+    Buffer name_trigrams = {0};
+    Buffer name_postings = {0};
+    Buffer stanzas = {0};
+    Buffer dependency_offsets = {0};
+    Buffer dependencies = {0};
+    Buffer reverse_offsets = {0};
+    Buffer reverse_dependencies = {0};
+    Buffer *const owned[] = {
+        &header, &packages, &strings, &text, &trigrams, &postings, &name_trigrams, &name_postings,
+        &stanzas, &dependency_offsets, &dependencies, &reverse_offsets, &reverse_dependencies
+    };
+    uint32_t interned_offsets[256];
+    Slice interned_values[256];
+    int interned_count = 0;
+
+    span = begin_span("Laying out packages");
+    append_buffer(&strings, "", 1);
+    packages.data = grow_array(NULL, &packages.capacity, unique_count * sizeof(IndexPackage) + 1, 1);
+    for (size_t i = 0; i < unique_count; i++) {
+        const BuildEntry *entry = &entries[i];
+        IndexPackage package = {0};
+        package.name = append_string(&strings, entry->name);
+        package.version = append_string(&strings, entry->version);
+        package.architecture = intern_string(&strings, entry->architecture,
+                                             interned_offsets, interned_values, &interned_count);
+        package.section = intern_string(&strings, entry->section,
+                                        interned_offsets, interned_values, &interned_count);
+        package.description = append_string(&strings, entry->description);
+        package.size = entry->size;
+        package.installed_size = entry->installed_size;
+        package.name_length = entry->name.length;
+
+        package.text = (uint32_t)text.size;
+        append_lowercase(&text, entry->name.data, entry->name.length);
+        append_buffer(&text, "\n", 1);
+        append_lowercase(&text, entry->description.data, entry->description.length);
+        append_long_description(&text, entry->long_description);
+        package.text_length = (uint32_t)(text.size - package.text);
+        append_buffer(&text, "", 1);
+
+        package.stanza = append_buffer(&stanzas, entry->stanza.data, entry->stanza.length);
+        package.stanza_length = entry->stanza.length;
+        append_buffer(&stanzas, "\n", 1);
+
+        append_buffer(&packages, &package, sizeof(package));
+    }
+
+    uint32_t edge_count = build_dependency_graph(entries, unique_count, &dependency_offsets, &dependencies,
+                                                 &reverse_offsets, &reverse_dependencies);
+
+    // The list contents are no longer needed once everything is copied out
+    for (int i = 0; i < list_count; i++) release_list_file(&lists[i]);
+    free(lists);
+    free(entries);
+    free_list_files(paths, list_count);
+    end_span(span);
+
+    // Index the full text for search, and the space-padded names alone
+    // so "did you mean" lookups are not swamped by description matches
+    const IndexPackage *built = (const IndexPackage *)packages.data;
+    uint32_t *text_starts = malloc((unique_count + 1) * sizeof(uint32_t));
+    uint32_t *text_lengths = malloc((unique_count + 1) * sizeof(uint32_t));
+    uint32_t *name_starts = malloc((unique_count + 1) * sizeof(uint32_t));
+    uint32_t *name_lengths = malloc((unique_count + 1) * sizeof(uint32_t));
+    Buffer names = {0};
+    for (size_t i = 0; i < unique_count; i++) {
+        text_starts[i] = built[i].text;
+        text_lengths[i] = built[i].text_length;
+        name_starts[i] = (uint32_t)append_buffer(&names, " ", 1);
+        append_buffer(&names, text.data + built[i].text, built[i].name_length);
+        append_buffer(&names, " ", 1);
+        name_lengths[i] = built[i].name_length + 2;
+    }
+    span = begin_span("Building trigrams");
+    int trigram_result = build_trigrams(text.data, text_starts, text_lengths, (uint32_t)unique_count,
+                                        &trigrams, &postings);
+    if (trigram_result == 0) {
+        trigram_result = build_trigrams(names.data, name_starts, name_lengths, (uint32_t)unique_count,
+                                        &name_trigrams, &name_postings);
+    }
+    free(text_starts);
+    free(text_lengths);
+    free(name_starts);
+    free(name_lengths);
+    free(names.data);
+    end_span(span);
+    if (trigram_result != 0) {
+        free_buffers(owned, sizeof(owned) / sizeof(owned[0]));
+        return -2;
+    }
+
+    // Align every section so the mapped structs can be used in place
+    IndexHeader index_header = {0};
+    memcpy(index_header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    index_header.format_version = INDEX_FORMAT_VERSION;
+    index_header.package_count = (uint32_t)unique_count;
+    index_header.fingerprint = fingerprint;
+    index_header.trigram_count = (uint32_t)(trigrams.size / sizeof(IndexTrigram));
+    index_header.name_trigram_count = (uint32_t)(name_trigrams.size / sizeof(IndexTrigram));
+    index_header.edge_count = edge_count;
+    align_buffer(&strings);
+    align_buffer(&text);
+    align_buffer(&postings);
+    align_buffer(&name_postings);
+    align_buffer(&stanzas);
+    align_buffer(&dependency_offsets);
+    align_buffer(&reverse_offsets);
+    index_header.packages_offset = sizeof(IndexHeader);
+    index_header.strings_offset = index_header.packages_offset + packages.size;
+    index_header.text_offset = index_header.strings_offset + strings.size;
+    index_header.trigrams_offset = index_header.text_offset + text.size;
+    index_header.postings_offset = index_header.trigrams_offset + trigrams.size;
+    index_header.name_trigrams_offset = index_header.postings_offset + postings.size;
+    index_header.name_postings_offset = index_header.name_trigrams_offset + name_trigrams.size;
+    index_header.stanzas_offset = index_header.name_postings_offset + name_postings.size;
+    index_header.dependency_offsets_offset = index_header.stanzas_offset + stanzas.size;
+    index_header.dependencies_offset = index_header.dependency_offsets_offset + dependency_offsets.size;
+    index_header.reverse_offsets_offset = index_header.dependencies_offset + dependencies.size;
+    index_header.reverse_dependencies_offset = index_header.reverse_offsets_offset + reverse_offsets.size;
+    index_header.file_size = index_header.reverse_dependencies_offset + reverse_dependencies.size;
+
+    // Check the records once here, so opening the file only has to
+    // check the header
+    PackageIndex view = {0};
+    view.header = &index_header;
+    view.packages = (const IndexPackage *)packages.data;
+    view.strings = strings.data;
+    view.text = text.data;
+    view.trigrams = (const IndexTrigram *)trigrams.data;
+    view.postings = (const unsigned char *)postings.data;
+    view.name_trigrams = (const IndexTrigram *)name_trigrams.data;
+    view.name_postings = (const unsigned char *)name_postings.data;
+    view.stanzas = stanzas.data;
+    view.dependency_offsets = (const uint32_t *)dependency_offsets.data;
+    view.dependencies = (const IndexEdge *)dependencies.data;
+    view.reverse_offsets = (const uint32_t *)reverse_offsets.data;
+    view.reverse_dependencies = (const IndexEdge *)reverse_dependencies.data;
+    if (validate_index_sections(&index_header) != 0 || validate_index_records(&view) != 0) {
+        free_buffers(owned, sizeof(owned) / sizeof(owned[0]));
+        return -2;
+    }
+    index_header.flags |= INDEX_FLAG_VALIDATED;
+    append_buffer(&header, &index_header, sizeof(index_header));
+
+    // Write the file next to where readers expect it
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, INDEX_FILE_NAME);
+    const Buffer *sections[] = {
+        &header, &packages, &strings, &text, &trigrams, &postings, &name_trigrams, &name_postings,
+        &stanzas, &dependency_offsets, &dependencies, &reverse_offsets, &reverse_dependencies
+    };
+    span = begin_span("Writing index");
+    int result = write_file_sections(path, sections, 13);
+    add_span_bytes(span, index_header.file_size);
+    end_span(span);
+
+    free_buffers(owned, sizeof(owned) / sizeof(owned[0]));
+    return result == 0 ? 0 : -2;
+}
+
+// Held by lime-aptd so its workers skip mapping and fingerprinting
+static PackageIndex resident_index;
+
+void set_resident_index(const PackageIndex *index)
+{
+    if (index) resident_index = *index;
+    else memset(&resident_index, 0, sizeof(resident_index));
+}
+
+int open_package_index(PackageIndex *out_index)
+{
+    if (resident_index.data) {
+        *out_index = resident_index;
+        return 0;
+    }
+    memset(out_index, 0, sizeof(*out_index));
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", get_cache_dir(), INDEX_FILE_NAME);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return -2;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    // Validate the header before trusting any offsets
+    const IndexHeader *header = data;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header->format_version != INDEX_FORMAT_VERSION ||
+        header->file_size != (uint64_t)st.st_size ||
+        !(header->flags & INDEX_FLAG_VALIDATED) ||
+        validate_index_sections(header) != 0) {
+        munmap(data, st.st_size);
+        return -2;
+    }
+
+    out_index->data = data;
+    out_index->size = st.st_size;
+    out_index->header = header;
+    out_index->packages = (const IndexPackage *)((const char *)data + header->packages_offset);
+    out_index->strings = (const char *)data + header->strings_offset;
+    out_index->text = (const char *)data + header->text_offset;
+    out_index->trigrams = (const IndexTrigram *)((const char *)data + header->trigrams_offset);
+    out_index->postings = (const unsigned char *)data + header->postings_offset;
+    out_index->postings_end = (const unsigned char *)data + header->name_trigrams_offset;
+    out_index->name_trigrams = (const IndexTrigram *)((const char *)data + header->name_trigrams_offset);
+    out_index->name_postings = (const unsigned char *)data + header->name_postings_offset;
+    out_index->name_postings_end = (const unsigned char *)data + header->stanzas_offset;
+    out_index->stanzas = (const char *)data + header->stanzas_offset;
+    out_index->dependency_offsets = (const uint32_t *)((const char *)data + header->dependency_offsets_offset);
+    out_index->dependencies = (const IndexEdge *)((const char *)data + header->dependencies_offset);
+    out_index->reverse_offsets = (const uint32_t *)((const char *)data + header->reverse_offsets_offset);
+    out_index->reverse_dependencies = (const IndexEdge *)((const char *)data + header->reverse_dependencies_offset);
+
+    // Compare against the current lists to detect a stale index
+    char **paths;
+    uint64_t fingerprint;
+    int list_count = collect_list_files(&paths, &fingerprint);
+    free_list_files(paths, list_count);
+    if (fingerprint != header->fingerprint) return -3;
+
+    return 0;
+}
+
+int load_package_index(PackageIndex *out_index)
+{
+    int span = begin_span("Opening package index");
+    int result = open_package_index(out_index);
+    if (result == 0) {
+        end_span(span);
+        return 0;
+    }
+
+    // Rebuild only when we are allowed to replace the file
+    close_package_index(out_index);
+    const char *cache_dir = get_cache_dir();
+    if ((access(cache_dir, W_OK) != 0 && (mkdir(cache_dir, 0755) != 0 || access(cache_dir, W_OK) != 0)) ||
+        build_package_index() != 0) {
+        end_span(span);
+        return result;
+    }
+
+    result = open_package_index(out_index);
+    end_span(span);
+    return result;
+}
+
+void close_package_index(PackageIndex *index)
+{
+    if (index->data && index->data != resident_index.data) munmap((void *)index->data, index->size);
+    memset(index, 0, sizeof(*index));
+}
+
+int find_index_package(const PackageIndex *index, const char *name)
+{
+    int low = 0;
+    int high = (int)index->header->package_count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int result = strcmp(get_index_string(index, index->packages[middle].name), name);
+        if (result == 0) return middle;
+        if (result < 0) low = middle + 1;
+        else high = middle - 1;
+    }
+    return -1;
+}
+
+uint32_t find_index_prefix(const PackageIndex *index, const char *prefix)
+{
+    uint32_t low = 0;
+    uint32_t high = index->header->package_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (strcmp(get_index_string(index, index->packages[middle].name), prefix) < 0) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+const IndexTrigram *find_index_trigram(const IndexTrigram *table, uint32_t count, uint32_t trigram)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        uint32_t value = table[middle].trigram;
+        if (value == trigram) return &table[middle];
+        if (value < trigram) low = middle + 1;
+        else high = middle;
+    }
+    return NULL;
+}
+
+const unsigned char *read_index_varint(const unsigned char *cursor, const unsigned char *end,
+                                       uint32_t *out_value)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35 && cursor < end; shift += 7) {
+        value |= (uint32_t)(*cursor & 0x7f) << shift;
+        if (!(*cursor++ & 0x80)) {
+            *out_value = value;
+            return cursor;
+        }
+    }
+    return NULL;
+}
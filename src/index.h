@@ -0,0 +1,158 @@
+/**
+ * lime-apt Package Index
+ *
+ * A compact, mmap-able snapshot of the apt lists. Packages are stored
+ * once per name in name order, with an inverted trigram index over the
+ * lowercased name and description so searches only look at candidates
+ * instead of scanning every description, and a second one over names
+ * alone for spelling suggestions. The raw list stanza of every package
+ * is kept as well, so "show" can print it straight from the mapping,
+ * along with the dependency graph between packages in compressed sparse
+ * row form: per-package offsets into one flat edge array, forwards and
+ * reversed.
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define INDEX_MAGIC          "LIMEIDX"
+#define INDEX_FORMAT_VERSION 6
+#define INDEX_FILE_NAME      "packages.idx"
+
+// File header, at offset 0
+typedef struct {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t package_count;
+    uint64_t fingerprint;       // Hash of the list files it was built from
+    uint64_t packages_offset;   // IndexPackage[package_count]
+    uint64_t strings_offset;    // NUL-terminated strings
+    uint64_t text_offset;       // Lowercased search text
+    uint64_t trigrams_offset;   // IndexTrigram[trigram_count]
+    uint64_t postings_offset;   // Varint delta-coded package ids
+    uint64_t name_trigrams_offset;  // Same, over " name " only
+    uint64_t name_postings_offset;
+    uint64_t stanzas_offset;    // Raw stanzas, as found in the lists
+    uint64_t dependency_offsets_offset;     // uint32_t[package_count + 1]
+    uint64_t dependencies_offset;           // IndexEdge[edge_count]
+    uint64_t reverse_offsets_offset;        // Same, reversed
+    uint64_t reverse_dependencies_offset;
+    uint32_t trigram_count;
+    uint32_t name_trigram_count;
+    uint32_t edge_count;
+    uint32_t flags;             // INDEX_FLAG_*
+    uint64_t file_size;
+} IndexHeader;
+
+// Every record offset and posting list was checked against its section
+// before the file was written; readers only check the header
+#define INDEX_FLAG_VALIDATED 0x01
+
+// One package, at its highest available version
+typedef struct {
+    uint32_t name;              // Offsets into the string pool
+    uint32_t version;
+    uint32_t architecture;
+    uint32_t section;
+    uint32_t description;       // Short description
+    uint32_t text;              // Offset into the search text
+    uint32_t text_length;       // "name\ndescription", lowercased
+    uint32_t name_length;
+    uint64_t size;              // Download size in bytes
+    uint64_t installed_size;    // Installed size in KiB
+    uint64_t stanza;            // Offset into the stanzas section
+    uint32_t stanza_length;
+    uint32_t reserved;
+} IndexPackage;
+
+// Posting list for one trigram
+typedef struct {
+    uint32_t trigram;           // Three lowercased bytes, big-endian
+    uint32_t count;             // Number of package ids in the list
+    uint64_t offset;            // Offset into the postings section
+} IndexTrigram;
+
+// Relationship kinds, strongest first
+typedef enum {
+    DEPENDENCY_PRE_DEPENDS,
+    DEPENDENCY_DEPENDS,
+    DEPENDENCY_RECOMMENDS,
+    DEPENDENCY_SUGGESTS,
+} DependencyKind;
+
+#define INDEX_EDGE_ALTERNATIVE 0x01     // One of several "a | b" choices
+#define INDEX_EDGE_VIRTUAL     0x02     // Through a Provides of the target
+
+// One dependency edge. In the forward graph "package" is the package
+// depended on; in the reverse graph it is the dependent.
+typedef struct {
+    uint32_t package;
+    uint8_t kind;               // DependencyKind
+    uint8_t flags;
+    uint16_t reserved;
+} IndexEdge;
+
+// An open, mapped index
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const IndexHeader *header;
+    const IndexPackage *packages;
+    const char *strings;
+    const char *text;
+    const IndexTrigram *trigrams;
+    const unsigned char *postings;
+    const unsigned char *postings_end;
+    const IndexTrigram *name_trigrams;
+    const unsigned char *name_postings;
+    const unsigned char *name_postings_end;
+    const char *stanzas;
+    const uint32_t *dependency_offsets;
+    const IndexEdge *dependencies;
+    const uint32_t *reverse_offsets;
+    const IndexEdge *reverse_dependencies;
+} PackageIndex;
+
+// Build the index from the apt lists and atomically replace the file.
+// Returns 0 on success, -1 if there are no lists, -2 on write failure.
+int build_package_index(void);
+
+// Map the index file. Returns 0 on success, -1 if it is missing,
+// -2 if it is corrupt or from another format version, -3 if the apt
+// lists changed since it was built.
+int open_package_index(PackageIndex *out_index);
+
+// Open the index, rebuilding it first when stale and we may write it
+int load_package_index(PackageIndex *out_index);
+
+void close_package_index(PackageIndex *index);
+
+// Answer every later open with this already mapped index instead of
+// the file, or with the file again when NULL. Closing the copies it
+// hands out leaves the mapping alone.
+void set_resident_index(const PackageIndex *index);
+
+// Binary search by exact name. Returns the package id or -1.
+int find_index_package(const PackageIndex *index, const char *name);
+
+// Id of the first package whose name sorts at or after "prefix"; the
+// names starting with it follow contiguously from there
+uint32_t find_index_prefix(const PackageIndex *index, const char *prefix);
+
+// Binary search a trigram table. Returns NULL if the trigram is absent.
+const IndexTrigram *find_index_trigram(const IndexTrigram *table, uint32_t count, uint32_t trigram);
+
+// Decode one value of a posting list, returning the next position, or
+// NULL if it runs into "end" or past the five bytes a uint32_t needs
+const unsigned char *read_index_varint(const unsigned char *cursor, const unsigned char *end,
+                                       uint32_t *out_value);
+
+static inline const char *get_index_string(const PackageIndex *index, uint32_t offset)
+{
+    return index->strings + offset;
+}
+
+#endif // INDEX_H
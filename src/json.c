@@ -0,0 +1,133 @@
+/**
+ * lime-apt NDJSON Writer
+ *
+ * Minimal streaming JSON object writer. Records are flat objects of
+ * strings, integers and booleans, which is all --json mode needs.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "json.h"
+
+static FILE *json_stream = NULL;
+static struct timespec json_start;
+static int json_started = 0;
+
+static long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void set_json_stream(FILE *stream)
+{
+    json_stream = stream;
+}
+
+long get_json_elapsed_ms(void)
+{
+    if (!json_started) {
+        clock_gettime(CLOCK_MONOTONIC, &json_start);
+        json_started = 1;
+    }
+    return monotonic_ms() - (json_start.tv_sec * 1000L + json_start.tv_nsec / 1000000L);
+}
+
+void write_json_string(FILE *out, const char *value, size_t length)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+        switch (c) {
+            case '"':  fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (c < 0x20) {
+                    fprintf(out, "\\u%04x", c);
+                } else {
+                    fputc(c, out);
+                }
+        }
+    }
+    fputc('"', out);
+}
+
+// Write a string literal with JSON escaping
+static void write_escaped(const char *value, size_t length)
+{
+    write_json_string(json_stream ? json_stream : stdout, value, length);
+}
+
+void begin_json_record(const char *type)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputs("{\"type\":", out);
+    write_escaped(type, strlen(type));
+    fprintf(out, ",\"elapsed_ms\":%ld", get_json_elapsed_ms());
+}
+
+void add_json_string_n(const char *key, const char *value, size_t length)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputc(',', out);
+    write_escaped(key, strlen(key));
+    fputc(':', out);
+    if (value) {
+        write_escaped(value, length);
+    } else {
+        fputs("null", out);
+    }
+}
+
+void add_json_string(const char *key, const char *value)
+{
+    add_json_string_n(key, value, value ? strlen(value) : 0);
+}
+
+void add_json_int(const char *key, long value)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputc(',', out);
+    write_escaped(key, strlen(key));
+    fprintf(out, ":%ld", value);
+}
+
+void add_json_bool(const char *key, int value)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputc(',', out);
+    write_escaped(key, strlen(key));
+    fputs(value ? ":true" : ":false", out);
+}
+
+void add_json_string_array(const char *key, const char *const values[], int count)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputc(',', out);
+    write_escaped(key, strlen(key));
+    fputs(":[", out);
+    for (int i = 0; i < count; i++) {
+        if (i > 0) fputc(',', out);
+        write_escaped(values[i], strlen(values[i]));
+    }
+    fputc(']', out);
+}
+
+void end_json_record(void)
+{
+    FILE *out = json_stream ? json_stream : stdout;
+
+    fputs("}\n", out);
+    fflush(out);
+}
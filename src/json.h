@@ -0,0 +1,36 @@
+/**
+ * lime-apt NDJSON Writer
+ *
+ * Streams one JSON object per line for --json mode. Every record is
+ * flushed as soon as it is complete so consumers can process results
+ * incrementally instead of waiting for the command to finish.
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+
+// Direct records to the given stream (defaults to stdout)
+void set_json_stream(FILE *stream);
+
+// Milliseconds elapsed since the process started emitting records
+long get_json_elapsed_ms(void);
+
+// Start a record; "type" and "elapsed_ms" are always written first
+void begin_json_record(const char *type);
+
+void add_json_string(const char *key, const char *value);
+void add_json_string_n(const char *key, const char *value, size_t length);
+void add_json_int(const char *key, long value);
+void add_json_bool(const char *key, int value);
+void add_json_string_array(const char *key, const char *const values[], int count);
+
+// Terminate the record with a newline and flush it
+void end_json_record(void);
+
+// Write a quoted, escaped string to any stream, for JSON documents
+// other than the record stream
+void write_json_string(FILE *stream, const char *value, size_t length);
+
+#endif // JSON_H
@@ -0,0 +1,217 @@
+/**
+ * lime-apt Package Lock Queue
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "lock.h"
+#include "paths.h"
+
+#define MAX_LOCK_FILES 4
+
+static char ticket_path[4096];
+static char ticket_name[64];
+
+static long get_monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+static int is_process_alive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// A descriptor that polls readable when the process exits, or -1
+static int open_process_fd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return pid > 0 ? (int)syscall(SYS_pidfd_open, pid, 0) : -1;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+// Directory part of a path, "." if it has none
+static void get_directory(const char *path, char *buffer, size_t buffer_size)
+{
+    const char *slash = strrchr(path, '/');
+    if (!slash) snprintf(buffer, buffer_size, ".");
+    else if (slash == path) snprintf(buffer, buffer_size, "/");
+    else snprintf(buffer, buffer_size, "%.*s", (int)(slash - path), path);
+}
+
+// apt's lock files for the requested kinds, where apt keeps them
+static int get_lock_files(int kinds, char out_paths[MAX_LOCK_FILES][4096])
+{
+    char dpkg_dir[2048];
+    get_directory(get_dpkg_status_path(), dpkg_dir, sizeof(dpkg_dir));
+    int count = 0;
+    if (kinds & LOCK_PACKAGES) {
+        snprintf(out_paths[count++], 4096, "%s/lock-frontend", dpkg_dir);
+        snprintf(out_paths[count++], 4096, "%s/lock", dpkg_dir);
+        snprintf(out_paths[count++], 4096, "%s/lock", get_archives_dir());
+    }
+    if (kinds & LOCK_LISTS) snprintf(out_paths[count++], 4096, "%s/lock", get_lists_dir());
+    return count;
+}
+
+// The process holding apt's fcntl lock on a file: 0 when free, -1 when
+// held by an open file description with no owner
+static pid_t get_lock_holder(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    pid_t holder = 0;
+    if (fcntl(fd, F_GETLK, &lock) == 0 && lock.l_type != F_UNLCK) holder = lock.l_pid > 0 ? lock.l_pid : -1;
+    close(fd);
+    return holder;
+}
+
+// The live run queued right before ours, clearing tickets of runs that
+// died without removing them. Returns 0 when we are first.
+static pid_t find_run_ahead(const char *queue_dir)
+{
+    DIR *dir = opendir(queue_dir);
+    if (!dir) return 0;
+
+    char ahead[256] = "";
+    pid_t ahead_pid = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *dash = strchr(entry->d_name, '-');
+        if (!dash || strcmp(entry->d_name, ticket_name) >= 0) continue;
+        pid_t pid = (pid_t)atoi(dash + 1);
+        if (!is_process_alive(pid)) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", queue_dir, entry->d_name);
+            unlink(path);
+            continue;
+        }
+        if (strcmp(entry->d_name, ahead) > 0) {
+            snprintf(ahead, sizeof(ahead), "%s", entry->d_name);
+            ahead_pid = pid;
+        }
+    }
+    closedir(dir);
+    return ahead_pid;
+}
+
+static void describe_holder(pid_t holder, LockWait *wait)
+{
+    wait->holder = holder;
+    snprintf(wait->holder_name, sizeof(wait->holder_name), "another process");
+    if (holder <= 0) return;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int)holder);
+    FILE *file = fopen(path, "r");
+    if (!file) return;
+    if (fgets(wait->holder_name, sizeof(wait->holder_name), file)) {
+        wait->holder_name[strcspn(wait->holder_name, "\n")] = '\0';
+    }
+    fclose(file);
+}
+
+void release_lock_turn(void)
+{
+    if (ticket_path[0]) unlink(ticket_path);
+    ticket_path[0] = '\0';
+}
+
+// Take a place at the back of the queue
+static int take_ticket(const char *queue_dir)
+{
+    if (ticket_path[0]) return 0;
+
+    char parent[4096];
+    get_directory(queue_dir, parent, sizeof(parent));
+    mkdir(parent, 0755);
+    mkdir(queue_dir, 0755);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(ticket_name, sizeof(ticket_name), "%020llu-%d",
+             (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec, (int)getpid());
+    snprintf(ticket_path, sizeof(ticket_path), "%s/%s", queue_dir, ticket_name);
+    int fd = open(ticket_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ticket_path[0] = '\0';
+        return -1;
+    }
+    close(fd);
+    atexit(release_lock_turn);
+    return 0;
+}
+
+int wait_for_lock_turn(int kinds, int timeout_seconds, LockWaitCallback callback, void *context,
+                       LockWait *out_wait)
+{
+    memset(out_wait, 0, sizeof(*out_wait));
+    const char *queue_dir = get_queue_dir();
+    if (take_ticket(queue_dir) != 0) return -2;
+
+    char lock_files[MAX_LOCK_FILES][4096];
+    int lock_count = get_lock_files(kinds, lock_files);
+
+    // Wake when a ticket goes away or apt closes a lock file it wrote
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    inotify_add_watch(inotify_fd, queue_dir, IN_DELETE | IN_MOVED_FROM);
+    for (int i = 0; i < lock_count; i++) {
+        char directory[4096];
+        get_directory(lock_files[i], directory, sizeof(directory));
+        inotify_add_watch(inotify_fd, directory, IN_CLOSE_WRITE | IN_DELETE);
+    }
+
+    long started_ms = get_monotonic_ms();
+    long timeout_ms = timeout_seconds > 0 ? timeout_seconds * 1000L : 0;
+    pid_t reported = 0;
+    int result = 0;
+    for (;;) {
+        pid_t holder = find_run_ahead(queue_dir);
+        for (int i = 0; !holder && i < lock_count; i++) holder = get_lock_holder(lock_files[i]);
+        out_wait->waited_ms = get_monotonic_ms() - started_ms;
+        if (!holder) break;
+
+        if (holder != reported) {
+            describe_holder(holder, out_wait);
+            reported = holder;
+            if (callback) callback(out_wait, context);
+        }
+        long remaining_ms = timeout_ms - out_wait->waited_ms;
+        if (remaining_ms <= 0) {
+            result = -1;
+            break;
+        }
+
+        // A holder without a pidfd is rechecked every second
+        struct pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { open_process_fd(holder), POLLIN, 0 } };
+        int wait_ms = fds[1].fd >= 0 || remaining_ms < 1000 ? (int)remaining_ms : 1000;
+        poll(fds, fds[1].fd >= 0 ? 2 : 1, wait_ms);
+        if (fds[1].fd >= 0) close(fds[1].fd);
+        char buffer[4096];
+        while (read(inotify_fd, buffer, sizeof(buffer)) > 0);
+    }
+
+    close(inotify_fd);
+    if (result != 0) release_lock_turn();
+    return result;
+}
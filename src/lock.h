@@ -0,0 +1,41 @@
+/**
+ * lime-apt Package Lock Queue
+ *
+ * Concurrent lime-apt runs take turns at apt's locks instead of failing
+ * on them. A run about to take a lock drops a ticket into a queue
+ * directory, named so tickets sort in arrival order, and waits until
+ * no live ticket is ahead of it and apt's lock files are free. Waiting
+ * sleeps in poll() on inotify (tickets removed, lock files closed) and
+ * on pidfds of whoever it waits for, so the next run starts the moment
+ * the previous one is done.
+ */
+
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <sys/types.h>
+
+// Locks a run needs, as flags
+#define LOCK_PACKAGES 1         // dpkg's frontend and database locks, apt's archive cache
+#define LOCK_LISTS    2         // apt's lists directory
+
+typedef struct {
+    long waited_ms;
+    pid_t holder;               // Run or process last waited for, 0 if none
+    char holder_name[64];
+} LockWait;
+
+// Called each time the wait moves on to another holder
+typedef void (*LockWaitCallback)(const LockWait *wait, void *context);
+
+// Wait for this process's turn at the locks in "kinds", for at most
+// timeout_seconds (0 to not wait at all). The turn lasts until the
+// process exits. Returns 0 once it is ours, -1 on timeout, or -2 when
+// the queue directory is unusable and the locks were not checked.
+int wait_for_lock_turn(int kinds, int timeout_seconds, LockWaitCallback callback, void *context,
+                       LockWait *out_wait);
+
+// Hand the turn to the next run early
+void release_lock_turn(void);
+
+#endif // LOCK_H
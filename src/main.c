@@ -5,370 +5,140 @@
  * with LimeOS branding, filtered output, and cleaner display.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
-#include <sys/ioctl.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <fnmatch.h>
 
 #include "packages.h"
+#include "output.h"
+#include "json.h"
+#include "process.h"
+#include "index.h"
+#include "search.h"
+#include "rank.h"
+#include "suggest.h"
+#include "dpkg.h"
+#include "version.h"
+#include "upgrade.h"
+#include "graph.h"
+#include "autoremove.h"
+#include "fetch.h"
+#include "supervisor.h"
+#include "manifest.h"
+#include "daemon.h"
+#include "lock.h"
+#include "timing.h"
+#include "repostats.h"
+#include "format.h"
 
-// ANSI color codes
-#define RESET       "\033[0m"
-#define BOLD        "\033[1m"
-#define DIM         "\033[2m"
-#define WHITE       "\033[97m"
-#define GRAY        "\033[90m"
-#define GREEN       "\033[92m"
-#define RED         "\033[91m"
-#define YELLOW      "\033[93m"
-#define CYAN        "\033[96m"
-#define CLEAR_LINE  "\033[2K\r"
-
-// Box drawing characters
-#define BOX_TL      "┌"
-#define BOX_TR      "┐"
-#define BOX_BL      "└"
-#define BOX_BR      "┘"
-#define BOX_H       "─"
-#define BOX_V       "│"
-
-// Status icons
-#define CHECK       "✓"
-#define CROSS       "✗"
-#define ARROW       "→"
-#define BULLET      "•"
-#define PKG_ICON    "📦"
-
-static int terminal_width = 80;
-
-static int get_terminal_width(void)
-{
-    struct winsize w;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0) {
-        return w.ws_col > 40 ? w.ws_col : 80;
-    }
-    return 80;
-}
-
-static void print_header(void)
-{
-    int box_width = terminal_width < 50 ? terminal_width - 2 : 48;
-    
-    printf("\n");
-    printf(WHITE BOX_TL);
-    for (int i = 0; i < box_width; i++) printf(BOX_H);
-    printf(BOX_TR RESET "\n");
-    
-    const char *title = " 🍋 LimeOS Package Manager";
-    int padding = box_width - 26;
-    printf(WHITE BOX_V BOLD "%s" RESET WHITE, title);
-    for (int i = 0; i < padding; i++) printf(" ");
-    printf(BOX_V RESET "\n");
-    
-    printf(WHITE BOX_BL);
-    for (int i = 0; i < box_width; i++) printf(BOX_H);
-    printf(BOX_BR RESET "\n\n");
-}
-
-static void print_status(const char *message)
-{
-    printf(CLEAR_LINE DIM "  %s %s..." RESET, BULLET, message);
-    fflush(stdout);
-}
-
-static void print_status_done(const char *message)
-{
-    printf(CLEAR_LINE GREEN "  %s" RESET " %s\n", CHECK, message);
-}
-
-static void print_success(const char *message)
-{
-    printf("\n" GREEN CHECK RESET " %s\n", message);
-}
+// Context for ranking results from the native search
+typedef struct {
+    RankHeap heap;
+    char **terms;
+    int term_count;
+} SearchRankContext;
 
-static void print_error(const char *message)
+static int rank_native_match(const SearchMatch *match, void *context)
 {
-    printf("\n" RED CROSS RESET " %s\n", message);
+    SearchRankContext *rank_context = context;
+    RankTier tier = get_rank_tier(match->name, rank_context->terms, rank_context->term_count);
+    push_rank_heap(&rank_context->heap, tier, match);
+    return 0;
 }
 
-static void print_info(const char *message)
+// Check whether every term occurs in the package's name or display name
+static int external_package_matches(const ExternalPackage *pkg, char *const terms[], int term_count,
+                                    int names_only)
 {
-    printf(DIM "  %s" RESET "\n", message);
+    for (int i = 0; i < term_count; i++) {
+        if (!strcasestr(pkg->name, terms[i]) &&
+            (names_only || !strcasestr(pkg->display_name, terms[i]))) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-// Parse and display search results beautifully
-static void format_search_output(FILE *pipe)
+static const char *get_source_label(PackageSourceType type)
 {
-    char line[2048];
-    char pkg_name[256] = "";
-    char pkg_version[128] = "";
-    char pkg_arch[64] = "";
-    char pkg_desc[1024] = "";
-    int is_installed = 0;
-    int pkg_count = 0;
-    int in_package = 0;
-    
-    // Skip "Sorting..." and "Full Text Search..." lines
-    while (fgets(line, sizeof(line), pipe)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
-        
-        // Skip apt status messages
-        if (strstr(line, "Sorting...") || strstr(line, "Full Text Search...")) {
-            continue;
-        }
-        
-        // Check if this is a package line (contains /)
-        if (strchr(line, '/') && !isspace(line[0])) {
-            // Print previous package if exists
-            if (in_package && strlen(pkg_name) > 0) {
-                printf(BOLD WHITE "  %s" RESET, pkg_name);
-                printf(DIM " %s" RESET, pkg_version);
-                if (is_installed) {
-                    printf(GREEN " [installed]" RESET);
-                }
-                printf("\n");
-                if (strlen(pkg_desc) > 0) {
-                    printf(DIM "    %s" RESET "\n", pkg_desc);
-                }
-                printf("\n");
-                pkg_count++;
-            }
-            
-            // Parse new package: name/repo,repo version arch [status]
-            char *slash = strchr(line, '/');
-            if (slash) {
-                *slash = '\0';
-                strncpy(pkg_name, line, sizeof(pkg_name) - 1);
-                
-                // Find version (after space)
-                char *rest = slash + 1;
-                char *space = strchr(rest, ' ');
-                if (space) {
-                    *space = '\0';
-                    space++;
-                    // Skip to version
-                    while (*space && !isdigit(*space) && *space != '+') space++;
-                    char *ver_end = strchr(space, ' ');
-                    if (ver_end) {
-                        *ver_end = '\0';
-                        strncpy(pkg_version, space, sizeof(pkg_version) - 1);
-                    }
-                }
-                
-                is_installed = (strstr(line, "[installed") != NULL) || 
-                               (slash && strstr(slash, "[installed") != NULL) ||
-                               (strstr(rest, "[installed") != NULL);
-            }
-            
-            pkg_desc[0] = '\0';
-            in_package = 1;
-        }
-        else if (in_package && isspace(line[0])) {
-            // This is a description line
-            char *desc = line;
-            while (*desc && isspace(*desc)) desc++;
-            strncpy(pkg_desc, desc, sizeof(pkg_desc) - 1);
-        }
-    }
-    
-    // Print last package
-    if (in_package && strlen(pkg_name) > 0) {
-        printf(BOLD WHITE "  %s" RESET, pkg_name);
-        printf(DIM " %s" RESET, pkg_version);
-        if (is_installed) {
-            printf(GREEN " [installed]" RESET);
-        }
-        printf("\n");
-        if (strlen(pkg_desc) > 0) {
-            printf(DIM "    %s" RESET "\n", pkg_desc);
-        }
-        printf("\n");
-        pkg_count++;
-    }
-    
-    if (pkg_count > 0) {
-        printf(DIM "  Found %d package(s)" RESET "\n", pkg_count);
-    } else {
-        printf(YELLOW "  No packages found" RESET "\n");
+    switch (type) {
+        case PKG_SOURCE_PPA:     return "PPA";
+        case PKG_SOURCE_DEB_URL: return "direct download";
+        case PKG_SOURCE_REPO:    return "custom repository";
     }
+    return "external";
 }
 
-// Parse and display update output minimally
-static void format_update_output(FILE *pipe)
+// Answer a search from the package index instead of running apt.
+// Returns -1 when the query needs apt (regex terms, unknown options)
+// or no usable index exists.
+static int run_native_search(int argc, char *argv[], int limit)
 {
-    char line[2048];
-    int hit_count = 0;
-    int get_count = 0;
-    int ppa_count = 0;
-    int upgradable = 0;
-    
-    print_status("Connecting to repositories");
+    char **terms = malloc(sizeof(char*) * argc);
+    int term_count = 0;
+    int names_only = 0;
     
-    while (fgets(line, sizeof(line), pipe)) {
-        line[strcspn(line, "\n")] = 0;
-        
-        if (strncmp(line, "Hit:", 4) == 0) {
-            hit_count++;
-            if (strstr(line, "ppa.launchpad")) ppa_count++;
-            print_status("Checking repositories");
-        }
-        else if (strncmp(line, "Get:", 4) == 0) {
-            get_count++;
-            print_status("Fetching package lists");
-        }
-        else if (strstr(line, "Reading package lists")) {
-            print_status("Reading package lists");
-        }
-        else if (strstr(line, "Building dependency tree")) {
-            print_status("Building dependency tree");
-        }
-        else if (strstr(line, "Reading state information")) {
-            print_status("Reading state information");
-        }
-        else if (strstr(line, "packages can be upgraded")) {
-            // Extract number
-            sscanf(line, "%d", &upgradable);
-        }
-        else if (strncmp(line, "Fetched", 7) == 0) {
-            print_status("Download complete");
+    // Only plain substring terms and --names-only are handled natively
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--names-only") == 0 || strcmp(argv[i], "-n") == 0) {
+            names_only = 1;
+        } else if (argv[i][0] == '-' || !is_plain_search_term(argv[i])) {
+            free(terms);
+            return -1;
+        } else {
+            terms[term_count++] = argv[i];
         }
     }
     
-    printf(CLEAR_LINE); // Clear status line
-    
-    // Print summary
-    print_status_done("Repositories synchronized");
-    
-    char summary[256];
-    snprintf(summary, sizeof(summary), "%d repositories checked, %d updated", 
-             hit_count + get_count, get_count);
-    print_info(summary);
-    
-    if (ppa_count > 0) {
-        snprintf(summary, sizeof(summary), "%d PPA(s) included", ppa_count);
-        print_info(summary);
-    }
-    
-    if (upgradable > 0) {
-        printf("\n" YELLOW "  %s %d package(s) can be upgraded" RESET "\n", ARROW, upgradable);
-        printf(DIM "    Run 'lime-apt upgrade' to update them" RESET "\n");
+    PackageIndex index;
+    if (term_count == 0 || load_package_index(&index) != 0) {
+        free(terms);
+        return -1;
     }
-}
-
-// Parse and display install/upgrade/remove output cleanly
-static void format_install_output(FILE *pipe, const char *action_type)
-{
-    char line[2048];
-    int installed = 0;
-    int upgraded = 0;
-    int removed = 0;
-    int configured = 0;
-    int already_newest = 0;
-    char newest_pkg[256] = "";
-    int autoremove_available = 0;
     
-    print_status("Reading package information");
+    // Rank apt matches and known external packages together, keeping
+    // only the best "limit" of them
+    SearchRankContext context;
+    init_rank_heap(&context.heap, limit > 0 ? (size_t)limit : 0);
+    context.terms = terms;
+    context.term_count = term_count;
+    search_package_index(&index, terms, term_count, names_only, rank_native_match, &context);
     
-    while (fgets(line, sizeof(line), pipe)) {
-        line[strcspn(line, "\n")] = 0;
+    char descriptions[KNOWN_PACKAGES_COUNT][256];
+    for (size_t i = 0; i < KNOWN_PACKAGES_COUNT; i++) {
+        const ExternalPackage *pkg = &KNOWN_PACKAGES[i];
+        if (!external_package_matches(pkg, terms, term_count, names_only)) continue;
+        if (find_index_package(&index, pkg->name) >= 0) continue;
         
-        // Handle "already the newest version" message
-        if (strstr(line, "is already the newest version") || 
-            strstr(line, "already the newest version")) {
-            already_newest++;
-            // Extract package name
-            char *space = strchr(line, ' ');
-            if (space) {
-                size_t len = space - line;
-                if (len < sizeof(newest_pkg) - 1) {
-                    strncpy(newest_pkg, line, len);
-                    newest_pkg[len] = '\0';
-                }
-            }
-        }
-        else if (strstr(line, "Selecting previously unselected") || 
-                 strstr(line, "Preparing to unpack")) {
-            print_status("Preparing packages");
-        }
-        else if (strstr(line, "Unpacking")) {
-            installed++;
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Unpacking (%d)", installed);
-            print_status(msg);
-        }
-        else if (strstr(line, "Setting up")) {
-            configured++;
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Configuring (%d)", configured);
-            print_status(msg);
-        }
-        else if (strstr(line, "Removing")) {
-            removed++;
-            char msg[256];
-            snprintf(msg, sizeof(msg), "Removing (%d)", removed);
-            print_status(msg);
-        }
-        else if (strstr(line, "upgraded") && strstr(line, "newly installed")) {
-            // Parse the summary line: "X upgraded, Y newly installed, Z to remove"
-            int up = 0, inst = 0, rem = 0;
-            sscanf(line, "%d upgraded, %d newly installed, %d to remove", &up, &inst, &rem);
-            upgraded = up;
-            installed = inst;
-            removed = rem;
-        }
-        else if (strstr(line, "Processing triggers")) {
-            print_status("Processing triggers");
-        }
-        else if (strstr(line, "packages were automatically installed")) {
-            autoremove_available = 1;
-        }
+        snprintf(descriptions[i], sizeof(descriptions[i]), "%s (%s)",
+                 pkg->display_name, get_source_label(pkg->type));
+        SearchMatch match = { pkg->name, "external", descriptions[i], 0, 1 };
+        rank_native_match(&match, &context);
     }
     
-    printf(CLEAR_LINE);
-    
-    // Print summary based on what happened
-    if (already_newest > 0 && installed == 0 && upgraded == 0) {
-        if (strlen(newest_pkg) > 0) {
-            print_status_done("Already up to date");
-            printf(DIM "  %s is the newest version" RESET "\n", newest_pkg);
-        } else {
-            print_status_done("Already up to date");
-        }
-    } else {
-        // Show what was done
-        if (installed > 0 || configured > 0) {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "%d package(s) installed", configured > 0 ? configured : installed);
-            print_status_done(msg);
-        }
-        if (upgraded > 0) {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "%d package(s) upgraded", upgraded);
-            print_status_done(msg);
-        }
-        if (removed > 0) {
-            char msg[256];
-            snprintf(msg, sizeof(msg), "%d package(s) removed", removed);
-            print_status_done(msg);
-        }
-        if (installed == 0 && upgraded == 0 && removed == 0 && configured == 0 && already_newest == 0) {
-            print_status_done("Nothing to do");
-        }
+    // Print best-first
+    const RankedMatch *ranked = sort_rank_heap(&context.heap);
+    for (size_t i = 0; i < context.heap.count; i++) {
+        print_search_result(&ranked[i].match, get_rank_tier_name(ranked[i].tier));
     }
+    print_search_summary((int)context.heap.count, (int)context.heap.total,
+                         context.heap.total > context.heap.count);
     
-    if (autoremove_available) {
-        printf(DIM "  Run 'lime-apt autoremove' to clean up unused packages" RESET "\n");
-    }
-    
-    (void)action_type; // Suppress unused warning
+    free_rank_heap(&context.heap);
+    close_package_index(&index);
+    free(terms);
+    return 0;
 }
 
-
 static const char *get_action_name(const char *cmd)
 {
     if (strcmp(cmd, "install") == 0) return "Installing";
@@ -420,19 +190,22 @@ static int install_deb_file(const char *deb_path)
     
     // Get package info from deb file
     snprintf(cmd, sizeof(cmd), "dpkg-deb -f '%s' Package 2>/dev/null", deb_path);
+    int span = begin_span("dpkg-deb -f");
     FILE *info_pipe = popen(cmd, "r");
     if (info_pipe) {
+        add_span_process(span);
         if (fgets(pkg_name, sizeof(pkg_name), info_pipe)) {
             pkg_name[strcspn(pkg_name, "\n")] = 0;
         }
         pclose(info_pipe);
     }
+    end_span(span);
     
     // Display what we're installing
     if (strlen(pkg_name) > 0) {
-        printf(GRAY " " ARROW RESET " " BOLD WHITE "Installing" RESET ": %s\n", pkg_name);
+        print_action("Installing", pkg_name);
     } else {
-        printf(GRAY " " ARROW RESET " " BOLD WHITE "Installing" RESET ": %s\n", deb_path);
+        print_action("Installing", deb_path);
     }
     printf(DIM "  From: %s" RESET "\n\n", deb_path);
     
@@ -440,11 +213,16 @@ static int install_deb_file(const char *deb_path)
     print_status("Extracting package");
     
     snprintf(cmd, sizeof(cmd), "dpkg -i '%s' 2>&1", deb_path);
+    span = begin_span("dpkg -i");
+    struct stat deb_stat;
+    if (stat(deb_path, &deb_stat) == 0) add_span_bytes(span, deb_stat.st_size);
     FILE *pipe = popen(cmd, "r");
     if (!pipe) {
+        end_span(span);
         print_error("Failed to execute dpkg");
         return 1;
     }
+    add_span_process(span);
     
     int has_errors = 0;
     while (fgets(line, sizeof(line), pipe)) {
@@ -470,6 +248,7 @@ static int install_deb_file(const char *deb_path)
     
     int status = pclose(pipe);
     int exit_code = WEXITSTATUS(status);
+    end_span(span);
     
     printf(CLEAR_LINE);
     
@@ -478,8 +257,10 @@ static int install_deb_file(const char *deb_path)
         printf(YELLOW "  %s Fixing dependencies..." RESET "\n", ARROW);
         
         snprintf(cmd, sizeof(cmd), "apt-get install -f -y 2>&1");
+        span = begin_span("apt-get install -f");
         FILE *fix_pipe = popen(cmd, "r");
         if (fix_pipe) {
+            add_span_process(span);
             while (fgets(line, sizeof(line), fix_pipe)) {
                 line[strcspn(line, "\n")] = 0;
                 if (strstr(line, "Setting up")) {
@@ -487,6 +268,7 @@ static int install_deb_file(const char *deb_path)
                 }
             }
             int fix_status = pclose(fix_pipe);
+            end_span(span);
             printf(CLEAR_LINE);
             
             if (WEXITSTATUS(fix_status) == 0) {
@@ -494,6 +276,7 @@ static int install_deb_file(const char *deb_path)
                 return 0;
             }
         }
+        end_span(span);
         
         print_error("Installation failed");
         printf(DIM "  Some dependencies could not be resolved" RESET "\n");
@@ -504,63 +287,15 @@ static int install_deb_file(const char *deb_path)
     return 0;
 }
 
-// Download a file using curl/wget
-static int download_file(const char *url, const char *output_path)
+// Write the sources.list.d entry for a custom repository, signed by
+// its keyring in /usr/share/keyrings
+static int write_repo_source(const char *repo_line, const char *name)
 {
-    char cmd[4096];
-    
-    // Try curl first, then wget
-    snprintf(cmd, sizeof(cmd), 
-        "curl -fsSL -o '%s' '%s' 2>/dev/null || wget -q -O '%s' '%s' 2>/dev/null",
-        output_path, url, output_path, url);
-    
-    return system(cmd);
-}
-
-// Add a PPA repository
-static int add_ppa(const char *ppa)
-{
-    char cmd[1024];
-    print_status("Adding PPA repository");
-    
-    snprintf(cmd, sizeof(cmd), "add-apt-repository -y '%s' >/dev/null 2>&1", ppa);
-    int result = system(cmd);
-    
-    if (result == 0) {
-        print_status_done("PPA added");
-        return 0;
-    }
-    return 1;
-}
-
-// Add a custom repository with GPG key
-static int add_custom_repo(const char *key_url, const char *repo_line, const char *name)
-{
-    char cmd[2048];
     char keyring_path[256];
     char list_path[256];
-    
     snprintf(keyring_path, sizeof(keyring_path), "/usr/share/keyrings/%s.gpg", name);
     snprintf(list_path, sizeof(list_path), "/etc/apt/sources.list.d/%s.list", name);
     
-    // Download and add GPG key
-    print_status("Adding repository key");
-    snprintf(cmd, sizeof(cmd), 
-        "curl -fsSL '%s' | gpg --dearmor -o '%s' 2>/dev/null",
-        key_url, keyring_path);
-    
-    if (system(cmd) != 0) {
-        // Try alternative method
-        snprintf(cmd, sizeof(cmd),
-            "wget -qO- '%s' | gpg --dearmor -o '%s' 2>/dev/null",
-            key_url, keyring_path);
-        if (system(cmd) != 0) {
-            return 1;
-        }
-    }
-    
-    // Add repository
-    print_status("Adding repository");
     FILE *f = fopen(list_path, "w");
     if (!f) return 1;
     
@@ -583,30 +318,7 @@ static int add_custom_repo(const char *key_url, const char *repo_line, const cha
         // Add signed-by option
         fprintf(f, "deb [signed-by=%s] %s\n", keyring_path, repo_line + 4);
     }
-    fclose(f);
-    
-    print_status_done("Repository added");
-    return 0;
-}
-
-// Download and install a .deb from URL
-static int install_deb_from_url(const char *url, const char *pkg_name)
-{
-    char tmp_path[256];
-    snprintf(tmp_path, sizeof(tmp_path), "/tmp/%s.deb", pkg_name);
-    
-    printf(GRAY " " ARROW RESET " " BOLD WHITE "Downloading" RESET ": %s\n", pkg_name);
-    print_status("Downloading package");
-    
-    if (download_file(url, tmp_path) != 0) {
-        print_error("Download failed");
-        return 1;
-    }
-    
-    print_status_done("Downloaded");
-    
-    // Install the downloaded .deb
-    return install_deb_file(tmp_path);
+    return fclose(f) == 0 ? 0 : 1;
 }
 
 // Check if a package exists in apt
@@ -614,205 +326,1839 @@ static int package_exists_in_apt(const char *name)
 {
     char cmd[512];
     snprintf(cmd, sizeof(cmd), "apt-cache show '%s' >/dev/null 2>&1", name);
-    return system(cmd) == 0;
+    int span = begin_span("apt-cache show");
+    add_span_process(span);
+    int found = system(cmd) == 0;
+    end_span(span);
+    return found;
 }
 
-// Install an external package from our database
-static int install_external_package(const ExternalPackage *pkg)
+// Report an unknown package, with spelling suggestions when any are close
+static void print_not_found(const char *name)
 {
-    printf(CYAN "  📦 Found in LimeOS package database" RESET "\n");
-    printf(DIM "     %s" RESET "\n\n", pkg->display_name);
+    const char *suggestions[SUGGEST_MAX_RESULTS];
+    int span = begin_span("Suggesting names");
+    PackageIndex index;
+    int have_index = load_package_index(&index) == 0;
+    int suggestion_count = suggest_package_names(have_index ? &index : NULL, name,
+                                                 suggestions, SUGGEST_MAX_RESULTS);
+    end_span(span);
     
-    int result = 0;
-    
-    switch (pkg->type) {
-        case PKG_SOURCE_PPA:
-            result = add_ppa(pkg->source);
-            if (result == 0) {
-                print_status("Updating package lists");
-                system("apt-get update >/dev/null 2>&1");
-                printf(CLEAR_LINE);
-                
-                // Now install via apt
-                char cmd[512];
-                snprintf(cmd, sizeof(cmd), "apt-get install -y '%s'", pkg->name);
-                print_status("Installing package");
-                result = system(cmd);
-                printf(CLEAR_LINE);
-            }
-            break;
-            
-        case PKG_SOURCE_DEB_URL:
-            result = install_deb_from_url(pkg->source, pkg->name);
-            break;
-            
-        case PKG_SOURCE_REPO:
-            result = add_custom_repo(pkg->key_url, pkg->repo_line, pkg->name);
-            if (result == 0) {
-                print_status("Updating package lists");
-                system("apt-get update >/dev/null 2>&1");
-                printf(CLEAR_LINE);
-                
-                // Now install via apt
-                char cmd[512];
-                snprintf(cmd, sizeof(cmd), "apt-get install -y '%s'", pkg->name);
-                print_status("Installing package");
-                result = system(cmd);
-                printf(CLEAR_LINE);
+    if (is_json_output()) {
+        begin_json_record("not_found");
+        add_json_string("name", name);
+        add_json_string_array("suggestions", suggestions, suggestion_count);
+        end_json_record();
+    } else {
+        printf(YELLOW "  %s Package '%s' not found in repositories" RESET "\n", CROSS, name);
+        printf(DIM "    Not in apt or LimeOS package database" RESET "\n");
+        if (suggestion_count > 0) {
+            printf(DIM "    Did you mean: " RESET);
+            for (int i = 0; i < suggestion_count; i++) {
+                printf("%s" BOLD "%s" RESET, i > 0 ? ", " : "", suggestions[i]);
             }
-            break;
+            printf(DIM "?" RESET "\n");
+        }
+        printf("\n");
     }
     
-    return result;
+    if (have_index) close_package_index(&index);
 }
 
-// Thread data for parallel downloads
+// Options that cannot turn an installed package into something to do
+static int is_noop_safe_option(const char *option)
+{
+    const char *safe[] = {"-y", "--yes", "--assume-yes", "-q", "--quiet",
+                          "--no-install-recommends", "--install-recommends", NULL};
+    for (int i = 0; safe[i] != NULL; i++) {
+        if (strcmp(option, safe[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Drop install arguments that dpkg already has at or above the
+// candidate version, before any apt child runs. LimeOS packages count
+// as up to date once dpkg knows them. Returns the number of package
+// arguments left.
+static int skip_installed_packages(int *argc, char *argv[])
+{
+    int package_count = 0;
+    for (int i = 2; i < *argc; i++) {
+        if (argv[i][0] != '-') {
+            package_count++;
+        } else if (!is_noop_safe_option(argv[i])) {
+            return package_count;   // e.g. --reinstall or -t changes the answer
+        }
+    }
+
+    DpkgStatus status;
+    if (open_dpkg_status(&status) != 0) return package_count;
+    PackageIndex index;
+    int have_index = load_package_index(&index) == 0;
+
+    int skipped = 0;
+    int kept = 2;
+    for (int i = 2; i < *argc; i++) {
+        const char *name = argv[i];
+        const DpkgPackage *package = NULL;
+        if (name[0] != '-' && !strpbrk(name, "=/:+") && name[strlen(name) - 1] != '-') {
+            package = find_dpkg_package(&status, name);
+        }
+
+        int up_to_date = 0;
+        if (package && package->installed) {
+            int id = have_index ? find_index_package(&index, name) : -1;
+            if (id >= 0) {
+                const char *candidate = get_index_string(&index, index.packages[id].version);
+                up_to_date = compare_debian_versions_n(package->version.data, package->version.length,
+                                                       candidate, strlen(candidate)) >= 0;
+            } else {
+                up_to_date = find_external_package(name) != NULL;
+            }
+        }
+
+        if (!up_to_date) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+
+        if (skipped++ == 0) print_status_done("Already up to date");
+        if (is_json_output()) {
+            begin_json_record("package");
+            add_json_string("action", "unchanged");
+            add_json_string("name", name);
+            add_json_string_n("version", package->version.data, package->version.length);
+            end_json_record();
+        } else {
+            printf(DIM "  %s is already the newest version (%.*s)" RESET "\n",
+                   name, (int)package->version.length, package->version.data);
+        }
+        package_count--;
+    }
+    *argc = kept;
+    argv[kept] = NULL;
+
+    if (skipped > 0 && package_count == 0 && is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "install");
+        add_json_int("installed", 0);
+        add_json_int("upgraded", 0);
+        add_json_int("removed", 0);
+        add_json_int("unchanged", skipped);
+        add_json_bool("autoremove_available", 0);
+        end_json_record();
+    }
+
+    if (have_index) close_package_index(&index);
+    close_dpkg_status(&status);
+    return package_count;
+}
+
+// Package filters for the native "list" forms
 typedef struct {
-    const char *package_name;
-    int result;
-    int is_external;
-    const ExternalPackage *ext_pkg;
-} DownloadTask;
+    char **patterns;        // Globs on the name; any may match
+    int pattern_count;
+    const char *section;    // Exact section, with or without its area
+} ListFilter;
 
-static void print_usage(void)
+// Check a package against the list filter. "section" need not be
+// NUL-terminated.
+static int matches_list_filter(const ListFilter *filter, const char *name,
+                               const char *section, size_t section_length)
 {
-    print_header();
-    printf(BOLD "Usage:" RESET " lime-apt <command> [options] [packages]\n\n");
-    printf(BOLD "Commands:" RESET "\n");
-    printf("  install      Install packages from repositories\n");
-    printf("  install-deb  Install a local .deb file\n");
-    printf("  remove       Remove packages\n");
-    printf("  update       Update package lists\n");
-    printf("  upgrade      Upgrade installed packages\n");
-    printf("  search       Search for packages\n");
-    printf("  show         Show package details\n");
-    printf("  autoremove   Remove unused dependencies\n");
-    printf("  clean        Clear package cache\n");
-    printf("\n" BOLD "Examples:" RESET "\n");
-    printf("  lime-apt install firefox\n");
-    printf("  lime-apt install-deb ~/Downloads/package.deb\n");
-    printf("  lime-apt search vim\n");
-    printf("\n" DIM "All apt commands are supported." RESET "\n\n");
+    if (filter->section) {
+        // "games" also matches "contrib/games"
+        const char *slash = memchr(section, '/', section_length);
+        const char *short_section = slash ? slash + 1 : section;
+        size_t short_length = section_length - (short_section - section);
+        size_t filter_length = strlen(filter->section);
+        if (!(filter_length == section_length && memcmp(filter->section, section, section_length) == 0) &&
+            !(filter_length == short_length && memcmp(filter->section, short_section, short_length) == 0)) {
+            return 0;
+        }
+    }
+    if (filter->pattern_count == 0) return 1;
+    for (int i = 0; i < filter->pattern_count; i++) {
+        if (fnmatch(filter->patterns[i], name, 0) == 0) return 1;
+    }
+    return 0;
 }
 
-int main(int argc, char *argv[])
+// Running totals for the upgrade preview
+typedef struct {
+    const ListFilter *filter;
+    int count;
+    uint64_t download_size;
+} UpgradeSummary;
+
+static int print_upgradable_package(const UpgradablePackage *package, void *context)
 {
-    terminal_width = get_terminal_width();
-    
-    if (argc < 2) {
-        print_usage();
+    UpgradeSummary *summary = context;
+    if (!matches_list_filter(summary->filter, package->name, package->section, strlen(package->section))) {
         return 0;
     }
-    
-    if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
-        print_usage();
+    summary->count++;
+    summary->download_size += package->size;
+
+    if (is_json_output()) {
+        begin_json_record("package");
+        add_json_string("name", package->name);
+        add_json_string_n("installed_version", package->installed_version.data,
+                          package->installed_version.length);
+        add_json_string("version", package->version);
+        add_json_string("architecture", package->architecture);
+        add_json_string("section", package->section);
+        add_json_int("size", (long)package->size);
+        add_json_int("installed_size", (long)package->installed_size * 1024);
+        end_json_record();
         return 0;
     }
-    
-    // Check root for privileged commands
-    const char *root_cmds[] = {"install", "install-deb", "remove", "purge", "update", "upgrade", 
-                                "full-upgrade", "dist-upgrade", "autoremove", NULL};
-    int needs_root = 0;
-    for (int i = 0; root_cmds[i] != NULL; i++) {
-        if (strcmp(argv[1], root_cmds[i]) == 0) {
-            needs_root = 1;
-            break;
+
+    char size[32];
+    format_size(package->size, size, sizeof(size));
+    printf(BOLD WHITE "  %s" RESET, package->name);
+    printf(DIM " %.*s → " RESET "%s", (int)package->installed_version.length,
+           package->installed_version.data, package->version);
+    printf(DIM "  %s" RESET "\n", size);
+    return 0;
+}
+
+// Stream installed packages straight from the dpkg database
+static void list_installed_packages(const DpkgStatus *status, const ListFilter *filter)
+{
+    int count = 0;
+    char name[256];
+    for (size_t i = 0; i < status->count; i++) {
+        const DpkgPackage *package = &status->packages[i];
+        if (!package->installed) continue;
+        snprintf(name, sizeof(name), "%.*s", (int)package->name.length, package->name.data);
+        if (!matches_list_filter(filter, name, package->section.data, package->section.length)) continue;
+        count++;
+
+        if (is_json_output()) {
+            begin_json_record("package");
+            add_json_string("name", name);
+            add_json_string_n("version", package->version.data, package->version.length);
+            add_json_string_n("architecture", package->architecture.data, package->architecture.length);
+            add_json_string_n("section", package->section.data, package->section.length);
+            end_json_record();
+            continue;
         }
+
+        printf(BOLD WHITE "  %s" RESET DIM " %.*s %.*s" RESET GRAY "  %.*s" RESET "\n", name,
+               (int)package->version.length, package->version.data,
+               (int)package->architecture.length, package->architecture.data,
+               (int)package->section.length, package->section.data);
     }
-    
-    if (needs_root && geteuid() != 0) {
-        print_header();
-        print_error("This command requires root privileges");
-        printf(DIM "  Try: sudo lime-apt %s ..." RESET "\n\n", argv[1]);
-        return 1;
+
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "list");
+        add_json_int("installed", count);
+        end_json_record();
+    } else if (count > 0) {
+        printf("\n" DIM "  %d package(s) installed" RESET "\n", count);
+    } else {
+        printf(YELLOW "  No packages found" RESET "\n");
     }
-    
-    print_header();
-    
-    // Handle install-deb command specially
-    if (strcmp(argv[1], "install-deb") == 0) {
+}
+
+// Preview upgrades by joining the dpkg database with the index
+static int list_upgradable_packages(const DpkgStatus *status, const ListFilter *filter)
+{
+    PackageIndex index;
+    if (load_package_index(&index) != 0) return -1;
+
+    UpgradeSummary summary = {filter, 0, 0};
+    find_upgradable_packages(&index, status, print_upgradable_package, &summary);
+
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "list");
+        add_json_int("upgradable", summary.count);
+        add_json_int("download_size", (long)summary.download_size);
+        end_json_record();
+    } else if (summary.count > 0) {
+        char size[32];
+        format_size(summary.download_size, size, sizeof(size));
+        printf("\n" DIM "  %d package(s) can be upgraded, %s to download" RESET "\n",
+               summary.count, size);
+    } else {
+        print_status_done("All packages are up to date");
+    }
+
+    close_package_index(&index);
+    return 0;
+}
+
+// Answer "list --installed" and "list --upgradable" (with optional name
+// globs and --section) without loading the apt cache. Returns -1 for
+// other list forms, or when the databases cannot be read.
+static int run_native_list(int argc, char *argv[])
+{
+    int installed = 0;
+    int upgradable = 0;
+    ListFilter filter = {NULL, 0, NULL};
+    filter.patterns = malloc(sizeof(char*) * argc);
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--installed") == 0) {
+            installed = 1;
+        } else if (strcmp(argv[i], "--upgradable") == 0 || strcmp(argv[i], "--upgradeable") == 0) {
+            upgradable = 1;
+        } else if (strcmp(argv[i], "--section") == 0 && i + 1 < argc) {
+            filter.section = argv[++i];
+        } else if (strncmp(argv[i], "--section=", 10) == 0) {
+            filter.section = argv[i] + 10;
+        } else if (argv[i][0] != '-') {
+            filter.patterns[filter.pattern_count++] = argv[i];
+        } else {
+            free(filter.patterns);
+            return -1;
+        }
+    }
+
+    int result = -1;
+    DpkgStatus status;
+    if (installed != upgradable && open_dpkg_status(&status) == 0) {
+        if (installed) {
+            list_installed_packages(&status, &filter);
+            result = 0;
+        } else {
+            result = list_upgradable_packages(&status, &filter);
+        }
+        close_dpkg_status(&status);
+    }
+    free(filter.patterns);
+    return result;
+}
+
+// Web address behind a LimeOS package's install source
+static void get_external_package_url(const ExternalPackage *pkg, char *buffer, size_t buffer_size)
+{
+    switch (pkg->type) {
+        case PKG_SOURCE_PPA: {
+            // ppa:owner/name lives at launchpad.net/~owner/+archive/ubuntu/name
+            const char *ppa = strncmp(pkg->source, "ppa:", 4) == 0 ? pkg->source + 4 : pkg->source;
+            const char *slash = strchr(ppa, '/');
+            if (slash) {
+                snprintf(buffer, buffer_size, "https://launchpad.net/~%.*s/+archive/ubuntu/%s",
+                         (int)(slash - ppa), ppa, slash + 1);
+            } else {
+                snprintf(buffer, buffer_size, "%s", pkg->source);
+            }
+            return;
+        }
+        case PKG_SOURCE_DEB_URL:
+            snprintf(buffer, buffer_size, "%s", pkg->source);
+            return;
+        case PKG_SOURCE_REPO: {
+            const char *url = pkg->repo_line ? strstr(pkg->repo_line, "http") : NULL;
+            snprintf(buffer, buffer_size, "%.*s", url ? (int)strcspn(url, " ") : 0, url ? url : "");
+            return;
+        }
+    }
+    buffer[0] = '\0';
+}
+
+// Fields apt show leaves out as well
+static int is_hidden_show_field(const char *key, size_t key_length)
+{
+    const char *hidden[] = {"Filename", "MD5sum", "SHA1", "SHA256", "SHA512", "Description-md5", NULL};
+    for (int i = 0; hidden[i] != NULL; i++) {
+        if (strlen(hidden[i]) == key_length && memcmp(hidden[i], key, key_length) == 0) return 1;
+    }
+    return 0;
+}
+
+// Render a raw list stanza field by field, straight from the index mapping
+static void print_stanza(const char *stanza, size_t length)
+{
+    const char *line = stanza;
+    const char *end = stanza + length;
+    int hidden = 0;
+    int in_description = 0;
+
+    while (line < end) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (!line_end) line_end = end;
+        int line_length = (int)(line_end - line);
+
+        if (line[0] == ' ' || line[0] == '\t') {
+            // Continuation of the previous field; " ." is a paragraph break
+            if (!hidden) {
+                if (line_length == 2 && line[1] == '.') {
+                    printf("\n");
+                } else {
+                    printf("%s    %.*s" RESET "\n", in_description ? "" : DIM, line_length - 1, line + 1);
+                }
+            }
+        } else {
+            const char *colon = memchr(line, ':', line_end - line);
+            size_t key_length = colon ? (size_t)(colon - line) : (size_t)line_length;
+            hidden = is_hidden_show_field(line, key_length);
+            in_description = key_length == 11 && memcmp(line, "Description", 11) == 0;
+            if (!hidden && colon) {
+                const char *value = colon + 1;
+                while (value < line_end && *value == ' ') value++;
+                if (in_description) printf("\n");
+                printf(DIM "  %-16.*s" RESET "%s%.*s" RESET "\n", (int)key_length + 1, line,
+                       in_description ? BOLD : "", (int)(line_end - value), value);
+            }
+        }
+        line = line_end + 1;
+    }
+}
+
+// Answer "show" from the package index and the LimeOS database.
+// Returns -1 when options are given or no usable index exists,
+// otherwise the exit code.
+static int run_native_show(int argc, char *argv[])
+{
+    for (int i = 2; i < argc; i++) {
+        if (argv[i][0] == '-') return -1;
+    }
+    if (argc < 3) return -1;
+
+    PackageIndex index;
+    if (load_package_index(&index) != 0) return -1;
+    DpkgStatus status;
+    int have_status = open_dpkg_status(&status) == 0;
+
+    int exit_code = 0;
+    for (int i = 2; i < argc; i++) {
+        const char *name = argv[i];
+        int id = find_index_package(&index, name);
+        const ExternalPackage *ext_pkg = id < 0 ? find_external_package(name) : NULL;
+        const DpkgPackage *installed = have_status ? find_dpkg_package(&status, name) : NULL;
+        if (installed && !installed->installed) installed = NULL;
+
+        if (id >= 0) {
+            const IndexPackage *package = &index.packages[id];
+            const char *stanza = index.stanzas + package->stanza;
+            if (is_json_output()) {
+                begin_json_record("package");
+                add_json_string("name", name);
+                add_json_string("version", get_index_string(&index, package->version));
+                add_json_bool("installed", installed != NULL);
+                if (installed) {
+                    add_json_string_n("installed_version", installed->version.data, installed->version.length);
+                }
+                add_json_string("source", "apt");
+                add_json_string_n("stanza", stanza, package->stanza_length);
+                end_json_record();
+                continue;
+            }
+
+            printf(BOLD WHITE "  %s" RESET DIM " %s" RESET, name, get_index_string(&index, package->version));
+            if (installed) {
+                printf(GREEN " [installed %.*s]" RESET, (int)installed->version.length, installed->version.data);
+            }
+            printf("\n\n");
+            print_stanza(stanza, package->stanza_length);
+            printf("\n");
+        } else if (ext_pkg) {
+            char url[512];
+            get_external_package_url(ext_pkg, url, sizeof(url));
+            if (is_json_output()) {
+                begin_json_record("package");
+                add_json_string("name", name);
+                add_json_string("display_name", ext_pkg->display_name);
+                add_json_bool("installed", installed != NULL);
+                add_json_string("source", "limeos");
+                add_json_string("source_type", get_source_label(ext_pkg->type));
+                add_json_string("url", url);
+                end_json_record();
+                continue;
+            }
+
+            printf(BOLD WHITE "  %s" RESET CYAN " [LimeOS]" RESET, name);
+            if (installed) printf(GREEN " [installed]" RESET);
+            printf("\n\n");
+            printf(DIM "  %-16s" RESET BOLD "%s" RESET "\n", "Name:", ext_pkg->display_name);
+            printf(DIM "  %-16s" RESET "%s\n", "Source:", get_source_label(ext_pkg->type));
+            printf(DIM "  %-16s" RESET "%s\n", "URL:", url);
+            if (ext_pkg->type == PKG_SOURCE_PPA) {
+                printf(DIM "  %-16s" RESET "%s\n", "PPA:", ext_pkg->source);
+            } else if (ext_pkg->type == PKG_SOURCE_REPO && ext_pkg->key_url) {
+                printf(DIM "  %-16s" RESET "%s\n", "Signing key:", ext_pkg->key_url);
+            }
+            printf("\n");
+        } else {
+            print_not_found(name);
+            exit_code = 1;
+        }
+    }
+
+    if (have_status) close_dpkg_status(&status);
+    close_package_index(&index);
+    return exit_code;
+}
+
+// Run an apt tool with lime-apt's own stdout and stderr, after flushing
+// what lime-apt printed so far. In --json mode that stdout is already
+// stderr, keeping the tool's text out of the records. Returns its exit
+// code, or -1 if it could not be started.
+static int run_apt_tool(const char *label, char *const args[])
+{
+    fflush(stdout);
+    fflush(stderr);
+    int span = begin_span(label);
+    pid_t pid = fork();
+    if (pid < 0) {
+        end_span(span);
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(args[0], args);
+        _exit(127);
+    }
+    add_span_process(span);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    set_span_exit(span, pid, exit_code);
+    end_span(span);
+    return exit_code == 127 ? -1 : exit_code;
+}
+
+// List the packages depending on one, from the index's reverse graph.
+// Returns -1 when no usable index exists, otherwise the exit code.
+static int run_rdepends(int argc, char *argv[])
+{
+    const char *name = NULL;
+    int installed_only = 0;
+    int recurse = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--installed") == 0) installed_only = 1;
+        else if (strcmp(argv[i], "--recurse") == 0) recurse = 1;
+        else if (argv[i][0] != '-' && !name) name = argv[i];
+        else return -1;
+    }
+    if (!name) {
+        print_error("No package specified");
+        printf(DIM "  Usage: lime-apt rdepends [--installed] [--recurse] <package>" RESET "\n\n");
+        return 1;
+    }
+
+    PackageIndex index;
+    if (load_package_index(&index) != 0) return -1;
+    int id = find_index_package(&index, name);
+    if (id < 0) {
+        print_not_found(name);
+        close_package_index(&index);
+        return 1;
+    }
+
+    unsigned char *installed = NULL;
+    DpkgStatus status;
+    if (open_dpkg_status(&status) == 0) {
+        installed = mark_installed_packages(&index, &status);
+        close_dpkg_status(&status);
+    }
+    const unsigned char *only = installed_only ? installed : NULL;
+
+    // Direct dependents carry their relationship; a recursive walk lists
+    // everything that would be affected, nearest first
+    int count = 0;
+    if (recurse) {
+        uint32_t *ids;
+        uint32_t total = collect_reverse_closure(&index, (uint32_t)id, DEPENDENCY_SUGGESTS,
+                                                 installed_only && installed ? installed : NULL, &ids);
+        for (uint32_t i = 0; i < total; i++) {
+            const char *dependent = get_index_string(&index, index.packages[ids[i]].name);
+            int is_installed = installed && installed[ids[i]];
+            count++;
+            if (is_json_output()) {
+                begin_json_record("dependency");
+                add_json_string("name", dependent);
+                add_json_bool("installed", is_installed);
+                end_json_record();
+            } else {
+                printf(BOLD WHITE "  %s" RESET "%s\n", dependent, is_installed ? GREEN " [installed]" RESET : "");
+            }
+        }
+        free(ids);
+    } else {
+        uint32_t edge_count;
+        const IndexEdge *edges = get_reverse_dependencies(&index, (uint32_t)id, &edge_count);
+        for (uint32_t e = 0; e < edge_count; e++) {
+            uint32_t dependent_id = edges[e].package;
+            if (only && !only[dependent_id]) continue;
+            const char *dependent = get_index_string(&index, index.packages[dependent_id].name);
+            int is_installed = installed && installed[dependent_id];
+            count++;
+            if (is_json_output()) {
+                begin_json_record("dependency");
+                add_json_string("name", dependent);
+                add_json_string("kind", get_dependency_kind_name(edges[e].kind));
+                add_json_bool("alternative", (edges[e].flags & INDEX_EDGE_ALTERNATIVE) != 0);
+                add_json_bool("virtual", (edges[e].flags & INDEX_EDGE_VIRTUAL) != 0);
+                add_json_bool("installed", is_installed);
+                end_json_record();
+            } else {
+                printf(BOLD WHITE "  %s" RESET DIM " %s%s%s" RESET "%s\n", dependent,
+                       get_dependency_kind_name(edges[e].kind),
+                       (edges[e].flags & INDEX_EDGE_ALTERNATIVE) ? ", alternative" : "",
+                       (edges[e].flags & INDEX_EDGE_VIRTUAL) ? ", via Provides" : "",
+                       is_installed ? GREEN " [installed]" RESET : "");
+            }
+        }
+    }
+
+    if (is_json_output()) {
+        begin_json_record("summary");
+        add_json_string("command", "rdepends");
+        add_json_string("name", name);
+        add_json_int("count", count);
+        end_json_record();
+    } else if (count > 0) {
+        printf("\n" DIM "  %d package(s) depend on %s" RESET "\n", count, name);
+    } else {
+        printf(YELLOW "  Nothing depends on %s" RESET "\n", name);
+    }
+
+    free(installed);
+    close_package_index(&index);
+    return 0;
+}
+
+// Explain why a package is installed: the shortest chain of installed
+// packages leading to it from a manually installed one (or, without
+// apt's records, from one nothing else needs).
+static int run_why(int argc, char *argv[])
+{
+    if (argc != 3 || argv[2][0] == '-') {
+        print_error("Specify one package");
+        printf(DIM "  Usage: lime-apt why <package>" RESET "\n\n");
+        return 1;
+    }
+    const char *name = argv[2];
+
+    PackageIndex index;
+    if (load_package_index(&index) != 0) {
+        print_error("Package index unavailable; run lime-apt update");
+        return 1;
+    }
+    int id = find_index_package(&index, name);
+    DpkgStatus status;
+    if (id < 0 || open_dpkg_status(&status) != 0) {
+        if (id < 0) print_not_found(name);
+        close_package_index(&index);
+        return 1;
+    }
+    unsigned char *installed = mark_installed_packages(&index, &status);
+    close_dpkg_status(&status);
+
+    uint32_t path[64];
+    uint8_t kinds[64];
+    // Manually installed packages are the roots when apt records them
+    unsigned char *roots = mark_auto_installed_packages(&index);
+    if (roots) {
+        for (uint32_t i = 0; i < index.header->package_count; i++) roots[i] = installed[i] && !roots[i];
+    }
+    int length = find_dependency_path(&index, (uint32_t)id, installed, roots, path, kinds, 64);
+
+    if (is_json_output()) {
+        for (int i = 0; i + 1 < length; i++) {
+            begin_json_record("dependency");
+            add_json_string("from", get_index_string(&index, index.packages[path[i]].name));
+            add_json_string("kind", get_dependency_kind_name(kinds[i]));
+            add_json_string("to", get_index_string(&index, index.packages[path[i + 1]].name));
+            end_json_record();
+        }
+        begin_json_record("summary");
+        add_json_string("command", "why");
+        add_json_string("name", name);
+        add_json_bool("installed", installed[id]);
+        add_json_string("root", length > 0 ? get_index_string(&index, index.packages[path[0]].name) : NULL);
+        add_json_int("length", length > 0 ? length - 1 : 0);
+        end_json_record();
+    } else if (length == 1) {
+        if (roots) {
+            print_status_done("Manually installed");
+        } else {
+            print_status_done("Top-level package");
+            printf(DIM "  Nothing installed depends on %s" RESET "\n", name);
+        }
+    } else if (length > 1) {
+        for (int i = 0; i + 1 < length; i++) {
+            printf("  %*s" BOLD WHITE "%s" RESET DIM " %s " RESET "%s\n", i * 2, "",
+                   get_index_string(&index, index.packages[path[i]].name),
+                   get_dependency_kind_name(kinds[i]),
+                   get_index_string(&index, index.packages[path[i + 1]].name));
+        }
+    } else {
+        printf(YELLOW "  No installed package depends on %s" RESET "\n", name);
+        if (!installed[id]) printf(DIM "  %s is not installed" RESET "\n", name);
+    }
+
+    free(roots);
+    free(installed);
+    close_package_index(&index);
+    return 0;
+}
+
+static void print_removable_package(const RemovablePackage *package, void *context)
+{
+    unsigned long *reclaimed = context;
+    *reclaimed += package->installed_size;
+
+    if (is_json_output()) {
+        begin_json_record("package");
+        add_json_string("action", "remove");
+        add_json_string_n("name", package->name.data, package->name.length);
+        add_json_string_n("version", package->version.data, package->version.length);
+        add_json_int("installed_size", (long)package->installed_size * 1024);
+        end_json_record();
+        return;
+    }
+
+    char size[32];
+    format_size((uint64_t)package->installed_size * 1024, size, sizeof(size));
+    printf(BOLD WHITE "  %.*s" RESET DIM " %.*s  %s" RESET "\n", (int)package->name.length, package->name.data,
+           (int)package->version.length, package->version.data, size);
+}
+
+// Show what autoremove would remove, computed in-process without the
+// dpkg lock. Returns -1 when the databases are unavailable.
+static int run_autoremove_preview(void)
+{
+    DpkgStatus status;
+    if (open_dpkg_status(&status) != 0) return -1;
+
+    unsigned long reclaimed = 0;
+    int count = find_autoremovable_packages(&status, print_removable_package, &reclaimed);
+    if (count >= 0) {
+        char size[32];
+        format_size((uint64_t)reclaimed * 1024, size, sizeof(size));
+        if (is_json_output()) {
+            begin_json_record("summary");
+            add_json_string("command", "autoremove");
+            add_json_int("removable", count);
+            add_json_int("reclaimed", (long)reclaimed * 1024);
+            end_json_record();
+        } else if (count > 0) {
+            printf("\n" DIM "  %d package(s) can be removed, freeing %s" RESET "\n", count, size);
+        } else {
+            print_status_done("Nothing to remove");
+        }
+    }
+
+    close_dpkg_status(&status);
+    return count >= 0 ? 0 : -1;
+}
+
+// Thread data for parallel downloads
+typedef struct {
+    const char *package_name;
+    int result;
+    int is_external;
+    const ExternalPackage *ext_pkg;
+} DownloadTask;
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Print package names starting with a prefix, one per line, for the
+// shell completion scripts: a slice of the index's sorted name table
+// merged with the known external packages, or the installed packages
+// with --installed. A stale index is still good enough for completion.
+static int run_complete(int argc, char *argv[])
+{
+    int installed_only = argc > 2 && strcmp(argv[2], "--installed") == 0;
+    const char *prefix = argc > 2 + installed_only ? argv[2 + installed_only] : "";
+    size_t prefix_length = strlen(prefix);
+
+    if (installed_only) {
+        DpkgStatus status;
+        if (open_dpkg_status(&status) != 0) return 1;
+        const DpkgField *previous = NULL;
+        for (size_t i = 0; i < status.count; i++) {
+            const DpkgPackage *package = &status.packages[i];
+            if (!package->installed || package->name.length < prefix_length ||
+                memcmp(package->name.data, prefix, prefix_length) != 0) {
+                continue;
+            }
+            // Multi-arch packages appear once per architecture
+            if (previous && previous->length == package->name.length &&
+                memcmp(previous->data, package->name.data, package->name.length) == 0) {
+                continue;
+            }
+            printf("%.*s\n", (int)package->name.length, package->name.data);
+            previous = &package->name;
+        }
+        close_dpkg_status(&status);
+        return 0;
+    }
+
+    PackageIndex index;
+    int result = open_package_index(&index);
+    if (result != 0 && result != -3) {
+        close_package_index(&index);
+        if (load_package_index(&index) != 0) {
+            char *apt_argv[] = { "apt-cache", "pkgnames", (char *)prefix, NULL };
+            execvp("apt-cache", apt_argv);
+            return 1;
+        }
+    }
+
+    const char *known[KNOWN_PACKAGES_COUNT];
+    size_t known_count = 0;
+    for (size_t i = 0; i < KNOWN_PACKAGES_COUNT; i++) {
+        if (strncmp(KNOWN_PACKAGES[i].name, prefix, prefix_length) == 0) known[known_count++] = KNOWN_PACKAGES[i].name;
+    }
+    qsort(known, known_count, sizeof(const char*), compare_names);
+
+    uint32_t package_count = index.header->package_count;
+    uint32_t id = find_index_prefix(&index, prefix);
+    size_t k = 0;
+    for (;;) {
+        const char *name = NULL;
+        if (id < package_count) {
+            name = get_index_string(&index, index.packages[id].name);
+            if (strncmp(name, prefix, prefix_length) != 0) name = NULL;
+        }
+        if (!name && k == known_count) break;
+
+        int order = !name ? 1 : k == known_count ? -1 : strcmp(name, known[k]);
+        if (order <= 0) {
+            puts(name);
+            id++;
+            if (order == 0) k++;
+        } else {
+            puts(known[k++]);
+        }
+    }
+
+    close_package_index(&index);
+    return 0;
+}
+
+static void print_usage(void)
+{
+    print_header();
+    printf(BOLD "Usage:" RESET " lime-apt <command> [options] [packages]\n\n");
+    printf(BOLD "Commands:" RESET "\n");
+    printf("  install      Install packages from repositories\n");
+    printf("  install-deb  Install a local .deb file\n");
+    printf("  remove       Remove packages\n");
+    printf("  update       Update package lists\n");
+    printf("  upgrade      Upgrade installed packages\n");
+    printf("  search       Search for packages\n");
+    printf("  show         Show package details\n");
+    printf("  rdepends     List packages depending on a package\n");
+    printf("  why          Explain why a package is installed\n");
+    printf("  autoremove   Remove unused dependencies (--preview to only list them)\n");
+    printf("  clean        Clear package cache\n");
+    printf("  complete     List package names for shell completion\n");
+    printf("  apply        Install everything a manifest lists in one planned run\n");
+    printf("\n" BOLD "Options:" RESET "\n");
+    printf("  --json       Stream NDJSON records instead of decorated output\n");
+    printf("  --limit N    Stop searching after N results\n");
+    printf("  --section S  Only list packages in section S\n");
+    printf("  --connections N  Parallel archive downloads per mirror (0 to let apt download)\n");
+    printf("  --lock-timeout S Wait up to S seconds in line for apt's locks (default 300)\n");
+    printf("  --timings    Print where the run spent its time at exit\n");
+    printf("  --stats      With update, report time and bytes per repository\n");
+    printf("\n" BOLD "Examples:" RESET "\n");
+    printf("  lime-apt install firefox\n");
+    printf("  lime-apt install-deb ~/Downloads/package.deb\n");
+    printf("  lime-apt search vim\n");
+    printf("  lime-apt list --upgradable\n");
+    printf("\n" DIM "All apt commands are supported." RESET "\n\n");
+}
+
+// Maximum number of search results to show (0 for all)
+static int search_limit = 0;
+
+// Parallel archive downloads per mirror (0 leaves downloading to apt)
+static int fetch_connections = 4;
+
+// Seconds to wait in line for apt's locks (0 fails at once, like apt)
+static int lock_timeout = 300;
+
+// Report per-repository timings after update (--stats)
+static int update_stats = 0;
+
+// Print the span tree at exit (--timings)
+static int show_timings = 0;
+
+// Chrome trace-event file written at exit (LIME_APT_TRACE)
+static const char *trace_path = NULL;
+
+// Strip lime-apt's own options from argv so the rest passes through to
+// apt, applying them unless only the remaining arguments are wanted
+static void parse_global_options(int *argc, char *argv[], int apply)
+{
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            if (apply) enable_json_output();
+            continue;
+        }
+        if (strcmp(argv[i], "--limit") == 0 && i + 1 < *argc) {
+            i++;
+            if (apply) search_limit = atoi(argv[i]);
+            continue;
+        }
+        if (strncmp(argv[i], "--limit=", 8) == 0) {
+            if (apply) search_limit = atoi(argv[i] + 8);
+            continue;
+        }
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < *argc) {
+            i++;
+            if (apply) fetch_connections = atoi(argv[i]);
+            continue;
+        }
+        if (strncmp(argv[i], "--connections=", 14) == 0) {
+            if (apply) fetch_connections = atoi(argv[i] + 14);
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            if (apply) update_stats = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--timings") == 0) {
+            if (apply) show_timings = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--lock-timeout") == 0 && i + 1 < *argc) {
+            i++;
+            if (apply) lock_timeout = atoi(argv[i]);
+            continue;
+        }
+        if (strncmp(argv[i], "--lock-timeout=", 15) == 0) {
+            if (apply) lock_timeout = atoi(argv[i] + 15);
+            continue;
+        }
+        argv[out++] = argv[i];
+    }
+    argv[out] = NULL;
+    *argc = out;
+}
+
+// Read-only commands lime-aptd may answer: they neither need root nor
+// change anything
+static int is_daemon_query(int argc, char *argv[])
+{
+    char **args = malloc((argc + 1) * sizeof(char*));
+    memcpy(args, argv, argc * sizeof(char*));
+    args[argc] = NULL;
+    parse_global_options(&argc, args, 0);
+
+    const char *queries[] = {"search", "show", "list", "rdepends", "why", "complete", NULL};
+    int query = 0;
+    for (int i = 0; argc > 1 && queries[i] != NULL; i++) {
+        if (strcmp(args[1], queries[i]) == 0) query = 1;
+    }
+    if (argc == 3 && strcmp(args[1], "autoremove") == 0 && strcmp(args[2], "--preview") == 0) query = 1;
+    free(args);
+    return query;
+}
+
+// Emit the final NDJSON result record and pass the exit code through
+static int finish_command(const char *command, int exit_code)
+{
+    if (show_timings) print_timings();
+    if (trace_path && write_trace(trace_path, command) != 0) {
+        print_error("Cannot write the trace");
+        if (!is_json_output()) printf(DIM "  %s" RESET "\n\n", trace_path);
+    }
+    if (is_json_output()) {
+        begin_json_record("result");
+        add_json_string("command", command);
+        add_json_int("exit_code", exit_code);
+        end_json_record();
+    }
+    return exit_code;
+}
+
+static void print_lock_wait(const LockWait *wait, void *context)
+{
+    (void)context;
+    if (is_json_output()) return;
+    char msg[256];
+    if (wait->holder > 0) {
+        snprintf(msg, sizeof(msg), "Waiting for %s (pid %d) to release the package lock",
+                 wait->holder_name, (int)wait->holder);
+    } else {
+        snprintf(msg, sizeof(msg), "Waiting for another process to release the package lock");
+    }
+    print_status(msg);
+}
+
+// Wait in line for apt's locks behind other lime-apt runs and whatever
+// holds them now, so concurrent runs follow each other instead of
+// failing. Returns 0 once it is this run's turn.
+static int take_lock_turn(int kinds)
+{
+    static int timed_out;
+    if (timed_out) return -1;
+
+    LockWait wait;
+    int span = begin_span("Waiting for apt's locks");
+    int result = wait_for_lock_turn(kinds, lock_timeout, print_lock_wait, NULL, &wait);
+    end_span(span);
+    if (result == -2 || wait.holder == 0) return 0;     // Uncontended, or no queue to wait in
+
+    if (is_json_output()) {
+        begin_json_record("lock_wait");
+        add_json_string("holder", wait.holder_name);
+        add_json_int("pid", wait.holder);
+        add_json_int("waited_ms", wait.waited_ms);
+        add_json_bool("acquired", result == 0);
+        end_json_record();
+    }
+    if (result == 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "Waited %.1fs for the package lock", wait.waited_ms / 1000.0);
+        print_status_done(msg);
+        return 0;
+    }
+
+    timed_out = 1;
+    if (!is_json_output()) printf(CLEAR_LINE);
+    print_error("Timed out waiting for the package lock");
+    printf(DIM "  Held by %s (pid %d) after %.0fs; see --lock-timeout" RESET "\n",
+           wait.holder_name, (int)wait.holder, wait.waited_ms / 1000.0);
+    return -1;
+}
+
+// Commands whose archives are fetched before apt runs
+static int is_fetch_command(const char *cmd)
+{
+    return (strcmp(cmd, "install") == 0 ||
+            strcmp(cmd, "upgrade") == 0 ||
+            strcmp(cmd, "full-upgrade") == 0 ||
+            strcmp(cmd, "dist-upgrade") == 0);
+}
+
+static void print_fetch_progress(const FetchItem *item, int ok, int done, int total, void *context)
+{
+    (void)context;
+    if (is_json_output()) {
+        begin_json_record("download");
+        add_json_string("name", item->file_name);
+        add_json_int("size", (long)item->size);
+        add_json_bool("ok", ok);
+        end_json_record();
+        return;
+    }
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Downloading archives (%d/%d)", done, total);
+    print_status(msg);
+}
+
+// Queue the parallel archive download for the apt operation in argv
+static void queue_prefetch(Supervisor *supervisor, ArchiveFetch *fetch, int argc, char *argv[])
+{
+    char **apt_args = malloc(sizeof(char*) * (argc + 6));
+    int apt_argc = 0;
+    apt_args[apt_argc++] = "apt-get";
+    apt_args[apt_argc++] = "--print-uris";
+    apt_args[apt_argc++] = "-qq";
+    apt_args[apt_argc++] = "-y";
+    // apt's upgrade may install new dependencies; apt-get's does not
+    if (strcmp(argv[1], "upgrade") == 0) apt_args[apt_argc++] = "--with-new-pkgs";
+    for (int i = 1; i < argc; i++) {
+        apt_args[apt_argc++] = argv[i];
+    }
+    apt_args[apt_argc] = NULL;
+
+    queue_archive_fetch(supervisor, fetch, apt_args, fetch_connections, print_fetch_progress, NULL);
+    free(apt_args);
+}
+
+// Summarize a finished prefetch. Returns 1 when every archive is in
+// apt's cache, so apt can install with --no-download.
+static int report_prefetch(const ArchiveFetch *fetch)
+{
+    if (fetch->listing_failed) {
+        if (!is_json_output()) printf(CLEAR_LINE);
+        return 0;
+    }
+    if (fetch->count == 0) return 1;
+
+    int failed = fetch->count - fetch->fetched;
+    if (is_json_output()) {
+        begin_json_record("fetch");
+        add_json_int("archives", fetch->count);
+        add_json_int("fetched", fetch->fetched);
+        add_json_int("failed", failed);
+        add_json_int("bytes", (long)fetch->bytes);
+        add_json_int("connections", fetch_connections);
+        end_json_record();
+    } else {
+        char size[32];
+        char msg[256];
+        format_size(fetch->bytes, size, sizeof(size));
+        snprintf(msg, sizeof(msg), "Downloaded %d archive(s), %s", fetch->fetched, size);
+        print_status_done(msg);
+        if (failed > 0) printf(DIM "  %d archive(s) left for apt to download" RESET "\n", failed);
+    }
+    return failed == 0;
+}
+
+// Download the archives an install or upgrade needs, several per mirror
+// at once, before apt runs. Returns 1 when all of them are in apt's
+// cache, so apt can install with --no-download.
+static int prefetch_archives(int argc, char *argv[])
+{
+    if (fetch_connections <= 0 || !is_fetch_command(argv[1])) return 0;
+
+    Supervisor supervisor;
+    ArchiveFetch fetch;
+    int span = begin_span("Prefetching archives");
+    init_supervisor(&supervisor);
+    queue_prefetch(&supervisor, &fetch, argc, argv);
+    print_status("Resolving archives");
+    run_jobs(&supervisor);
+    end_span(span);
+
+    int offline = report_prefetch(&fetch);
+    free_archive_fetch(&fetch);
+    free_supervisor(&supervisor);
+    return offline;
+}
+
+static const char *get_job_state_name(JobState state)
+{
+    switch (state) {
+        case JOB_WAITING:   return "waiting";
+        case JOB_RUNNING:   return "running";
+        case JOB_SUCCEEDED: return "succeeded";
+        case JOB_FAILED:    return "failed";
+        case JOB_SKIPPED:   return "skipped";
+    }
+    return "unknown";
+}
+
+// The one renderer for supervised steps: a status line while a step
+// runs, and a line for each as it finishes, in completion order
+static void print_job_state(Supervisor *supervisor, int id, void *context)
+{
+    (void)context;
+    const Job *job = &supervisor->jobs[id];
+    if (is_json_output()) {
+        if (job->state == JOB_RUNNING) return;
+        begin_json_record("job");
+        add_json_string("label", job->label);
+        add_json_string("state", get_job_state_name(job->state));
+        add_json_int("started_ms", job->started_ms);
+        add_json_int("duration_ms", job->state == JOB_SKIPPED ? 0 : job->finished_ms - job->started_ms);
+        end_json_record();
+        return;
+    }
+
+    char msg[512];
+    switch (job->state) {
+        case JOB_RUNNING:
+            print_status(job->label);
+            break;
+        case JOB_SUCCEEDED:
+            snprintf(msg, sizeof(msg), "%s " DIM "(%.1fs)" RESET, job->label,
+                     (job->finished_ms - job->started_ms) / 1000.0);
+            print_status_done(msg);
+            break;
+        case JOB_FAILED:
+            printf(CLEAR_LINE RED "  %s" RESET " %s failed\n", CROSS, job->label);
+            break;
+        case JOB_SKIPPED:
+            printf(CLEAR_LINE DIM "  %s skipped" RESET "\n", job->label);
+            break;
+        default:
+            break;
+    }
+}
+
+// Writes a repository's source entry once its key has arrived
+static int write_fetched_repo_source(Supervisor *supervisor, int job, void *context)
+{
+    (void)supervisor;
+    (void)job;
+    const ExternalPackage *pkg = context;
+    return write_repo_source(pkg->repo_line, pkg->name);
+}
+
+// Counts a finished download's size towards its timing span
+static int count_downloaded_bytes(Supervisor *supervisor, int job, void *context)
+{
+    (void)context;
+    struct stat st;
+    const Job *download = &supervisor->jobs[job];
+    if (stat(download->argv[4], &st) == 0) add_span_bytes(download->span, st.st_size);
+    return 0;
+}
+
+// Queue the download of a LimeOS .deb package to /tmp. Returns the job
+// id; the file's path goes to out_path.
+static int queue_deb_download(Supervisor *supervisor, const ExternalPackage *pkg, const JobHooks *hooks,
+                              char *out_path, size_t path_size)
+{
+    char label[512];
+    snprintf(out_path, path_size, "/tmp/%s.deb", pkg->name);
+    char *download[] = {
+        "sh", "-c", "curl -fsSL -o \"$1\" \"$2\" || wget -q -O \"$1\" \"$2\"",
+        "sh", out_path, (char *)pkg->source, NULL
+    };
+    JobHooks download_hooks = *hooks;
+    download_hooks.on_finish = count_downloaded_bytes;
+    snprintf(label, sizeof(label), "Downloading %s", pkg->name);
+    return add_job(supervisor, label, download, -1, &download_hooks);
+}
+
+// Queue adding a LimeOS package's PPA or repository, without refreshing
+// the lists, so one update can follow every new source. Returns the job id.
+static int queue_source_addition(Supervisor *supervisor, const ExternalPackage *pkg, const JobHooks *hooks)
+{
+    char label[512];
+    if (pkg->type == PKG_SOURCE_PPA) {
+        char *add[] = { "add-apt-repository", "-y", "-n", (char *)pkg->source, NULL };
+        snprintf(label, sizeof(label), "Adding %s", pkg->source);
+        return add_job(supervisor, label, add, -1, hooks);
+    }
+
+    char keyring_path[256];
+    snprintf(keyring_path, sizeof(keyring_path), "/usr/share/keyrings/%s.gpg", pkg->name);
+    char *key[] = {
+        "sh", "-c",
+        "curl -fsSL \"$1\" | gpg --dearmor --yes -o \"$2\" || wget -qO- \"$1\" | gpg --dearmor --yes -o \"$2\"",
+        "sh", (char *)pkg->key_url, keyring_path, NULL
+    };
+    JobHooks repo_hooks = { NULL, write_fetched_repo_source, hooks->on_state, (void *)pkg };
+    snprintf(label, sizeof(label), "Adding repository key for %s", pkg->name);
+    return add_job(supervisor, label, key, -1, &repo_hooks);
+}
+
+// Install the requested packages apt does not know from the LimeOS
+// database, and take them out of argv. Downloads, key fetches and new
+// sources all run at once, alongside the archive prefetch for the
+// packages apt does know; only steps taking the dpkg lock wait for each
+// other. Returns the number of external packages and counts the ones
+// apt knows in *out_apt_count; *out_offline is set as by
+// prefetch_archives(), or to -1 when no prefetch ran.
+static int run_smart_install(int *argc, char *argv[], int *out_all_found, int *out_apt_count,
+                             int *out_offline)
+{
+    const ExternalPackage **externals = calloc(*argc, sizeof(ExternalPackage*));
+    int external_count = 0;
+    int apt_count = 0;
+    *out_offline = -1;
+
+    // Keep flags and apt's packages in argv; externals move out
+    int span = begin_span("Resolving packages");
+    int kept = 2;
+    for (int i = 2; i < *argc; i++) {
+        if (argv[i][0] == '-' || package_exists_in_apt(argv[i])) {
+            if (argv[i][0] != '-') apt_count++;
+            argv[kept++] = argv[i];
+            continue;
+        }
+        const ExternalPackage *ext_pkg = find_external_package(argv[i]);
+        if (ext_pkg) {
+            externals[external_count++] = ext_pkg;
+        } else {
+            print_not_found(argv[i]);
+            *out_all_found = 0;
+            argv[kept++] = argv[i];
+        }
+    }
+    end_span(span);
+    *out_apt_count = apt_count;
+    if (external_count == 0) {
+        free(externals);
+        return 0;
+    }
+    argv[kept] = NULL;
+    *argc = kept;
+
+    Supervisor supervisor;
+    init_supervisor(&supervisor);
+    int dpkg_lock = add_job_group(&supervisor, 1);
+    JobHooks hooks = { NULL, NULL, print_job_state, NULL };
+    int *final_jobs = malloc(external_count * sizeof(int));
+    int *source_jobs = malloc(external_count * sizeof(int));
+    const char **repo_names = malloc((external_count + 4) * sizeof(char*));
+    int source_count = 0;
+    char label[512];
+    char tmp_path[256];
+
+    for (int e = 0; e < external_count; e++) {
+        const ExternalPackage *pkg = externals[e];
+        print_action("Installing", pkg->name);
+        printf(CYAN "  📦 Found in LimeOS package database" RESET "\n");
+        printf(DIM "     %s" RESET "\n\n", pkg->display_name);
+
+        if (pkg->type == PKG_SOURCE_DEB_URL) {
+            int downloaded = queue_deb_download(&supervisor, pkg, &hooks, tmp_path, sizeof(tmp_path));
+
+            // dpkg leaves missing dependencies for apt to fix up
+            char *install[] = { "sh", "-c", "dpkg -i \"$1\" || apt-get install -f -y", "sh", tmp_path, NULL };
+            snprintf(label, sizeof(label), "Installing %s", pkg->name);
+            final_jobs[e] = add_job(&supervisor, label, install, dpkg_lock, &hooks);
+            add_job_dependency(&supervisor, final_jobs[e], downloaded);
+            continue;
+        }
+
+        source_jobs[source_count] = queue_source_addition(&supervisor, pkg, &hooks);
+        final_jobs[e] = -1;
+        repo_names[source_count++] = pkg->name;
+    }
+
+    // One refresh and one apt transaction for everything from new sources
+    if (source_count > 0) {
+        char *update[] = { "apt-get", "update", NULL };
+        int updated = add_job(&supervisor, "Updating package lists", update, -1, &hooks);
+        for (int i = 0; i < source_count; i++) add_job_dependency(&supervisor, updated, source_jobs[i]);
+
+        char **install = malloc((source_count + 4) * sizeof(char*));
+        int n = 0;
+        install[n++] = "apt-get";
+        install[n++] = "install";
+        install[n++] = "-y";
+        for (int i = 0; i < source_count; i++) install[n++] = (char *)repo_names[i];
+        install[n] = NULL;
+        int installed = add_job(&supervisor, "Installing from new sources", install, dpkg_lock, &hooks);
+        add_job_dependency(&supervisor, installed, updated);
+        free(install);
+        for (int e = 0; e < external_count; e++) {
+            if (final_jobs[e] < 0) final_jobs[e] = installed;
+        }
+    }
+
+    // apt's own archives download meanwhile
+    ArchiveFetch fetch;
+    int prefetching = apt_count > 0 && fetch_connections > 0;
+    if (prefetching) {
+        queue_prefetch(&supervisor, &fetch, *argc, argv);
+        // The fetch holds the archive cache lock apt-get and dpkg want
+        for (int e = 0; e < external_count; e++) hold_until_fetched(&supervisor, &fetch, final_jobs[e]);
+    }
+
+    int turn = take_lock_turn(LOCK_PACKAGES | (source_count > 0 ? LOCK_LISTS : 0));
+    if (turn == 0) {
+        span = begin_span("Installing external packages");
+        run_jobs(&supervisor);
+        end_span(span);
+    }
+
+    for (int e = 0; e < external_count; e++) {
+        if (supervisor.jobs[final_jobs[e]].state != JOB_SUCCEEDED) *out_all_found = 0;
+    }
+    if (prefetching) {
+        *out_offline = turn == 0 ? report_prefetch(&fetch) : 0;
+        free_archive_fetch(&fetch);
+    }
+    printf("\n");
+
+    free_supervisor(&supervisor);
+    free(final_jobs);
+    free(source_jobs);
+    free(repo_names);
+    free(externals);
+    return external_count;
+}
+
+// Whether a manifest name is already installed at its candidate
+// version, as skip_installed_packages() decides for install
+static int is_manifest_entry_current(const PackageIndex *index, const DpkgStatus *status, const char *name)
+{
+    const DpkgPackage *package = status ? find_dpkg_package(status, name) : NULL;
+    if (!package || !package->installed) return 0;
+    int id = index ? find_index_package(index, name) : -1;
+    if (id < 0) return find_external_package(name) != NULL;
+    const char *candidate = get_index_string(index, index->packages[id].version);
+    return compare_debian_versions_n(package->version.data, package->version.length,
+                                     candidate, strlen(candidate)) >= 0;
+}
+
+// Show the dpkg transaction's progress under its status line
+static void print_transaction_line(Supervisor *supervisor, int job, const char *line, void *context)
+{
+    (void)supervisor;
+    (void)job;
+    (void)context;
+    if (is_json_output()) return;
+    if (strncmp(line, "Unpacking ", 10) == 0 || strncmp(line, "Setting up ", 11) == 0) {
+        char msg[256];
+        snprintf(msg, sizeof(msg), "%.*s", (int)strcspn(line, "("), line);
+        print_status(msg);
+    }
+}
+
+// One line of the plan-vs-actual report
+static void print_plan_row(const char *label, JobState state, long planned_ms, long started_ms, long duration_ms)
+{
+    if (is_json_output()) {
+        begin_json_record("step");
+        add_json_string("label", label);
+        add_json_string("state", get_job_state_name(state));
+        add_json_int("planned_start_ms", planned_ms);
+        add_json_int("started_ms", started_ms);
+        add_json_int("duration_ms", duration_ms);
+        end_json_record();
+        return;
+    }
+    if (state == JOB_SKIPPED) {
+        printf(DIM "    %-36.36s %8s %8s %8s" RESET "\n", label, "-", "-", "skipped");
+        return;
+    }
+    printf("    %-36.36s %7.1fs %7.1fs %7.1fs%s\n", label, planned_ms / 1000.0, started_ms / 1000.0,
+           duration_ms / 1000.0, state == JOB_FAILED ? RED " failed" RESET : "");
+}
+
+// Compare each step's start with the earliest its dependencies allowed,
+// with the archive transfers folded into one step
+static void print_plan_report(Supervisor *supervisor, const ArchiveFetch *fetch)
+{
+    long *planned = malloc((supervisor->count ? supervisor->count : 1) * sizeof(long));
+    long critical_ms = get_earliest_starts(supervisor, planned);
+    long wall_ms = get_supervisor_ms(supervisor);
+    int first_transfer = fetch && fetch->count > 0 ? fetch->first_job : supervisor->count;
+    int transfer_end = fetch ? first_transfer + fetch->count : first_transfer;
+    long serial_ms = 0;
+
+    if (!is_json_output()) {
+        printf("\n" BOLD "  Plan vs actual" RESET "\n");
+        printf(DIM "    %-36s %8s %8s %8s" RESET "\n", "Step", "Planned", "Started", "Took");
+    }
+    for (int id = 0; id < supervisor->count; id++) {
+        const Job *job = &supervisor->jobs[id];
+        if (id > first_transfer && id < transfer_end) continue;
+        if (id < first_transfer || id >= transfer_end) {
+            long took = job->state == JOB_SKIPPED ? 0 : job->finished_ms - job->started_ms;
+            print_plan_row(job->label, job->state, planned[id], job->started_ms, took);
+            serial_ms += took;
+            continue;
+        }
+
+        // Transfers run side by side; report their span
+        long planned_ms = planned[id], started_ms = job->started_ms, finished_ms = job->finished_ms;
+        JobState state = JOB_SUCCEEDED;
+        for (int t = first_transfer; t < transfer_end; t++) {
+            const Job *transfer = &supervisor->jobs[t];
+            if (planned[t] < planned_ms) planned_ms = planned[t];
+            if (transfer->started_ms < started_ms) started_ms = transfer->started_ms;
+            if (transfer->finished_ms > finished_ms) finished_ms = transfer->finished_ms;
+            if (transfer->state != JOB_SUCCEEDED) state = JOB_FAILED;
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "Downloading %d archive(s)", fetch->count);
+        print_plan_row(label, state, planned_ms, started_ms, finished_ms - started_ms);
+        serial_ms += finished_ms - started_ms;
+    }
+
+    if (is_json_output()) {
+        begin_json_record("plan");
+        add_json_int("wall_ms", wall_ms);
+        add_json_int("critical_path_ms", critical_ms);
+        add_json_int("serial_ms", serial_ms);
+        end_json_record();
+    } else {
+        printf(DIM "  Took %.1fs; the plan's critical path is %.1fs, the steps back to back %.1fs" RESET "\n",
+               wall_ms / 1000.0, critical_ms / 1000.0, serial_ms / 1000.0);
+    }
+    free(planned);
+}
+
+// Bring the system to a manifest in one planned operation: resolve every
+// entry against the index and dpkg up front, add new sources at once,
+// refresh the lists once, download while that happens, and install
+// everything in a single dpkg transaction
+static int run_apply(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int dry_run = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--dry-run") == 0 || strcmp(argv[i], "-s") == 0) dry_run = 1;
+        else path = argv[i];
+    }
+    if (!path) {
+        print_error("No manifest specified");
+        printf(DIM "  Usage: lime-apt apply [--dry-run] <manifest>" RESET "\n\n");
+        return 1;
+    }
+    Manifest manifest;
+    if (read_manifest(path, &manifest) != 0) {
+        print_error("Cannot read the manifest");
+        printf(DIM "  %s" RESET "\n\n", path);
+        return 1;
+    }
+
+    DpkgStatus status;
+    PackageIndex index;
+    int span = begin_span("Planning");
+    int have_status = open_dpkg_status(&status) == 0;
+    int have_index = load_package_index(&index) == 0;
+    print_action("Applying", path);
+
+    // Sort every entry into the step that handles it
+    int count = manifest.count;
+    char **apt_names = malloc((count + 4) * sizeof(char*));
+    char **install_args = malloc((count + 8) * sizeof(char*));
+    const ExternalPackage **externals = malloc((count ? count : 1) * sizeof(ExternalPackage*));
+    int apt_count = 0, external_count = 0, deb_count = 0, unchanged = 0, missing = 0;
+    for (int i = 0; i < count; i++) {
+        char *name = manifest.entries[i].name;
+        if (is_deb_file(name)) {
+            if (access(name, R_OK) != 0) {
+                printf(YELLOW "  %s %s not found" RESET "\n", CROSS, name);
+                missing++;
+            }
+            deb_count++;
+            continue;
+        }
+        if (!strpbrk(name, "=/:") &&
+            is_manifest_entry_current(have_index ? &index : NULL, have_status ? &status : NULL, name)) {
+            unchanged++;
+            continue;
+        }
+        const ExternalPackage *ext_pkg = NULL;
+        if (strpbrk(name, "=/:") || !have_index || find_index_package(&index, name) >= 0) {
+            apt_names[apt_count++] = name;
+        } else if ((ext_pkg = find_external_package(name)) != NULL) {
+            externals[external_count++] = ext_pkg;
+        } else {
+            print_not_found(name);
+            missing++;
+        }
+    }
+    if (have_index) close_package_index(&index);
+    if (have_status) close_dpkg_status(&status);
+    end_span(span);
+
+    int result = 0;
+    if (is_json_output()) {
+        begin_json_record("manifest");
+        add_json_string("path", path);
+        add_json_int("unchanged", unchanged);
+        add_json_int("apt", apt_count);
+        add_json_int("external", external_count);
+        add_json_int("local", deb_count);
+        add_json_int("missing", missing);
+        end_json_record();
+    } else {
+        printf(DIM "  %d unchanged, %d from apt, %d from the LimeOS database, %d local .deb" RESET "\n\n",
+               unchanged, apt_count, external_count, deb_count);
+    }
+    if (missing > 0) {
+        print_error("The manifest lists packages that cannot be installed");
+        printf(DIM "  Nothing was changed" RESET "\n");
+        result = 1;
+    } else if (apt_count + external_count + deb_count == 0) {
+        print_success("Nothing to do");
+    } else if (!dry_run && geteuid() != 0) {
+        print_error("This command requires root privileges");
+        printf(DIM "  Try: sudo lime-apt apply %s" RESET "\n", path);
+        result = 1;
+    }
+    if (result != 0 || apt_count + external_count + deb_count == 0) {
+        printf("\n");
+        free(apt_names);
+        free(install_args);
+        free(externals);
+        free_manifest(&manifest);
+        return result;
+    }
+
+    Supervisor supervisor;
+    init_supervisor(&supervisor);
+    JobHooks hooks = { NULL, NULL, print_job_state, NULL };
+    int *source_jobs = malloc((external_count ? external_count : 1) * sizeof(int));
+    int *download_jobs = malloc((external_count ? external_count : 1) * sizeof(int));
+    char (*deb_paths)[256] = malloc((external_count ? external_count : 1) * sizeof(*deb_paths));
+    int source_count = 0, download_count = 0;
+
+    int n = 0;
+    install_args[n++] = "apt-get";
+    install_args[n++] = "install";
+    install_args[n++] = "-y";
+    for (int i = 0; i < apt_count; i++) install_args[n++] = apt_names[i];
+    for (int e = 0; e < external_count; e++) {
+        const ExternalPackage *pkg = externals[e];
+        if (pkg->type == PKG_SOURCE_DEB_URL) {
+            download_jobs[download_count] = queue_deb_download(&supervisor, pkg, &hooks, deb_paths[download_count],
+                                                               sizeof(deb_paths[0]));
+            install_args[n++] = deb_paths[download_count++];
+        } else {
+            source_jobs[source_count++] = queue_source_addition(&supervisor, pkg, &hooks);
+            install_args[n++] = (char *)pkg->name;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (is_deb_file(manifest.entries[i].name)) install_args[n++] = manifest.entries[i].name;
+    }
+    install_args[n] = NULL;
+
+    int updated = -1;
+    if (source_count > 0) {
+        char *update[] = { "apt-get", "update", NULL };
+        updated = add_job(&supervisor, "Updating package lists", update, -1, &hooks);
+        for (int i = 0; i < source_count; i++) add_job_dependency(&supervisor, updated, source_jobs[i]);
+    }
+
+    // Archives for what the current lists know download meanwhile
+    ArchiveFetch fetch;
+    int prefetching = apt_count > 0 && fetch_connections > 0;
+    if (prefetching) {
+        apt_names[apt_count] = NULL;
+        char **fetch_argv = malloc((apt_count + 3) * sizeof(char*));
+        fetch_argv[0] = "lime-apt";
+        fetch_argv[1] = "install";
+        memcpy(fetch_argv + 2, apt_names, (apt_count + 1) * sizeof(char*));
+        queue_prefetch(&supervisor, &fetch, apt_count + 2, fetch_argv);
+        free(fetch_argv);
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "Installing %d package(s)", n - 3);
+    JobHooks transaction_hooks = { print_transaction_line, NULL, print_job_state, NULL };
+    int installed = add_job(&supervisor, label, install_args, -1, &transaction_hooks);
+    if (updated >= 0) add_job_dependency(&supervisor, installed, updated);
+    for (int i = 0; i < download_count; i++) add_job_dependency(&supervisor, installed, download_jobs[i]);
+    if (prefetching) hold_until_fetched(&supervisor, &fetch, installed);
+
+    if (dry_run) {
+        for (int id = 0; id < supervisor.count; id++) {
+            const Job *job = &supervisor.jobs[id];
+            if (is_json_output()) {
+                begin_json_record("step");
+                add_json_string("label", job->label);
+                add_json_int("after", job->after_count + job->follows_count);
+                end_json_record();
+                continue;
+            }
+            printf("  %s %s", ARROW, job->label);
+            for (int d = 0; d < job->after_count + job->follows_count; d++) {
+                int before = d < job->after_count ? job->after[d] : job->follows[d - job->after_count];
+                printf(DIM "%s%s" RESET, d == 0 ? "  after: " : ", ", supervisor.jobs[before].label);
+            }
+            printf("\n");
+        }
+    } else if (take_lock_turn(LOCK_PACKAGES | (updated >= 0 ? LOCK_LISTS : 0)) != 0) {
+        result = 1;
+    } else {
+        span = begin_span("Running the plan");
+        run_jobs(&supervisor);
+        end_span(span);
+        if (prefetching) report_prefetch(&fetch);
+        print_plan_report(&supervisor, prefetching ? &fetch : NULL);
+        printf("\n");
+        result = supervisor.jobs[installed].state == JOB_SUCCEEDED ? 0 : 1;
+
+        // The lists changed under the index
+        if (updated >= 0 && supervisor.jobs[updated].state == JOB_SUCCEEDED) {
+            print_status("Indexing packages");
+            int index_span = begin_span("Indexing packages");
+            int indexed = build_package_index();
+            end_span(index_span);
+            if (indexed == 0) {
+                print_status_done("Package index rebuilt");
+            } else if (!is_json_output()) {
+                printf(CLEAR_LINE);
+            }
+        }
+        if (result == 0) print_success("Manifest applied");
+        else print_error("Operation failed");
+    }
+    printf("\n");
+
+    if (prefetching) free_archive_fetch(&fetch);
+    free_supervisor(&supervisor);
+    free(source_jobs);
+    free(download_jobs);
+    free(deb_paths);
+    free(apt_names);
+    free(install_args);
+    free(externals);
+    free_manifest(&manifest);
+    return result;
+}
+
+// Everything lime-apt does for one command line, standalone or in a
+// lime-aptd worker
+static int run_command(int argc, char *argv[])
+{
+    init_output();
+    parse_global_options(&argc, argv, 1);
+    trace_path = getenv("LIME_APT_TRACE");
+    if (trace_path && !*trace_path) trace_path = NULL;
+    if (show_timings || trace_path) enable_timings();
+    
+    if (argc < 2) {
+        print_usage();
+        return 0;
+    }
+    begin_span(argv[1]);
+    
+    if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+        print_usage();
+        return 0;
+    }
+    
+    // Completion output goes straight to the shell, undecorated
+    if (strcmp(argv[1], "complete") == 0) {
+        return run_complete(argc, argv);
+    }
+    
+    // Check root for privileged commands
+    const char *root_cmds[] = {"install", "install-deb", "remove", "purge", "update", "upgrade", 
+                                "full-upgrade", "dist-upgrade", "autoremove", NULL};
+    int needs_root = 0;
+    for (int i = 0; root_cmds[i] != NULL; i++) {
+        if (strcmp(argv[1], root_cmds[i]) == 0) {
+            needs_root = 1;
+            break;
+        }
+    }
+    
+    // A preview only reads the databases
+    int preview = strcmp(argv[1], "autoremove") == 0 && argc == 3 && strcmp(argv[2], "--preview") == 0;
+    if (preview) needs_root = 0;
+    
+    if (needs_root && geteuid() != 0) {
+        print_header();
+        print_error("This command requires root privileges");
+        printf(DIM "  Try: sudo lime-apt %s ..." RESET "\n\n", argv[1]);
+        return finish_command(argv[1], 1);
+    }
+    
+    print_header();
+    
+    // Handle install-deb command specially
+    if (strcmp(argv[1], "install-deb") == 0) {
         if (argc < 3) {
             print_error("No .deb file specified");
             printf(DIM "  Usage: lime-apt install-deb <file.deb>" RESET "\n\n");
-            return 1;
+            return finish_command(argv[1], 1);
         }
+        if (take_lock_turn(LOCK_PACKAGES) != 0) return finish_command(argv[1], 1);
         
         int result = install_deb_file(argv[2]);
         if (result == 0) {
             print_success("Done");
         }
         printf("\n");
-        return result;
+        return finish_command(argv[1], result);
     }
     
     // Also support: lime-apt install ./package.deb (auto-detect)
     if (strcmp(argv[1], "install") == 0 && argc > 2 && is_deb_file(argv[2])) {
+        if (take_lock_turn(LOCK_PACKAGES) != 0) return finish_command(argv[1], 1);
         int result = install_deb_file(argv[2]);
         if (result == 0) {
             print_success("Done");
         }
         printf("\n");
-        return result;
+        return finish_command(argv[1], result);
+    }
+    
+    // List installed or upgradable packages without running apt
+    if (strcmp(argv[1], "list") == 0 && run_native_list(argc, argv) == 0) {
+        printf("\n");
+        return finish_command(argv[1], 0);
+    }
+    
+    // Print package details from the index without loading the apt cache
+    if (strcmp(argv[1], "show") == 0) {
+        int result = run_native_show(argc, argv);
+        if (result >= 0) return finish_command(argv[1], result);
+    }
+    
+    // Dependency queries over the index's graph
+    if (strcmp(argv[1], "rdepends") == 0) {
+        int result = run_rdepends(argc, argv);
+        if (result >= 0) return finish_command(argv[1], result);
+
+        // Without an index, or for options it does not know, apt-cache answers
+        char **apt_args = malloc(sizeof(char*) * (argc + 1));
+        apt_args[0] = "apt-cache";
+        for (int i = 1; i <= argc; i++) apt_args[i] = argv[i];
+        result = run_apt_tool("apt-cache rdepends", apt_args);
+        free(apt_args);
+        if (result < 0) {
+            print_error("Failed to execute apt-cache");
+            printf("\n");
+            return finish_command(argv[1], 1);
+        }
+        return finish_command(argv[1], result);
+    }
+    if (strcmp(argv[1], "why") == 0) {
+        return finish_command(argv[1], run_why(argc, argv));
+    }
+    
+    // Manifests check for root themselves, after planning, so a dry run
+    // works for anyone
+    if (strcmp(argv[1], "apply") == 0) {
+        return finish_command(argv[1], run_apply(argc, argv));
     }
     
-    // Smart install: check if packages exist in apt, fallback to external database
+    if (preview) {
+        if (run_autoremove_preview() == 0) {
+            printf("\n");
+            return finish_command(argv[1], 0);
+        }
+        print_error("Cannot read the package index or apt's extended states");
+        printf("\n");
+        return finish_command(argv[1], 1);
+    }
+    
+    // Answer "already installed" from the dpkg database without apt
+    int left = -1;
+    if (strcmp(argv[1], "install") == 0 && argc > 2) {
+        int span = begin_span("Checking installed packages");
+        left = skip_installed_packages(&argc, argv);
+        end_span(span);
+    }
+    if (left == 0) {
+        print_success("Nothing to do");
+        printf("\n");
+        return finish_command(argv[1], 0);
+    }
+    
+    // Smart install: packages apt does not know come from the external
+    // database, overlapping with apt's own downloads
+    int offline = -1;
     if (strcmp(argv[1], "install") == 0 && argc > 2) {
         int all_found = 1;
-        int external_count = 0;
-        
-        // First pass: check which packages need external sources
-        for (int i = 2; i < argc; i++) {
-            if (argv[i][0] == '-') continue; // Skip flags
-            
-            if (!package_exists_in_apt(argv[i])) {
-                const ExternalPackage *ext_pkg = find_external_package(argv[i]);
-                if (ext_pkg) {
-                    external_count++;
-                    printf(GRAY " " ARROW RESET " " BOLD WHITE "Installing" RESET ": %s\n", argv[i]);
-                    
-                    int result = install_external_package(ext_pkg);
-                    if (result == 0) {
-                        print_status_done("Installed");
-                    } else {
-                        print_error("Failed to install");
-                        all_found = 0;
-                    }
-                    printf("\n");
-                } else {
-                    printf(YELLOW "  %s Package '%s' not found in repositories" RESET "\n", CROSS, argv[i]);
-                    printf(DIM "    Not in apt or LimeOS package database" RESET "\n\n");
-                    all_found = 0;
-                }
-            }
-        }
+        int apt_count = 0;
+        int external_count = run_smart_install(&argc, argv, &all_found, &apt_count, &offline);
         
         // If we handled all packages externally, we're done
-        if (external_count > 0) {
-            // Build list of remaining packages (those in apt)
-            int has_apt_packages = 0;
-            for (int i = 2; i < argc; i++) {
-                if (argv[i][0] == '-') continue;
-                if (package_exists_in_apt(argv[i])) {
-                    has_apt_packages = 1;
-                    break;
-                }
-            }
-            
-            if (!has_apt_packages) {
-                if (all_found) {
-                    print_success("All packages installed");
-                }
-                printf("\n");
-                return all_found ? 0 : 1;
+        if (external_count > 0 && apt_count == 0) {
+            if (all_found) {
+                print_success("All packages installed");
             }
-            // Continue to install apt packages below
+            printf("\n");
+            return finish_command(argv[1], all_found ? 0 : 1);
         }
     }
     
     const char *action = get_action_name(argv[1]);
     
-    // Build command string
-    char cmd[4096] = "apt ";
+    // Take our turn at apt's locks; apt itself waits out anyone who
+    // slips in between
+    int lock_kinds = strcmp(argv[1], "update") == 0 ? LOCK_LISTS : LOCK_PACKAGES;
+    if (needs_root && take_lock_turn(lock_kinds) != 0) return finish_command(argv[1], 1);
+    
+    // Fill apt's archive cache in parallel, then let apt install offline.
+    // This writes to the cache, so it only starts on our turn.
+    if (offline < 0) offline = prefetch_archives(argc, argv);
+    char lock_option[64];
+    snprintf(lock_option, sizeof(lock_option), "DPkg::Lock::Timeout=%d", lock_timeout);
+    int wait_in_apt = needs_root && lock_timeout > 0;
+    
+    // Build apt argument list
+    char **cmd_args = malloc(sizeof(char*) * (argc + 5));
+    int cmd_argc = 0;
+    cmd_args[cmd_argc++] = "apt";
+    if (offline) cmd_args[cmd_argc++] = "--no-download";
+    if (wait_in_apt) {
+        cmd_args[cmd_argc++] = "-o";
+        cmd_args[cmd_argc++] = lock_option;
+    }
     
     // Add -y flag for commands that might ask for confirmation (when filtering output)
     if (needs_filtering(argv[1]) && 
@@ -820,31 +2166,47 @@ int main(int argc, char *argv[])
          strcmp(argv[1], "upgrade") == 0 ||
          strcmp(argv[1], "remove") == 0 ||
          strcmp(argv[1], "autoremove") == 0)) {
-        strcat(cmd, "-y ");
+        cmd_args[cmd_argc++] = "-y";
     }
     
     for (int i = 1; i < argc; i++) {
-        strcat(cmd, argv[i]);
-        strcat(cmd, " ");
+        cmd_args[cmd_argc++] = argv[i];
     }
-    strcat(cmd, "2>&1");
+    cmd_args[cmd_argc] = NULL;
     
     // For commands that need filtering, capture output
     if (needs_filtering(argv[1])) {
-        if (strcmp(argv[1], "search") == 0) {
+        if (strcmp(argv[1], "search") == 0 && !is_json_output()) {
             printf(GRAY "  Searching packages...\n\n" RESET);
         }
         
-        FILE *pipe = popen(cmd, "r");
+        // Prefer the package index over a full apt search
+        if (strcmp(argv[1], "search") == 0 && run_native_search(argc, argv, search_limit) == 0) {
+            free(cmd_args);
+            print_success("Done");
+            printf("\n");
+            return finish_command(argv[1], 0);
+        }
+        
+        char apt_label[64];
+        snprintf(apt_label, sizeof(apt_label), "apt %s", argv[1]);
+        int span = begin_span(apt_label);
+        pid_t apt_pid;
+        FILE *pipe = open_process_pipe(cmd_args, &apt_pid);
+        free(cmd_args);
         if (!pipe) {
+            end_span(span);
             print_error("Failed to execute apt");
-            return 1;
+            return finish_command(argv[1], 1);
         }
         
+        int stopped_early = 0;
+        int lock_failed = 0;
         if (strcmp(argv[1], "update") == 0) {
-            format_update_output(pipe);
+            format_update_output(pipe, update_stats);
         } else if (strcmp(argv[1], "search") == 0) {
-            format_search_output(pipe);
+            // Stop apt as soon as enough results have been shown
+            stopped_early = format_search_output(pipe, search_limit);
         } else if (strcmp(argv[1], "install") == 0 ||
                    strcmp(argv[1], "upgrade") == 0 ||
                    strcmp(argv[1], "remove") == 0 ||
@@ -859,28 +2221,53 @@ int main(int argc, char *argv[])
                     }
                 }
                 if (strlen(packages) > 0) {
-                    printf(GRAY " " ARROW RESET " " BOLD WHITE "%s" RESET ": %s\n\n", action, packages);
+                    print_action(action, packages);
+                    printf("\n");
                 }
             }
-            format_install_output(pipe, argv[1]);
+            lock_failed = format_install_output(pipe, argv[1]);
         }
         
-        int status = pclose(pipe);
-        int exit_code = WEXITSTATUS(status);
+        int exit_code = close_process_pipe(pipe, apt_pid, stopped_early);
+        set_span_exit(span, apt_pid, exit_code);
+        end_span(span);
+        
+        // Refresh the package index from the new lists
+        if (exit_code == 0 && strcmp(argv[1], "update") == 0) {
+            print_status("Indexing packages");
+            int index_span = begin_span("Indexing packages");
+            int indexed = build_package_index();
+            end_span(index_span);
+            if (indexed == 0) {
+                print_status_done("Package index rebuilt");
+            } else if (!is_json_output()) {
+                printf(CLEAR_LINE);
+            }
+        }
         
         if (exit_code == 0 && action) {
             print_success("Done");
+        } else if (exit_code != 0 && lock_failed) {
+            print_error("Another process holds the package lock");
+            printf(DIM "  Waited %ds; see --lock-timeout" RESET "\n", lock_timeout);
         } else if (exit_code != 0) {
             print_error("Operation failed");
         }
         printf("\n");
-        return exit_code;
+        return finish_command(argv[1], exit_code);
     }
     
+    free(cmd_args);
+    
     // For other commands, run normally with apt colors
-    char **apt_args = malloc(sizeof(char*) * (argc + 3));
+    char **apt_args = malloc(sizeof(char*) * (argc + 6));
     apt_args[0] = "apt";
     int apt_argc = 1;
+    if (offline) apt_args[apt_argc++] = "--no-download";
+    if (wait_in_apt) {
+        apt_args[apt_argc++] = "-o";
+        apt_args[apt_argc++] = lock_option;
+    }
     apt_args[apt_argc++] = "-o";
     apt_args[apt_argc++] = "APT::Color=1";
     for (int i = 1; i < argc; i++) {
@@ -898,18 +2285,25 @@ int main(int argc, char *argv[])
             }
         }
         if (strlen(packages) > 0) {
-            printf(GRAY " " ARROW RESET " " BOLD WHITE "%s" RESET ": %s\n\n", action, packages);
+            print_action(action, packages);
+            printf("\n");
         }
     }
     
+    char apt_label[64];
+    snprintf(apt_label, sizeof(apt_label), "apt %s", argv[1]);
+    int span = begin_span(apt_label);
     pid_t pid = fork();
     if (pid == 0) {
         execvp("apt", apt_args);
         perror("Failed to execute apt");
         exit(1);
     } else if (pid > 0) {
+        add_span_process(span);
         int status;
         waitpid(pid, &status, 0);
+        set_span_exit(span, pid, WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+        end_span(span);
         
         if (WIFEXITED(status)) {
             int exit_code = WEXITSTATUS(status);
@@ -920,10 +2314,26 @@ int main(int argc, char *argv[])
             }
             printf("\n");
             free(apt_args);
-            return exit_code;
+            return finish_command(argv[1], exit_code);
         }
     }
     
     free(apt_args);
-    return 0;
+    return finish_command(argv[1], 0);
+}
+
+int main(int argc, char *argv[])
+{
+    // lime-aptd is this binary under another name
+    const char *program = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    if (strcmp(program, "lime-aptd") == 0) return run_daemon(is_daemon_query, run_command);
+
+    // Queries go to a running daemon, which answers from warm state;
+    // traces are of this process, so traced runs stay here
+    int exit_code;
+    if (is_daemon_query(argc, argv) && !getenv("LIME_APT_TRACE") &&
+        forward_to_daemon(argc, argv, &exit_code) == 0) {
+        return exit_code;
+    }
+    return run_command(argc, argv);
 }
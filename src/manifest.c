@@ -0,0 +1,73 @@
+/**
+ * lime-apt Package Manifest
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "manifest.h"
+
+static int is_deb_path(const char *name)
+{
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".deb") == 0;
+}
+
+static void add_entry(Manifest *manifest, const char *name, int line)
+{
+    for (int i = 0; i < manifest->count; i++) {
+        if (strcmp(manifest->entries[i].name, name) == 0) return;
+    }
+    if (manifest->count == manifest->capacity) {
+        manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 64;
+        manifest->entries = realloc(manifest->entries, manifest->capacity * sizeof(ManifestEntry));
+    }
+    manifest->entries[manifest->count].name = strdup(name);
+    manifest->entries[manifest->count].line = line;
+    manifest->count++;
+}
+
+int read_manifest(const char *path, Manifest *out_manifest)
+{
+    memset(out_manifest, 0, sizeof(*out_manifest));
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!file) return -1;
+
+    // Directory relative .deb paths are resolved against
+    char base[PATH_MAX] = ".";
+    const char *slash = strrchr(path, '/');
+    if (slash && file != stdin) snprintf(base, sizeof(base), "%.*s", (int)(slash - path), path);
+    if (slash == path) strcpy(base, "/");
+
+    char line[4096];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "#")] = '\0';
+
+        char *save;
+        for (char *token = strtok_r(line, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save)) {
+            if (!is_deb_path(token) || token[0] == '/') {
+                add_entry(out_manifest, token, line_number);
+                continue;
+            }
+            // apt only takes a local file for a path with a slash in it
+            char joined[PATH_MAX * 2];
+            char resolved[PATH_MAX];
+            snprintf(joined, sizeof(joined), "%s/%s", base, token);
+            add_entry(out_manifest, realpath(joined, resolved) ? resolved : joined, line_number);
+        }
+    }
+
+    if (file != stdin) fclose(file);
+    return 0;
+}
+
+void free_manifest(Manifest *manifest)
+{
+    for (int i = 0; i < manifest->count; i++) free(manifest->entries[i].name);
+    free(manifest->entries);
+    memset(manifest, 0, sizeof(*manifest));
+}
@@ -0,0 +1,30 @@
+/**
+ * lime-apt Package Manifest
+ *
+ * Reads the declarative package lists "lime-apt apply" installs from:
+ * whitespace-separated package names, apt selectors such as "name=1.2"
+ * or "name/bookworm-backports", and paths to local .deb files, with
+ * "#" starting a comment. Relative .deb paths are taken from the
+ * manifest's own directory, so a manifest can ship next to its debs.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+typedef struct {
+    char *name;                 // Package name, apt selector or .deb path
+    int line;
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *entries;     // In manifest order, without duplicates
+    int count;
+    int capacity;
+} Manifest;
+
+// Read a manifest. Returns 0 on success, -1 if it cannot be read.
+int read_manifest(const char *path, Manifest *out_manifest);
+
+void free_manifest(Manifest *manifest);
+
+#endif // MANIFEST_H
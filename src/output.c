@@ -0,0 +1,169 @@
+/**
+ * lime-apt Output Helpers
+ *
+ * Status line rendering. In --json mode every helper emits a record
+ * instead of decorated text, so callers never need to branch.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "output.h"
+#include "json.h"
+
+int terminal_width = 80;
+
+static int json_output = 0;
+static char last_phase[256] = "";
+
+static int get_terminal_width(void)
+{
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0) {
+        return w.ws_col > 40 ? w.ws_col : 80;
+    }
+    return 80;
+}
+
+void init_output(void)
+{
+    terminal_width = get_terminal_width();
+}
+
+void enable_json_output(void)
+{
+    // Keep the real stdout for records and send everything else
+    // (stray printf, apt children) to stderr
+    fflush(stdout);
+    int json_fd = dup(STDOUT_FILENO);
+    FILE *stream = json_fd >= 0 ? fdopen(json_fd, "w") : NULL;
+    if (!stream) return;
+
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    set_json_stream(stream);
+    get_json_elapsed_ms();
+    json_output = 1;
+}
+
+int is_json_output(void)
+{
+    return json_output;
+}
+
+void print_header(void)
+{
+    if (json_output) return;
+
+    int box_width = terminal_width < 50 ? terminal_width - 2 : 48;
+
+    printf("\n");
+    printf(WHITE BOX_TL);
+    for (int i = 0; i < box_width; i++) printf(BOX_H);
+    printf(BOX_TR RESET "\n");
+
+    const char *title = " 🍋 LimeOS Package Manager";
+    int padding = box_width - 26;
+    printf(WHITE BOX_V BOLD "%s" RESET WHITE, title);
+    for (int i = 0; i < padding; i++) printf(" ");
+    printf(BOX_V RESET "\n");
+
+    printf(WHITE BOX_BL);
+    for (int i = 0; i < box_width; i++) printf(BOX_H);
+    printf(BOX_BR RESET "\n\n");
+}
+
+void print_status(const char *message)
+{
+    if (json_output) {
+        // Only report phase transitions, not every repeated update
+        if (strcmp(last_phase, message) == 0) return;
+        snprintf(last_phase, sizeof(last_phase), "%s", message);
+        begin_json_record("phase");
+        add_json_string("phase", message);
+        end_json_record();
+        return;
+    }
+
+    printf(CLEAR_LINE DIM "  %s %s..." RESET, BULLET, message);
+    fflush(stdout);
+}
+
+void print_status_done(const char *message)
+{
+    if (json_output) {
+        last_phase[0] = '\0';
+        begin_json_record("done");
+        add_json_string("message", message);
+        end_json_record();
+        return;
+    }
+
+    printf(CLEAR_LINE GREEN "  %s" RESET " %s\n", CHECK, message);
+}
+
+void print_success(const char *message)
+{
+    if (json_output) {
+        begin_json_record("success");
+        add_json_string("message", message);
+        end_json_record();
+        return;
+    }
+
+    printf("\n" GREEN CHECK RESET " %s\n", message);
+}
+
+void print_error(const char *message)
+{
+    if (json_output) {
+        begin_json_record("error");
+        add_json_string("message", message);
+        end_json_record();
+        return;
+    }
+
+    printf("\n" RED CROSS RESET " %s\n", message);
+}
+
+void print_info(const char *message)
+{
+    if (json_output) {
+        begin_json_record("info");
+        add_json_string("message", message);
+        end_json_record();
+        return;
+    }
+
+    printf(DIM "  %s" RESET "\n", message);
+}
+
+void print_action(const char *action, const char *subject)
+{
+    if (json_output) {
+        begin_json_record("action");
+        add_json_string("action", action);
+        add_json_string("target", subject);
+        end_json_record();
+        return;
+    }
+
+    printf(GRAY " " ARROW RESET " " BOLD WHITE "%s" RESET ": %s\n", action, subject);
+}
+
+void format_size(uint64_t bytes, char *buffer, size_t buffer_size)
+{
+    const char *units[] = {"B", "kB", "MB", "GB", "TB"};
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1000.0 && unit < 4) {
+        value /= 1000.0;
+        unit++;
+    }
+    if (unit == 0) {
+        snprintf(buffer, buffer_size, "%llu B", (unsigned long long)bytes);
+    } else {
+        snprintf(buffer, buffer_size, "%.1f %s", value, units[unit]);
+    }
+}
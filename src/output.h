@@ -0,0 +1,66 @@
+/**
+ * lime-apt Output Helpers
+ *
+ * Colors, icons and status line helpers shared by every command,
+ * plus the switch between decorated terminal output and NDJSON.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ANSI color codes
+#define RESET       "\033[0m"
+#define BOLD        "\033[1m"
+#define DIM         "\033[2m"
+#define WHITE       "\033[97m"
+#define GRAY        "\033[90m"
+#define GREEN       "\033[92m"
+#define RED         "\033[91m"
+#define YELLOW      "\033[93m"
+#define CYAN        "\033[96m"
+#define CLEAR_LINE  "\033[2K\r"
+
+// Box drawing characters
+#define BOX_TL      "┌"
+#define BOX_TR      "┐"
+#define BOX_BL      "└"
+#define BOX_BR      "┘"
+#define BOX_H       "─"
+#define BOX_V       "│"
+
+// Status icons
+#define CHECK       "✓"
+#define CROSS       "✗"
+#define ARROW       "→"
+#define BULLET      "•"
+#define PKG_ICON    "📦"
+
+// Width of the attached terminal, refreshed by init_output()
+extern int terminal_width;
+
+// Detect the terminal width
+void init_output(void);
+
+// Switch to NDJSON records on stdout (decorated output goes to stderr)
+void enable_json_output(void);
+
+// Whether --json mode is active
+int is_json_output(void);
+
+void print_header(void);
+void print_status(const char *message);
+void print_status_done(const char *message);
+void print_success(const char *message);
+void print_error(const char *message);
+void print_info(const char *message);
+
+// Print the " → Action: subject" line that introduces an operation
+void print_action(const char *action, const char *subject);
+
+// Human-readable byte count, e.g. "12.3 MB"
+void format_size(uint64_t bytes, char *buffer, size_t buffer_size);
+
+#endif // OUTPUT_H
@@ -627,7 +627,7 @@ static const ExternalPackage KNOWN_PACKAGES[] = {
 #define KNOWN_PACKAGES_COUNT (sizeof(KNOWN_PACKAGES) / sizeof(KNOWN_PACKAGES[0]))
 
 // Find a package in the known packages database
-static const ExternalPackage* find_external_package(const char *name)
+static inline const ExternalPackage* find_external_package(const char *name)
 {
     for (size_t i = 0; i < KNOWN_PACKAGES_COUNT; i++) {
         if (strcmp(KNOWN_PACKAGES[i].name, name) == 0) {
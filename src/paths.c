@@ -0,0 +1,53 @@
+/**
+ * lime-apt System Paths
+ */
+
+#include <stdlib.h>
+
+#include "paths.h"
+
+static const char *get_path(const char *variable, const char *fallback)
+{
+    const char *value = getenv(variable);
+    return (value && *value) ? value : fallback;
+}
+
+const char *get_lists_dir(void)
+{
+    return get_path("LIME_APT_LISTS_DIR", "/var/lib/apt/lists");
+}
+
+const char *get_cache_dir(void)
+{
+    return get_path("LIME_APT_CACHE_DIR", "/var/cache/lime-apt");
+}
+
+const char *get_dpkg_status_path(void)
+{
+    return get_path("LIME_APT_DPKG_STATUS", "/var/lib/dpkg/status");
+}
+
+const char *get_extended_states_path(void)
+{
+    return get_path("LIME_APT_EXTENDED_STATES", "/var/lib/apt/extended_states");
+}
+
+const char *get_apt_config_dir(void)
+{
+    return get_path("LIME_APT_CONFIG_DIR", "/etc/apt");
+}
+
+const char *get_archives_dir(void)
+{
+    return get_path("LIME_APT_ARCHIVES_DIR", "/var/cache/apt/archives");
+}
+
+const char *get_queue_dir(void)
+{
+    return get_path("LIME_APT_QUEUE_DIR", "/run/lime-apt/queue");
+}
+
+const char *get_socket_path(void)
+{
+    return get_path("LIME_APT_SOCKET", "/run/lime-aptd.sock");
+}
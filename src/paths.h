@@ -0,0 +1,36 @@
+/**
+ * lime-apt System Paths
+ *
+ * Locations of the apt and dpkg databases lime-apt reads natively.
+ * Each can be overridden from the environment, which lets the index
+ * be built and queried against a copy of another machine's state.
+ */
+
+#ifndef PATHS_H
+#define PATHS_H
+
+// Directory holding the downloaded apt lists (LIME_APT_LISTS_DIR)
+const char *get_lists_dir(void);
+
+// Directory for lime-apt's own derived data (LIME_APT_CACHE_DIR)
+const char *get_cache_dir(void);
+
+// dpkg status database (LIME_APT_DPKG_STATUS)
+const char *get_dpkg_status_path(void);
+
+// apt's record of automatically installed packages (LIME_APT_EXTENDED_STATES)
+const char *get_extended_states_path(void);
+
+// apt's configuration, apt.conf and apt.conf.d (LIME_APT_CONFIG_DIR)
+const char *get_apt_config_dir(void);
+
+// apt's downloaded archive cache (LIME_APT_ARCHIVES_DIR)
+const char *get_archives_dir(void);
+
+// Directory of tickets ordering concurrent runs at apt's locks (LIME_APT_QUEUE_DIR)
+const char *get_queue_dir(void);
+
+// Unix socket lime-aptd answers queries on (LIME_APT_SOCKET)
+const char *get_socket_path(void);
+
+#endif // PATHS_H
@@ -0,0 +1,68 @@
+/**
+ * lime-apt Child Processes
+ *
+ * fork/exec with a pipe on stdout and stderr, mirroring what popen()
+ * with "2>&1" did, but without a shell and with access to the pid.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "process.h"
+#include "timing.h"
+
+FILE *open_process_pipe(char *const argv[], pid_t *out_pid)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        // Child: send both output streams into the pipe
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    add_span_process(-1);
+    FILE *stream = fdopen(fds[0], "r");
+    if (!stream) {
+        close(fds[0]);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return NULL;
+    }
+
+    *out_pid = pid;
+    return stream;
+}
+
+int close_process_pipe(FILE *pipe, pid_t pid, int terminate)
+{
+    // Closing our end first makes a child blocked on write fail with
+    // SIGPIPE even if it ignores SIGTERM
+    if (terminate) kill(pid, SIGTERM);
+    fclose(pipe);
+
+    // Reap the child, retrying if interrupted by a signal
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+    if (terminate) return 0;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    return 1;
+}
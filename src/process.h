@@ -0,0 +1,21 @@
+/**
+ * lime-apt Child Processes
+ *
+ * A popen() replacement that keeps the child's pid, so a reader that
+ * has seen enough output can stop the child instead of draining it.
+ */
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// Run argv[0] with stdout and stderr connected to the returned stream
+FILE *open_process_pipe(char *const argv[], pid_t *out_pid);
+
+// Close the stream and reap the child, optionally terminating it first.
+// Returns the child's exit code, or 0 if it was terminated on request.
+int close_process_pipe(FILE *pipe, pid_t pid, int terminate);
+
+#endif // PROCESS_H
@@ -0,0 +1,132 @@
+/**
+ * lime-apt Search Ranking
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "rank.h"
+
+void init_rank_heap(RankHeap *heap, size_t limit)
+{
+    memset(heap, 0, sizeof(*heap));
+    heap->limit = limit;
+}
+
+void free_rank_heap(RankHeap *heap)
+{
+    free(heap->entries);
+    memset(heap, 0, sizeof(*heap));
+}
+
+// Case-insensitive substring check for short package names
+static const char *find_in_name(const char *name, const char *term)
+{
+    size_t term_len = strlen(term);
+    for (const char *p = name; *p; p++) {
+        if (strncasecmp(p, term, term_len) == 0) return p;
+    }
+    return NULL;
+}
+
+RankTier get_rank_tier(const char *name, char *const terms[], int term_count)
+{
+    // A multi-term query ranks by its weakest term
+    RankTier worst = RANK_EXACT_NAME;
+    for (int i = 0; i < term_count; i++) {
+        RankTier tier;
+        const char *found = find_in_name(name, terms[i]);
+        if (!found) tier = RANK_DESCRIPTION;
+        else if (found == name && name[strlen(terms[i])] == '\0') tier = RANK_EXACT_NAME;
+        else if (found == name) tier = RANK_NAME_PREFIX;
+        else tier = RANK_NAME_SUBSTRING;
+        if (tier > worst) worst = tier;
+    }
+    return worst;
+}
+
+// Order by tier, then name length, then name
+static int compare_ranked(const RankedMatch *left, const RankedMatch *right)
+{
+    if (left->tier != right->tier) return left->tier < right->tier ? -1 : 1;
+    if (left->name_length != right->name_length) return left->name_length < right->name_length ? -1 : 1;
+    return strcmp(left->match.name, right->match.name);
+}
+
+static void swap_ranked(RankedMatch *a, RankedMatch *b)
+{
+    RankedMatch tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// Restore the max-heap (worst match at the root) below position i
+static void sift_down(RankedMatch *entries, size_t count, size_t i)
+{
+    for (;;) {
+        size_t largest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < count && compare_ranked(&entries[left], &entries[largest]) > 0) largest = left;
+        if (right < count && compare_ranked(&entries[right], &entries[largest]) > 0) largest = right;
+        if (largest == i) return;
+        swap_ranked(&entries[i], &entries[largest]);
+        i = largest;
+    }
+}
+
+static void sift_up(RankedMatch *entries, size_t i)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (compare_ranked(&entries[i], &entries[parent]) <= 0) return;
+        swap_ranked(&entries[i], &entries[parent]);
+        i = parent;
+    }
+}
+
+void push_rank_heap(RankHeap *heap, RankTier tier, const SearchMatch *match)
+{
+    RankedMatch candidate = { tier, strlen(match->name), *match };
+    heap->total++;
+
+    // When full, the newcomer only gets in by beating the current worst
+    if (heap->limit && heap->count == heap->limit) {
+        if (compare_ranked(&candidate, &heap->entries[0]) >= 0) return;
+        heap->entries[0] = candidate;
+        sift_down(heap->entries, heap->count, 0);
+        return;
+    }
+
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 64;
+        if (heap->limit && capacity > heap->limit) capacity = heap->limit;
+        heap->entries = realloc(heap->entries, capacity * sizeof(RankedMatch));
+        heap->capacity = capacity;
+    }
+    heap->entries[heap->count] = candidate;
+    sift_up(heap->entries, heap->count);
+    heap->count++;
+}
+
+const RankedMatch *sort_rank_heap(RankHeap *heap)
+{
+    // Heapsort: repeatedly move the worst remaining match to the end
+    for (size_t end = heap->count; end > 1; end--) {
+        swap_ranked(&heap->entries[0], &heap->entries[end - 1]);
+        sift_down(heap->entries, end - 1, 0);
+    }
+    return heap->entries;
+}
+
+const char *get_rank_tier_name(RankTier tier)
+{
+    switch (tier) {
+        case RANK_EXACT_NAME:     return "exact";
+        case RANK_NAME_PREFIX:    return "prefix";
+        case RANK_NAME_SUBSTRING: return "name";
+        case RANK_DESCRIPTION:    return "description";
+    }
+    return "description";
+}
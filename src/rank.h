@@ -0,0 +1,56 @@
+/**
+ * lime-apt Search Ranking
+ *
+ * Orders search matches by relevance: exact name, then name prefix,
+ * then name substring, then description-only matches; shorter names
+ * first within a tier. A bounded max-heap keeps only the best K
+ * matches, so asking for the top 20 never holds the whole result set.
+ */
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <stddef.h>
+
+#include "search.h"
+
+// Relevance tiers, best first
+typedef enum {
+    RANK_EXACT_NAME,
+    RANK_NAME_PREFIX,
+    RANK_NAME_SUBSTRING,
+    RANK_DESCRIPTION,
+} RankTier;
+
+// A match with its sort key
+typedef struct {
+    RankTier tier;
+    size_t name_length;
+    SearchMatch match;
+} RankedMatch;
+
+// Bounded heap of the best matches seen so far
+typedef struct {
+    RankedMatch *entries;
+    size_t count;
+    size_t capacity;
+    size_t limit;       // 0 keeps every match
+    size_t total;       // Matches offered, including evicted ones
+} RankHeap;
+
+void init_rank_heap(RankHeap *heap, size_t limit);
+void free_rank_heap(RankHeap *heap);
+
+// Classify a match by where the terms occur in its name
+RankTier get_rank_tier(const char *name, char *const terms[], int term_count);
+
+// Offer a match; kept only if it ranks within the limit
+void push_rank_heap(RankHeap *heap, RankTier tier, const SearchMatch *match);
+
+// Sort the kept matches best-first in place and return them
+const RankedMatch *sort_rank_heap(RankHeap *heap);
+
+// Display name of a tier for --json output
+const char *get_rank_tier_name(RankTier tier);
+
+#endif // RANK_H
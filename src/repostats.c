@@ -0,0 +1,305 @@
+/**
+ * lime-apt Update Statistics
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "repostats.h"
+#include "output.h"
+#include "json.h"
+#include "packages.h"
+
+#define SLOWEST_SHOWN 5
+
+static long get_monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void init_update_stats(UpdateStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->last_failed = -1;
+    stats->started_ms = get_monotonic_ms();
+}
+
+void free_update_stats(UpdateStats *stats)
+{
+    for (int i = 0; i < stats->count; i++) {
+        free(stats->repos[i].url);
+        free(stats->repos[i].suite);
+        free(stats->repos[i].error);
+    }
+    for (int i = 0; i < stats->host_count; i++) free(stats->hosts[i].host);
+    free(stats->repos);
+    free(stats->hosts);
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Compare URLs ignoring trailing slashes, which apt drops when printing
+static int is_same_url(const char *a, const char *b)
+{
+    size_t a_length = strlen(a);
+    size_t b_length = strlen(b);
+    while (a_length > 0 && a[a_length - 1] == '/') a_length--;
+    while (b_length > 0 && b[b_length - 1] == '/') b_length--;
+    return a_length == b_length && strncmp(a, b, a_length) == 0;
+}
+
+// The LimeOS package whose PPA or repository a source URL belongs to
+static const ExternalPackage *find_known_source(const char *url)
+{
+    for (size_t i = 0; i < KNOWN_PACKAGES_COUNT; i++) {
+        const ExternalPackage *pkg = &KNOWN_PACKAGES[i];
+        if (pkg->type == PKG_SOURCE_PPA && strncmp(pkg->source, "ppa:", 4) == 0) {
+            char path[256];
+            snprintf(path, sizeof(path), "/%s/ubuntu", pkg->source + 4);
+            if (strstr(url, "launchpad") && strstr(url, path)) return pkg;
+        } else if (pkg->type == PKG_SOURCE_REPO && pkg->repo_line) {
+            // "deb [options] URL suite components"
+            const char *field = pkg->repo_line + strcspn(pkg->repo_line, " ");
+            field += strspn(field, " ");
+            if (*field == '[') {
+                field = strchr(field, ']');
+                if (!field) continue;
+                field += 1 + strspn(field + 1, " ");
+            }
+            char repo_url[512];
+            snprintf(repo_url, sizeof(repo_url), "%.*s", (int)strcspn(field, " "), field);
+            if (is_same_url(url, repo_url)) return pkg;
+        }
+    }
+    return NULL;
+}
+
+static int find_repo(UpdateStats *stats, const char *url, size_t url_length,
+                     const char *suite, size_t suite_length)
+{
+    for (int i = 0; i < stats->count; i++) {
+        const RepoStats *repo = &stats->repos[i];
+        if (strlen(repo->url) == url_length && strncmp(repo->url, url, url_length) == 0 &&
+            strlen(repo->suite) == suite_length && strncmp(repo->suite, suite, suite_length) == 0) {
+            return i;
+        }
+    }
+
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 16;
+        stats->repos = realloc(stats->repos, stats->capacity * sizeof(RepoStats));
+    }
+    RepoStats *repo = &stats->repos[stats->count];
+    memset(repo, 0, sizeof(*repo));
+    repo->url = strndup(url, url_length);
+    repo->suite = strndup(suite, suite_length);
+    repo->first_ms = -1;
+    const ExternalPackage *known = find_known_source(repo->url);
+    repo->known = known ? known->name : NULL;
+    return stats->count++;
+}
+
+static HostQueue *find_host(UpdateStats *stats, const char *url)
+{
+    // scheme://host, up to the path
+    const char *authority = strstr(url, "://");
+    authority = authority ? authority + 3 : url;
+    size_t length = authority - url + strcspn(authority, "/");
+
+    for (int i = 0; i < stats->host_count; i++) {
+        if (strlen(stats->hosts[i].host) == length && strncmp(stats->hosts[i].host, url, length) == 0) {
+            return &stats->hosts[i];
+        }
+    }
+    if (stats->host_count == stats->host_capacity) {
+        stats->host_capacity = stats->host_capacity ? stats->host_capacity * 2 : 8;
+        stats->hosts = realloc(stats->hosts, stats->host_capacity * sizeof(HostQueue));
+    }
+    HostQueue *host = &stats->hosts[stats->host_count++];
+    host->host = strndup(url, length);
+    host->repo = -1;
+    host->started_ms = 0;
+    return host;
+}
+
+// The download arriving from a host is complete
+static void close_transfer(UpdateStats *stats, HostQueue *host, long now_ms)
+{
+    if (host->repo < 0) return;
+    RepoStats *repo = &stats->repos[host->repo];
+    repo->transfer_ms += now_ms - host->started_ms;
+    if (now_ms > repo->done_ms) repo->done_ms = now_ms;
+    host->repo = -1;
+}
+
+// Parse apt's "[8,786 kB]" size suffix
+static uint64_t parse_fetch_size(const char *line)
+{
+    const char *open = strrchr(line, '[');
+    if (!open || !isdigit((unsigned char)open[1])) return 0;
+
+    double value = 0;
+    double fraction = 0;
+    const char *cursor = open + 1;
+    for (; isdigit((unsigned char)*cursor) || *cursor == ',' || *cursor == '.'; cursor++) {
+        if (*cursor == ',') continue;
+        if (*cursor == '.') {
+            fraction = 1;
+        } else if (fraction > 0) {
+            fraction /= 10;
+            value += (*cursor - '0') * fraction;
+        } else {
+            value = value * 10 + (*cursor - '0');
+        }
+    }
+    while (*cursor == ' ') cursor++;
+    switch (*cursor) {
+        case 'k': value *= 1e3; break;
+        case 'M': value *= 1e6; break;
+        case 'G': value *= 1e9; break;
+        case 'B': break;
+        default: return 0;
+    }
+    // Converting a double past the range is undefined
+    return value < 1.8e19 ? (uint64_t)value : UINT64_MAX;
+}
+
+void add_update_line(UpdateStats *stats, const char *line)
+{
+    long now_ms = get_monotonic_ms() - stats->started_ms;
+
+    // "  404  Not Found [IP: ...]" explains the failure above it
+    if (line[0] == ' ') {
+        if (stats->last_failed < 0) return;
+        RepoStats *repo = &stats->repos[stats->last_failed];
+        if (!repo->error) {
+            const char *reason = line + strspn(line, " ");
+            const char *ip = strstr(reason, " [IP:");
+            size_t length = ip ? (size_t)(ip - reason) : strlen(reason);
+            repo->error = strndup(reason, length);
+        }
+        stats->last_failed = -1;
+        return;
+    }
+    stats->last_failed = -1;
+    if (strncmp(line, "Fetched ", 8) == 0) {
+        finish_update_stats(stats);
+        return;
+    }
+
+    int get = strncmp(line, "Get:", 4) == 0;
+    int failed = strncmp(line, "Err:", 4) == 0;
+    if (!get && !failed && strncmp(line, "Hit:", 4) != 0 && strncmp(line, "Ign:", 4) != 0) return;
+
+    // "Get:5 URL suite[/component] ..."
+    const char *url = strchr(line, ' ');
+    if (!url) return;
+    url++;
+    size_t url_length = strcspn(url, " ");
+    const char *suite = url + url_length + strspn(url + url_length, " ");
+    size_t suite_length = strcspn(suite, " /");
+    if (url_length == 0 || suite_length == 0) return;
+
+    int id = find_repo(stats, url, url_length, suite, suite_length);
+    char host_url[1024];
+    snprintf(host_url, sizeof(host_url), "%.*s", (int)url_length, url);
+    HostQueue *host = find_host(stats, host_url);
+    close_transfer(stats, host, now_ms);
+
+    RepoStats *repo = &stats->repos[id];
+    if (repo->first_ms < 0) repo->first_ms = now_ms;
+    if (now_ms > repo->done_ms) repo->done_ms = now_ms;
+    repo->items++;
+    if (get) {
+        repo->bytes += parse_fetch_size(line);
+        host->repo = id;
+        host->started_ms = now_ms;
+    }
+    if (failed) {
+        repo->failed++;
+        stats->last_failed = id;
+    }
+}
+
+void finish_update_stats(UpdateStats *stats)
+{
+    long now_ms = get_monotonic_ms() - stats->started_ms;
+    for (int i = 0; i < stats->host_count; i++) close_transfer(stats, &stats->hosts[i], now_ms);
+}
+
+static uint64_t get_throughput(const RepoStats *repo)
+{
+    return repo->transfer_ms > 0 ? repo->bytes * 1000 / repo->transfer_ms : 0;
+}
+
+static int compare_done(const void *a, const void *b)
+{
+    const RepoStats *left = *(const RepoStats *const *)a;
+    const RepoStats *right = *(const RepoStats *const *)b;
+    return (left->done_ms < right->done_ms) - (left->done_ms > right->done_ms);
+}
+
+static void print_repo_line(const RepoStats *repo)
+{
+    char size[32];
+    char rate[32];
+    printf("    %6.2fs  " DIM "first reply %5.2fs" RESET, repo->done_ms / 1000.0, repo->first_ms / 1000.0);
+    if (repo->bytes > 0) {
+        format_size(repo->bytes, size, sizeof(size));
+        format_size(get_throughput(repo), rate, sizeof(rate));
+        printf("  %9s " DIM "at %s/s" RESET, size, rate);
+    }
+    printf("  %s %s", repo->url, repo->suite);
+    if (repo->known) printf(YELLOW "  [LimeOS: %s]" RESET, repo->known);
+    printf("\n");
+}
+
+void print_update_stats(const UpdateStats *stats)
+{
+    if (is_json_output()) {
+        for (int i = 0; i < stats->count; i++) {
+            const RepoStats *repo = &stats->repos[i];
+            begin_json_record("repository_stats");
+            add_json_string("url", repo->url);
+            add_json_string("suite", repo->suite);
+            add_json_int("first_ms", repo->first_ms);
+            add_json_int("done_ms", repo->done_ms);
+            add_json_int("transfer_ms", repo->transfer_ms);
+            add_json_int("bytes", (long)repo->bytes);
+            add_json_int("bytes_per_second", (long)get_throughput(repo));
+            add_json_int("items", repo->items);
+            add_json_bool("failed", repo->failed > 0);
+            add_json_string("error", repo->error);
+            add_json_string("known", repo->known ? repo->known : NULL);
+            end_json_record();
+        }
+        return;
+    }
+    if (stats->count == 0) return;
+
+    const RepoStats **sorted = malloc(stats->count * sizeof(RepoStats*));
+    for (int i = 0; i < stats->count; i++) sorted[i] = &stats->repos[i];
+    qsort(sorted, stats->count, sizeof(RepoStats*), compare_done);
+
+    printf("\n" BOLD "  Slowest repositories" RESET "\n");
+    for (int i = 0; i < stats->count && i < SLOWEST_SHOWN; i++) print_repo_line(sorted[i]);
+    if (stats->count > SLOWEST_SHOWN) {
+        printf(DIM "    ... %d more" RESET "\n", stats->count - SLOWEST_SHOWN);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < stats->count; i++) {
+        const RepoStats *repo = sorted[i];
+        if (!repo->failed) continue;
+        if (failed++ == 0) printf("\n" BOLD "  Failed repositories" RESET "\n");
+        printf(RED "    %s" RESET " %s %s", CROSS, repo->url, repo->suite);
+        if (repo->known) printf(YELLOW "  [LimeOS: %s]" RESET, repo->known);
+        printf("\n");
+        if (repo->error) printf(DIM "      %s" RESET "\n", repo->error);
+    }
+    free(sorted);
+}
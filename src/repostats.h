@@ -0,0 +1,59 @@
+/**
+ * lime-apt Update Statistics
+ *
+ * Attributes the time and bytes of an apt update to each source. apt
+ * prints "Get:" when a response starts arriving and "Hit:", "Ign:" or
+ * "Err:" when a request is answered, and each host's queue is served
+ * one response at a time, so a download runs from its "Get:" until the
+ * next line about the same host. Lines are timestamped as they arrive.
+ */
+
+#ifndef REPOSTATS_H
+#define REPOSTATS_H
+
+#include <stdint.h>
+
+typedef struct {
+    char *url;
+    char *suite;
+    long first_ms;              // First reply, since the update started
+    long done_ms;               // Last item finished
+    long transfer_ms;           // Time spent receiving its downloads
+    uint64_t bytes;
+    int items;
+    int failed;
+    char *error;                // Reason apt gave for the first failure
+    const char *known;          // LimeOS package this source serves, or NULL
+} RepoStats;
+
+typedef struct {
+    char *host;
+    int repo;                   // Source whose download is arriving, or -1
+    long started_ms;
+} HostQueue;
+
+typedef struct {
+    RepoStats *repos;
+    int count;
+    int capacity;
+    HostQueue *hosts;
+    int host_count;
+    int host_capacity;
+    int last_failed;            // Source an indented reason line belongs to
+    long started_ms;
+} UpdateStats;
+
+void init_update_stats(UpdateStats *stats);
+void free_update_stats(UpdateStats *stats);
+
+// Account one line of apt update output, as it arrives
+void add_update_line(UpdateStats *stats, const char *line);
+
+// Close the downloads still arriving; apt has finished fetching
+void finish_update_stats(UpdateStats *stats);
+
+// Print the slowest sources and every failed one, or one record per
+// source in --json mode
+void print_update_stats(const UpdateStats *stats);
+
+#endif // REPOSTATS_H
@@ -0,0 +1,242 @@
+/**
+ * lime-apt Native Search
+ *
+ * Query evaluation over packages.idx. Candidate sets come from
+ * intersecting the rarest trigram posting lists of each term; every
+ * candidate is then verified against the lowercased search text, so
+ * the trigram filter only has to be conservative, never exact.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "search.h"
+#include "dpkg.h"
+
+#define MAX_TERM_LENGTH 256
+
+// Skip intersecting lists this many times larger than the candidate
+// set; verification is cheaper than decoding them
+#define INTERSECT_RATIO 32
+
+int is_plain_search_term(const char *term)
+{
+    return strpbrk(term, ".+^$*[]?(){}|\\") == NULL && strlen(term) < MAX_TERM_LENGTH;
+}
+
+long find_substring(const char *haystack, size_t haystack_length,
+                    const char *needle, size_t needle_length)
+{
+    if (needle_length == 0) return 0;
+    if (needle_length > haystack_length) return -1;
+    if (needle_length == 1) {
+        const char *found = memchr(haystack, needle[0], haystack_length);
+        return found ? found - haystack : -1;
+    }
+
+    // Compare the first and last needle bytes against a whole block of
+    // positions at once, and only memcmp where both match
+    size_t i = 0;
+    size_t last = needle_length - 1;
+#if defined(__AVX2__)
+    const __m256i first_bytes = _mm256_set1_epi8(needle[0]);
+    const __m256i last_bytes = _mm256_set1_epi8(needle[last]);
+    for (; i + last + 32 <= haystack_length; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(haystack + i + last));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first_bytes, block_first),
+                             _mm256_cmpeq_epi8(last_bytes, block_last)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_length - 2) == 0) return (long)(i + bit);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i first_bytes = _mm_set1_epi8(needle[0]);
+    const __m128i last_bytes = _mm_set1_epi8(needle[last]);
+    for (; i + last + 16 <= haystack_length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + i + last));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first_bytes, block_first),
+                          _mm_cmpeq_epi8(last_bytes, block_last)));
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_length - 2) == 0) return (long)(i + bit);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // Finish the tail (or everything, without SIMD) one byte at a time
+    for (; i + needle_length <= haystack_length; i++) {
+        if (haystack[i] == needle[0] && haystack[i + last] == needle[last] &&
+            memcmp(haystack + i + 1, needle + 1, needle_length - 2) == 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Decode a posting list, stopping early at a damaged entry or an id
+// past the package table
+static uint32_t decode_postings(const PackageIndex *index, const IndexTrigram *entry, uint32_t *out_ids)
+{
+    const unsigned char *cursor = index->postings + entry->offset;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < entry->count; i++) {
+        uint32_t delta;
+        cursor = read_index_varint(cursor, index->postings_end, &delta);
+        if (!cursor) return i;
+        id = i == 0 ? delta : id + delta;
+        if (id >= index->header->package_count) return i;
+        out_ids[i] = id;
+    }
+    return entry->count;
+}
+
+// Keep only the candidates that also appear in the posting list
+static uint32_t intersect_postings(const PackageIndex *index, const IndexTrigram *entry,
+                                   uint32_t *candidates, uint32_t candidate_count)
+{
+    const unsigned char *cursor = index->postings + entry->offset;
+    uint32_t id = 0;
+    uint32_t kept = 0;
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < entry->count && position < candidate_count; i++) {
+        uint32_t delta;
+        cursor = read_index_varint(cursor, index->postings_end, &delta);
+        if (!cursor) break;
+        id = i == 0 ? delta : id + delta;
+        if (id >= index->header->package_count) break;
+        while (position < candidate_count && candidates[position] < id) position++;
+        if (position < candidate_count && candidates[position] == id) {
+            candidates[kept++] = id;
+            position++;
+        }
+    }
+    return kept;
+}
+
+static int compare_trigram_counts(const void *a, const void *b)
+{
+    const IndexTrigram *left = *(const IndexTrigram * const *)a;
+    const IndexTrigram *right = *(const IndexTrigram * const *)b;
+    return left->count < right->count ? -1 : (left->count > right->count);
+}
+
+// Narrow the package ids down using the terms' trigrams. Returns the
+// candidate count, or -1 if no term is long enough to have trigrams.
+static long collect_candidates(const PackageIndex *index, char terms[][MAX_TERM_LENGTH],
+                               const size_t *lengths, int term_count, uint32_t **out_candidates)
+{
+    size_t trigram_total = 0;
+    for (int t = 0; t < term_count; t++) {
+        if (lengths[t] >= 3) trigram_total += lengths[t] - 2;
+    }
+    if (trigram_total == 0) return -1;
+
+    // Look up every trigram; a missing one means nothing can match
+    const IndexTrigram **entries = malloc(trigram_total * sizeof(IndexTrigram *));
+    size_t entry_count = 0;
+    for (int t = 0; t < term_count; t++) {
+        for (size_t i = 0; i + 2 < lengths[t]; i++) {
+            uint32_t trigram = ((uint32_t)(unsigned char)terms[t][i] << 16) |
+                               ((uint32_t)(unsigned char)terms[t][i + 1] << 8) |
+                               (uint32_t)(unsigned char)terms[t][i + 2];
+            const IndexTrigram *entry = find_index_trigram(index->trigrams, index->header->trigram_count,
+                                                             trigram);
+            if (!entry) {
+                free(entries);
+                *out_candidates = NULL;
+                return 0;
+            }
+            entries[entry_count++] = entry;
+        }
+    }
+
+    // Start from the rarest list and intersect upwards
+    qsort(entries, entry_count, sizeof(IndexTrigram *), compare_trigram_counts);
+    uint32_t *candidates = malloc((entries[0]->count ? entries[0]->count : 1) * sizeof(uint32_t));
+    uint32_t count = decode_postings(index, entries[0], candidates);
+    for (size_t i = 1; i < entry_count && count > 0; i++) {
+        if (entries[i] == entries[i - 1]) continue;
+        if (entries[i]->count > (uint64_t)count * INTERSECT_RATIO) break;
+        count = intersect_postings(index, entries[i], candidates, count);
+    }
+
+    free(entries);
+    *out_candidates = candidates;
+    return count;
+}
+
+static int matches_terms(const PackageIndex *index, uint32_t id, char terms[][MAX_TERM_LENGTH],
+                         const size_t *lengths, int term_count, int names_only)
+{
+    const IndexPackage *package = &index->packages[id];
+    const char *text = index->text + package->text;
+    size_t length = names_only ? package->name_length : package->text_length;
+
+    for (int t = 0; t < term_count; t++) {
+        if (find_substring(text, length, terms[t], lengths[t]) < 0) return 0;
+    }
+    return 1;
+}
+
+int search_package_index(const PackageIndex *index, char *const terms[], int term_count,
+                         int names_only, SearchCallback callback, void *context)
+{
+    // Lowercase the terms to match the index text
+    char (*lowered)[MAX_TERM_LENGTH] = calloc(term_count ? term_count : 1, MAX_TERM_LENGTH);
+    size_t *lengths = calloc(term_count ? term_count : 1, sizeof(size_t));
+    for (int t = 0; t < term_count; t++) {
+        size_t i = 0;
+        for (; terms[t][i] && i < MAX_TERM_LENGTH - 1; i++) {
+            lowered[t][i] = (char)tolower((unsigned char)terms[t][i]);
+        }
+        lengths[t] = i;
+    }
+
+    uint32_t *candidates = NULL;
+    long candidate_count = collect_candidates(index, lowered, lengths, term_count, &candidates);
+    uint32_t total = candidate_count < 0 ? index->header->package_count : (uint32_t)candidate_count;
+
+    // Verify candidates in id order, which is also name order
+    DpkgStatus status;
+    int have_status = 0;
+    int match_count = 0;
+    for (uint32_t i = 0; i < total; i++) {
+        uint32_t id = candidate_count < 0 ? i : candidates[i];
+        if (!matches_terms(index, id, lowered, lengths, term_count, names_only)) continue;
+
+        const IndexPackage *package = &index->packages[id];
+        SearchMatch match;
+        match.name = get_index_string(index, package->name);
+        match.version = get_index_string(index, package->version);
+        match.description = get_index_string(index, package->description);
+        if (!have_status) {
+            open_dpkg_status(&status);
+            have_status = 1;
+        }
+        match.installed = is_dpkg_installed(&status, match.name);
+        match.external = 0;
+        match_count++;
+        if (callback(&match, context)) break;
+    }
+
+    if (have_status) close_dpkg_status(&status);
+    free(candidates);
+    free(lowered);
+    free(lengths);
+    return match_count;
+}
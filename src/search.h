@@ -0,0 +1,42 @@
+/**
+ * lime-apt Native Search
+ *
+ * Answers "lime-apt search" from the package index: posting lists of
+ * the query's trigrams narrow the candidates, and a SIMD substring scan
+ * confirms each one. Results come back in name order, like apt's.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "index.h"
+
+// A confirmed match; strings point into the index and stay valid while
+// it remains open
+typedef struct {
+    const char *name;
+    const char *version;
+    const char *description;
+    int installed;
+    int external;           // From the LimeOS package database, not apt
+} SearchMatch;
+
+// Receives each match; return non-zero to stop the search
+typedef int (*SearchCallback)(const SearchMatch *match, void *context);
+
+// Whether a term can be answered as a plain substring (apt treats
+// search terms as regular expressions)
+int is_plain_search_term(const char *term);
+
+// Find packages whose name (or description, unless names_only) contains
+// every term, case-insensitively. Returns the number of matches
+// delivered to the callback.
+int search_package_index(const PackageIndex *index, char *const terms[], int term_count,
+                         int names_only, SearchCallback callback, void *context);
+
+// Find the first occurrence of needle in haystack (SSE2/AVX2 when built
+// for it). Returns the offset or -1.
+long find_substring(const char *haystack, size_t haystack_length,
+                    const char *needle, size_t needle_length);
+
+#endif // SEARCH_H
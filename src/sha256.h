@@ -0,0 +1,30 @@
+/**
+ * lime-apt SHA-256
+ *
+ * Streaming SHA-256 (FIPS 180-4), used to check downloaded archives
+ * against the hashes apt publishes for them.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            // Bytes hashed so far
+    unsigned char block[64];
+    size_t block_length;
+} Sha256;
+
+void init_sha256(Sha256 *context);
+void update_sha256(Sha256 *context, const void *data, size_t length);
+
+// Finish and write the digest as 64 lowercase hex digits plus a NUL
+void finish_sha256_hex(Sha256 *context, char out_hex[65]);
+
+// Hash a whole file. Returns 0 on success, -1 if it cannot be read.
+int hash_file_sha256(const char *path, char out_hex[65]);
+
+#endif // SHA256_H
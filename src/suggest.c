@@ -0,0 +1,236 @@
+/**
+ * lime-apt Name Suggestions
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "suggest.h"
+#include "packages.h"
+
+#define SUGGEST_MAX_NAME_LENGTH 128
+#define SUGGEST_POOL_SIZE       32
+#define SUGGEST_MIN_SIMILARITY  0.3
+
+// A candidate name and how close it is to the query
+typedef struct {
+    const char *name;
+    double similarity;      // Dice coefficient over padded trigrams
+    int distance;           // Edit distance, filled in for the pool only
+} Suggestion;
+
+// Collect the distinct trigrams of " name " (lowercased). Returns the count.
+static int get_name_trigrams(const char *name, uint32_t *out_trigrams)
+{
+    char padded[SUGGEST_MAX_NAME_LENGTH + 3];
+    size_t length = strlen(name);
+    if (length > SUGGEST_MAX_NAME_LENGTH) length = SUGGEST_MAX_NAME_LENGTH;
+    padded[0] = ' ';
+    for (size_t i = 0; i < length; i++) padded[i + 1] = (char)tolower((unsigned char)name[i]);
+    padded[length + 1] = ' ';
+
+    int count = 0;
+    for (size_t i = 0; i + 2 < length + 2; i++) {
+        uint32_t trigram = ((uint32_t)(unsigned char)padded[i] << 16) |
+                           ((uint32_t)(unsigned char)padded[i + 1] << 8) |
+                           (uint32_t)(unsigned char)padded[i + 2];
+        int seen = 0;
+        for (int j = 0; j < count && !seen; j++) seen = out_trigrams[j] == trigram;
+        if (!seen) out_trigrams[count++] = trigram;
+    }
+    return count;
+}
+
+// Keep the pool sorted by similarity, dropping the weakest when full
+static void add_to_pool(Suggestion *pool, int *pool_count, const char *name, double similarity)
+{
+    if (similarity < SUGGEST_MIN_SIMILARITY) return;
+    for (int i = 0; i < *pool_count; i++) {
+        if (strcmp(pool[i].name, name) == 0) return;
+    }
+    if (*pool_count == SUGGEST_POOL_SIZE && similarity <= pool[*pool_count - 1].similarity) return;
+
+    int position = *pool_count < SUGGEST_POOL_SIZE ? (*pool_count)++ : SUGGEST_POOL_SIZE - 1;
+    while (position > 0 && pool[position - 1].similarity < similarity) {
+        pool[position] = pool[position - 1];
+        position--;
+    }
+    pool[position].name = name;
+    pool[position].similarity = similarity;
+    pool[position].distance = 0;
+}
+
+// Optimal string alignment distance (Levenshtein plus transpositions)
+static int get_edit_distance(const char *left, const char *right)
+{
+    size_t left_len = strlen(left);
+    size_t right_len = strlen(right);
+    if (left_len > SUGGEST_MAX_NAME_LENGTH) left_len = SUGGEST_MAX_NAME_LENGTH;
+    if (right_len > SUGGEST_MAX_NAME_LENGTH) right_len = SUGGEST_MAX_NAME_LENGTH;
+
+    int rows[3][SUGGEST_MAX_NAME_LENGTH + 1];
+    int *before = rows[0];
+    int *previous = rows[1];
+    int *current = rows[2];
+    for (size_t j = 0; j <= right_len; j++) previous[j] = (int)j;
+
+    for (size_t i = 1; i <= left_len; i++) {
+        current[0] = (int)i;
+        for (size_t j = 1; j <= right_len; j++) {
+            int cost = tolower((unsigned char)left[i - 1]) != tolower((unsigned char)right[j - 1]);
+            int best = previous[j] + 1;
+            if (current[j - 1] + 1 < best) best = current[j - 1] + 1;
+            if (previous[j - 1] + cost < best) best = previous[j - 1] + cost;
+            if (i > 1 && j > 1 && left[i - 1] == right[j - 2] && left[i - 2] == right[j - 1] &&
+                before[j - 2] + 1 < best) {
+                best = before[j - 2] + 1;
+            }
+            current[j] = best;
+        }
+        int *recycled = before;
+        before = previous;
+        previous = current;
+        current = recycled;
+    }
+    return previous[right_len];
+}
+
+// Score every index name sharing a trigram with the query
+static void score_index_names(const PackageIndex *index, const uint32_t *trigrams, int trigram_count,
+                              Suggestion *pool, int *pool_count)
+{
+    uint32_t package_count = index->header->package_count;
+    uint16_t *shared = calloc(package_count ? package_count : 1, sizeof(uint16_t));
+    uint32_t *touched = malloc((package_count ? package_count : 1) * sizeof(uint32_t));
+    uint32_t touched_count = 0;
+
+    // Count shared trigrams by walking each posting list once
+    for (int t = 0; t < trigram_count; t++) {
+        const IndexTrigram *entry = find_index_trigram(index->name_trigrams,
+                                                       index->header->name_trigram_count, trigrams[t]);
+        if (!entry) continue;
+        const unsigned char *cursor = index->name_postings + entry->offset;
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < entry->count; i++) {
+            uint32_t delta;
+            cursor = read_index_varint(cursor, index->name_postings_end, &delta);
+            if (!cursor) break;
+            id = i == 0 ? delta : id + delta;
+            if (id >= package_count) break;
+            if (shared[id]++ == 0) touched[touched_count++] = id;
+        }
+    }
+
+    // A padded name of length n has n trigrams
+    for (uint32_t i = 0; i < touched_count; i++) {
+        uint32_t id = touched[i];
+        const IndexPackage *package = &index->packages[id];
+        double similarity = 2.0 * shared[id] / (trigram_count + package->name_length);
+        add_to_pool(pool, pool_count, get_index_string(index, package->name), similarity);
+    }
+
+    free(shared);
+    free(touched);
+}
+
+// Short typos like transpositions share no trigrams with the intended
+// name, so also check names with the same first letter and a similar
+// length; they form one contiguous, name-sorted range
+static void score_short_names(const PackageIndex *index, const char *name,
+                              Suggestion *pool, int *pool_count)
+{
+    size_t length = strlen(name);
+    char first = (char)tolower((unsigned char)name[0]);
+
+    // Find the first name starting with that letter
+    uint32_t low = 0;
+    uint32_t high = index->header->package_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if ((unsigned char)get_index_string(index, index->packages[middle].name)[0] < (unsigned char)first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint32_t id = low; id < index->header->package_count; id++) {
+        const IndexPackage *package = &index->packages[id];
+        const char *candidate = get_index_string(index, package->name);
+        if (candidate[0] != first) break;
+        if (package->name_length + 2 < length || package->name_length > length + 2) continue;
+
+        int distance = get_edit_distance(name, candidate);
+        if (distance <= 2) add_to_pool(pool, pool_count, candidate, 1.0 - 0.1 * distance);
+    }
+}
+
+// Score the LimeOS database directly; it is small enough to scan
+static void score_known_names(const uint32_t *trigrams, int trigram_count,
+                              Suggestion *pool, int *pool_count)
+{
+    uint32_t known_trigrams[SUGGEST_MAX_NAME_LENGTH + 2];
+    for (size_t i = 0; i < KNOWN_PACKAGES_COUNT; i++) {
+        int known_count = get_name_trigrams(KNOWN_PACKAGES[i].name, known_trigrams);
+        int shared = 0;
+        for (int a = 0; a < trigram_count; a++) {
+            for (int b = 0; b < known_count; b++) {
+                if (trigrams[a] == known_trigrams[b]) {
+                    shared++;
+                    break;
+                }
+            }
+        }
+        double similarity = 2.0 * shared / (trigram_count + known_count);
+        add_to_pool(pool, pool_count, KNOWN_PACKAGES[i].name, similarity);
+    }
+}
+
+int suggest_package_names(const PackageIndex *index, const char *name,
+                          const char **out_names, int max_count)
+{
+    size_t length = strlen(name);
+    if (length == 0 || length > SUGGEST_MAX_NAME_LENGTH || max_count <= 0) return 0;
+
+    uint32_t trigrams[SUGGEST_MAX_NAME_LENGTH + 2];
+    int trigram_count = get_name_trigrams(name, trigrams);
+
+    Suggestion pool[SUGGEST_POOL_SIZE];
+    int pool_count = 0;
+    if (index) {
+        score_index_names(index, trigrams, trigram_count, pool, &pool_count);
+        if (length <= 6) score_short_names(index, name, pool, &pool_count);
+    }
+    score_known_names(trigrams, trigram_count, pool, &pool_count);
+
+    // Rank the shortlist: close typos by edit distance first, then
+    // looser matches (e.g. a word of a longer name) by similarity
+    int typo_limit = length < 6 ? 2 : (int)(length / 3);
+    for (int i = 0; i < pool_count; i++) {
+        pool[i].distance = get_edit_distance(name, pool[i].name);
+    }
+    for (int i = 1; i < pool_count; i++) {
+        Suggestion current = pool[i];
+        int j = i;
+        while (j > 0) {
+            const Suggestion *other = &pool[j - 1];
+            int current_typo = current.distance <= typo_limit;
+            int other_typo = other->distance <= typo_limit;
+            int better = current_typo != other_typo ? current_typo :
+                         current_typo ? current.distance < other->distance :
+                         current.similarity > other->similarity;
+            if (!better) break;
+            pool[j] = pool[j - 1];
+            j--;
+        }
+        pool[j] = current;
+    }
+
+    int count = 0;
+    for (int i = 0; i < pool_count && count < max_count; i++) {
+        if (strcmp(pool[i].name, name) == 0) continue;
+        out_names[count++] = pool[i].name;
+    }
+    return count;
+}
@@ -0,0 +1,23 @@
+/**
+ * lime-apt Name Suggestions
+ *
+ * "Did you mean" lookups for package names that do not exist. The
+ * name trigram index narrows ~70k names down to those sharing the most
+ * trigrams with the typo, and only that short list is ranked by edit
+ * distance.
+ */
+
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include "index.h"
+
+#define SUGGEST_MAX_RESULTS 3
+
+// Find names close to "name" among the index (may be NULL) and the
+// LimeOS package database. Writes up to max_count names, best first;
+// they point into the index or the database. Returns the count.
+int suggest_package_names(const PackageIndex *index, const char *name,
+                          const char **out_names, int max_count);
+
+#endif // SUGGEST_H
@@ -0,0 +1,302 @@
+/**
+ * lime-apt Job Supervisor
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#include "supervisor.h"
+#include "timing.h"
+
+static long get_monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+void init_supervisor(Supervisor *supervisor)
+{
+    memset(supervisor, 0, sizeof(*supervisor));
+    supervisor->origin_ms = get_monotonic_ms();
+}
+
+void free_supervisor(Supervisor *supervisor)
+{
+    for (int i = 0; i < supervisor->count; i++) {
+        Job *job = &supervisor->jobs[i];
+        for (char **arg = job->argv; *arg; arg++) free(*arg);
+        free(job->argv);
+        free(job->label);
+        free(job->after);
+        free(job->follows);
+        free(job->partial);
+    }
+    free(supervisor->jobs);
+    free(supervisor->groups);
+    memset(supervisor, 0, sizeof(*supervisor));
+}
+
+long get_supervisor_ms(const Supervisor *supervisor)
+{
+    return get_monotonic_ms() - supervisor->origin_ms;
+}
+
+int add_job_group(Supervisor *supervisor, int limit)
+{
+    supervisor->groups = realloc(supervisor->groups, (supervisor->group_count + 1) * sizeof(JobGroup));
+    JobGroup group = { limit, 0 };
+    supervisor->groups[supervisor->group_count] = group;
+    return supervisor->group_count++;
+}
+
+int add_job(Supervisor *supervisor, const char *label, char *const argv[], int group, const JobHooks *hooks)
+{
+    if (supervisor->count == supervisor->capacity) {
+        supervisor->capacity = supervisor->capacity ? supervisor->capacity * 2 : 16;
+        supervisor->jobs = realloc(supervisor->jobs, supervisor->capacity * sizeof(Job));
+    }
+
+    Job *job = &supervisor->jobs[supervisor->count];
+    memset(job, 0, sizeof(*job));
+    int argc = 0;
+    while (argv[argc]) argc++;
+    job->argv = malloc((argc + 1) * sizeof(char*));
+    for (int i = 0; i < argc; i++) job->argv[i] = strdup(argv[i]);
+    job->argv[argc] = NULL;
+    job->label = strdup(label);
+    job->group = group;
+    job->span = -1;
+    job->fd = -1;
+    if (hooks) job->hooks = *hooks;
+    return supervisor->count++;
+}
+
+void add_job_dependency(Supervisor *supervisor, int job, int after)
+{
+    Job *waiting = &supervisor->jobs[job];
+    waiting->after = realloc(waiting->after, (waiting->after_count + 1) * sizeof(int));
+    waiting->after[waiting->after_count++] = after;
+}
+
+void add_job_ordering(Supervisor *supervisor, int job, int after)
+{
+    Job *waiting = &supervisor->jobs[job];
+    waiting->follows = realloc(waiting->follows, (waiting->follows_count + 1) * sizeof(int));
+    waiting->follows[waiting->follows_count++] = after;
+}
+
+static void set_job_state(Supervisor *supervisor, int id, JobState state)
+{
+    Job *job = &supervisor->jobs[id];
+    job->state = state;
+    if (state == JOB_RUNNING) job->started_ms = get_supervisor_ms(supervisor);
+    else job->finished_ms = get_supervisor_ms(supervisor);
+    if (state != JOB_RUNNING) end_span(job->span);
+    if (job->hooks.on_state) job->hooks.on_state(supervisor, id, job->hooks.context);
+}
+
+// Fork the job with both output streams on a non-blocking pipe
+static int start_job(Supervisor *supervisor, int id, int epoll_fd)
+{
+    Job *job = &supervisor->jobs[id];
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        execvp(job->argv[0], job->argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)id };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[0], &event);
+    job->pid = pid;
+    job->fd = fds[0];
+    job->span = open_span(job->label);
+    add_span_process(job->span);
+    supervisor->running++;
+    if (job->group >= 0) supervisor->groups[job->group].running++;
+    set_job_state(supervisor, id, JOB_RUNNING);
+    return 0;
+}
+
+// Start every waiting job whose dependencies succeeded and whose group
+// has room, in the order the jobs were added. A job settled in a pass
+// (skipped, or failed to start) can release one added before it, such
+// as a job held back by transfers queued later, so repeat until a pass
+// changes nothing.
+static void start_ready_jobs(Supervisor *supervisor, int epoll_fd)
+{
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int id = 0; id < supervisor->count && supervisor->running < MAX_RUNNING_JOBS; id++) {
+            Job *job = &supervisor->jobs[id];
+            if (job->state != JOB_WAITING) continue;
+
+            int ready = 1;
+            int blocked = 0;
+            for (int i = 0; i < job->after_count; i++) {
+                JobState after = supervisor->jobs[job->after[i]].state;
+                if (after == JOB_FAILED || after == JOB_SKIPPED) blocked = 1;
+                else if (after != JOB_SUCCEEDED) ready = 0;
+            }
+            for (int i = 0; i < job->follows_count; i++) {
+                JobState after = supervisor->jobs[job->follows[i]].state;
+                if (after == JOB_WAITING || after == JOB_RUNNING) ready = 0;
+            }
+            if (blocked) {
+                set_job_state(supervisor, id, JOB_SKIPPED);
+                changed = 1;
+                continue;
+            }
+            if (!ready) continue;
+            if (job->group >= 0 &&
+                supervisor->groups[job->group].running >= supervisor->groups[job->group].limit) {
+                continue;
+            }
+            if (start_job(supervisor, id, epoll_fd) != 0) {
+                set_job_state(supervisor, id, JOB_FAILED);
+                changed = 1;
+            }
+        }
+    }
+}
+
+// Hand complete lines to the job's callback, keeping any tail
+static void dispatch_output(Supervisor *supervisor, int id, const char *data, size_t length)
+{
+    Job *job = &supervisor->jobs[id];
+    job->partial = realloc(job->partial, job->partial_length + length + 1);
+    memcpy(job->partial + job->partial_length, data, length);
+    job->partial_length += length;
+
+    char *line = job->partial;
+    char *end = job->partial + job->partial_length;
+    char *newline;
+    while ((newline = memchr(line, '\n', end - line)) != NULL) {
+        *newline = '\0';
+        if (job->hooks.on_line) job->hooks.on_line(supervisor, id, line, job->hooks.context);
+        job = &supervisor->jobs[id];
+        line = newline + 1;
+    }
+    job->partial_length = end - line;
+    memmove(job->partial, line, job->partial_length);
+}
+
+// The job's output closed: reap it and settle its state
+static void finish_job(Supervisor *supervisor, int id, int epoll_fd)
+{
+    Job *job = &supervisor->jobs[id];
+    if (job->partial_length && job->hooks.on_line) {
+        job->partial[job->partial_length] = '\0';
+        job->partial_length = 0;
+        job->hooks.on_line(supervisor, id, job->partial, job->hooks.context);
+        job = &supervisor->jobs[id];
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, job->fd, NULL);
+    close(job->fd);
+    job->fd = -1;
+
+    int status = 0;
+    while (waitpid(job->pid, &status, 0) < 0 && errno == EINTR);
+    job->exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    set_span_exit(job->span, job->pid, job->exit_code);
+    supervisor->running--;
+    if (job->group >= 0) supervisor->groups[job->group].running--;
+
+    int ok = job->exit_code == 0;
+    if (ok && job->hooks.on_finish) ok = job->hooks.on_finish(supervisor, id, job->hooks.context) == 0;
+    set_job_state(supervisor, id, ok ? JOB_SUCCEEDED : JOB_FAILED);
+}
+
+static long get_job_duration(const Job *job)
+{
+    return job->state == JOB_SUCCEEDED || job->state == JOB_FAILED ? job->finished_ms - job->started_ms : 0;
+}
+
+long get_earliest_starts(const Supervisor *supervisor, long *out_starts)
+{
+    for (int i = 0; i < supervisor->count; i++) out_starts[i] = 0;
+
+    // Jobs queued from hooks may be depended on by earlier ones, so
+    // relax until nothing moves; the graph has no cycles
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < supervisor->count; i++) {
+            const Job *job = &supervisor->jobs[i];
+            long start = 0;
+            for (int d = 0; d < job->after_count + job->follows_count; d++) {
+                int before = d < job->after_count ? job->after[d] : job->follows[d - job->after_count];
+                long finish = out_starts[before] + get_job_duration(&supervisor->jobs[before]);
+                if (finish > start) start = finish;
+            }
+            if (start != out_starts[i]) {
+                out_starts[i] = start;
+                changed = 1;
+            }
+        }
+    }
+
+    long critical = 0;
+    for (int i = 0; i < supervisor->count; i++) {
+        long finish = out_starts[i] + get_job_duration(&supervisor->jobs[i]);
+        if (finish > critical) critical = finish;
+    }
+    return critical;
+}
+
+int run_jobs(Supervisor *supervisor)
+{
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return -1;
+
+    char buffer[16384];
+    for (;;) {
+        start_ready_jobs(supervisor, epoll_fd);
+        if (supervisor->running == 0) break;
+
+        struct epoll_event events[16];
+        int ready = epoll_wait(epoll_fd, events, 16, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+
+        for (int i = 0; i < ready; i++) {
+            int id = (int)events[i].data.u32;
+            ssize_t n;
+            while ((n = read(supervisor->jobs[id].fd, buffer, sizeof(buffer))) > 0) {
+                dispatch_output(supervisor, id, buffer, n);
+            }
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) finish_job(supervisor, id, epoll_fd);
+        }
+    }
+    close(epoll_fd);
+
+    int failed = 0;
+    for (int i = 0; i < supervisor->count; i++) {
+        if (supervisor->jobs[i].state != JOB_SUCCEEDED) failed++;
+    }
+    return failed;
+}
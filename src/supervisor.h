@@ -0,0 +1,103 @@
+/**
+ * lime-apt Job Supervisor
+ *
+ * Runs a batch of child processes concurrently from one epoll loop.
+ * Jobs in a group with a limit, such as the one for the dpkg lock or
+ * the transfers to one mirror, never exceed it; everything else, like
+ * downloads and key fetches, overlaps freely. Every line a child prints
+ * goes to its job's callback, so one renderer can draw them all.
+ */
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <sys/types.h>
+
+#define MAX_RUNNING_JOBS 32
+
+typedef enum {
+    JOB_WAITING,
+    JOB_RUNNING,
+    JOB_SUCCEEDED,
+    JOB_FAILED,
+    JOB_SKIPPED,                // A job it depends on did not succeed
+} JobState;
+
+typedef struct Supervisor Supervisor;
+
+// Per-job hooks, all optional. on_line receives each output line;
+// on_finish runs in-process after the child exits 0 and fails the job
+// by returning non-zero; on_state sees every state change.
+typedef struct {
+    void (*on_line)(Supervisor *supervisor, int job, const char *line, void *context);
+    int (*on_finish)(Supervisor *supervisor, int job, void *context);
+    void (*on_state)(Supervisor *supervisor, int job, void *context);
+    void *context;
+} JobHooks;
+
+typedef struct {
+    char *label;
+    char **argv;                // Owned copy, NULL-terminated
+    int group;                  // -1 when unlimited
+    int *after;                 // Jobs that must succeed first
+    int after_count;
+    int *follows;               // Jobs that must finish first, however they end
+    int follows_count;
+    JobHooks hooks;
+    JobState state;
+    int exit_code;
+    long started_ms;            // Since the supervisor was created
+    long finished_ms;
+    pid_t pid;
+    int span;                   // Timing span while it runs
+    int fd;
+    char *partial;              // Output not yet ended by a newline
+    size_t partial_length;
+} Job;
+
+// A limit on how many jobs of one kind run at once
+typedef struct {
+    int limit;
+    int running;
+} JobGroup;
+
+struct Supervisor {
+    Job *jobs;
+    int count;
+    int capacity;
+    JobGroup *groups;
+    int group_count;
+    int running;
+    long origin_ms;
+};
+
+void init_supervisor(Supervisor *supervisor);
+void free_supervisor(Supervisor *supervisor);
+
+// Add a group allowing "limit" concurrent jobs. Returns its id.
+int add_job_group(Supervisor *supervisor, int limit);
+
+// Queue a job; argv is copied. Returns its id. Jobs may be added from
+// inside hooks while the supervisor runs.
+int add_job(Supervisor *supervisor, const char *label, char *const argv[], int group, const JobHooks *hooks);
+
+// Hold a job back until another one has succeeded
+void add_job_dependency(Supervisor *supervisor, int job, int after);
+
+// Hold a job back until another one has finished, whether or not it
+// succeeded
+void add_job_ordering(Supervisor *supervisor, int job, int after);
+
+// Run until every job has finished or been skipped. Returns the number
+// of jobs that did not succeed.
+int run_jobs(Supervisor *supervisor);
+
+// After a run: the earliest each job could have started had only its
+// dependencies held it back, given the durations measured. Writes one
+// value per job and returns the length of the critical path.
+long get_earliest_starts(const Supervisor *supervisor, long *out_starts);
+
+// Milliseconds since the supervisor was created
+long get_supervisor_ms(const Supervisor *supervisor);
+
+#endif // SUPERVISOR_H
@@ -0,0 +1,308 @@
+/**
+ * lime-apt Phase Timings
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "output.h"
+#include "json.h"
+
+#define MAX_OPEN_SPANS 64
+#define MAX_SHOWN_CHILDREN 12
+
+static int enabled = 0;
+static struct timespec origin;
+static Span *spans = NULL;
+static int span_count = 0;
+static int span_capacity = 0;
+static int open_spans[MAX_OPEN_SPANS];
+static int open_depth = 0;
+
+static long get_elapsed_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - origin.tv_sec) * 1000000L + (now.tv_nsec - origin.tv_nsec) / 1000L;
+}
+
+void enable_timings(void)
+{
+    if (enabled) return;
+    enabled = 1;
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+}
+
+int are_timings_enabled(void)
+{
+    return enabled;
+}
+
+static int add_span(const char *name)
+{
+    if (span_count == span_capacity) {
+        span_capacity = span_capacity ? span_capacity * 2 : 64;
+        spans = realloc(spans, span_capacity * sizeof(Span));
+    }
+    Span *span = &spans[span_count];
+    span->name = strdup(name);
+    span->parent = open_depth > 0 ? open_spans[open_depth - 1] : -1;
+    span->start_us = get_elapsed_us();
+    span->end_us = -1;
+    span->processes = 0;
+    span->bytes = 0;
+    span->detached = 0;
+    span->pid = 0;
+    span->exit_code = -1;
+    return span_count++;
+}
+
+int begin_span(const char *name)
+{
+    if (!enabled) return -1;
+    int id = add_span(name);
+    if (open_depth < MAX_OPEN_SPANS) open_spans[open_depth++] = id;
+    return id;
+}
+
+int open_span(const char *name)
+{
+    if (!enabled) return -1;
+    int id = add_span(name);
+    spans[id].detached = 1;
+    return id;
+}
+
+static int is_inside(int span, int ancestor)
+{
+    while (span > ancestor) span = spans[span].parent;
+    return span == ancestor;
+}
+
+void end_span(int span)
+{
+    if (span < 0 || span >= span_count) return;
+    long now = get_elapsed_us();
+    for (int i = span; i < span_count; i++) {
+        if (spans[i].end_us < 0 && is_inside(i, span)) spans[i].end_us = now;
+    }
+    while (open_depth > 0 && spans[open_spans[open_depth - 1]].end_us >= 0) open_depth--;
+}
+
+static Span *find_span(int span)
+{
+    if (!enabled) return NULL;
+    if (span < 0) span = open_depth > 0 ? open_spans[open_depth - 1] : -1;
+    return span >= 0 && span < span_count ? &spans[span] : NULL;
+}
+
+void add_span_process(int span)
+{
+    Span *target = find_span(span);
+    if (target) __atomic_fetch_add(&target->processes, 1, __ATOMIC_RELAXED);
+}
+
+void add_span_bytes(int span, uint64_t bytes)
+{
+    Span *target = find_span(span);
+    if (target) __atomic_fetch_add(&target->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void set_span_exit(int span, int pid, int exit_code)
+{
+    Span *target = find_span(span);
+    if (!target) return;
+    target->pid = pid;
+    target->exit_code = exit_code;
+}
+
+const Span *get_spans(int *out_count)
+{
+    *out_count = span_count;
+    return spans;
+}
+
+static void print_span_line(int depth, const char *name, long duration_us, int processes, uint64_t bytes)
+{
+    int width = 44 - depth * 2;
+    printf("    %*s%-*.*s %9.1f ms", depth * 2, "", width, width, name, duration_us / 1000.0);
+    if (processes > 0) printf(DIM "  %d process%s" RESET, processes, processes == 1 ? "" : "es");
+    if (bytes > 0) {
+        char size[32];
+        format_size(bytes, size, sizeof(size));
+        printf(DIM "  %s" RESET, size);
+    }
+    printf("\n");
+}
+
+// Print a span and its children, with counts covering the whole
+// subtree; long runs of siblings such as archive transfers are cut short
+static void print_span_tree(int id, int depth, const int *first_child, const int *next_sibling,
+                            const int *processes, const uint64_t *bytes)
+{
+    const Span *span = &spans[id];
+    print_span_line(depth, span->name, span->end_us - span->start_us, processes[id], bytes[id]);
+
+    int shown = 0;
+    int hidden = 0;
+    int hidden_processes = 0;
+    uint64_t hidden_bytes = 0;
+    for (int child = first_child[id]; child >= 0; child = next_sibling[child]) {
+        if (shown++ < MAX_SHOWN_CHILDREN) {
+            print_span_tree(child, depth + 1, first_child, next_sibling, processes, bytes);
+            continue;
+        }
+        hidden++;
+        hidden_processes += processes[child];
+        hidden_bytes += bytes[child];
+    }
+    if (hidden > 0) {
+        char name[64];
+        snprintf(name, sizeof(name), "... %d more", hidden);
+        int width = 44 - (depth + 1) * 2;
+        printf(DIM "    %*s%-*s %12s" RESET, (depth + 1) * 2, "", width, name, "");
+        if (hidden_processes > 0) printf(DIM "  %d processes" RESET, hidden_processes);
+        if (hidden_bytes > 0) {
+            char size[32];
+            format_size(hidden_bytes, size, sizeof(size));
+            printf(DIM "  %s" RESET, size);
+        }
+        printf("\n");
+    }
+}
+
+static void close_open_spans(void)
+{
+    long now = get_elapsed_us();
+    for (int i = 0; i < span_count; i++) {
+        if (spans[i].end_us < 0) spans[i].end_us = now;
+    }
+    open_depth = 0;
+}
+
+void print_timings(void)
+{
+    if (!enabled || span_count == 0) return;
+    close_open_spans();
+
+    if (is_json_output()) {
+        for (int i = 0; i < span_count; i++) {
+            begin_json_record("span");
+            add_json_int("id", i);
+            add_json_int("parent", spans[i].parent);
+            add_json_string("name", spans[i].name);
+            add_json_int("start_us", spans[i].start_us);
+            add_json_int("duration_us", spans[i].end_us - spans[i].start_us);
+            add_json_int("processes", spans[i].processes);
+            add_json_int("bytes", (long)spans[i].bytes);
+            end_json_record();
+        }
+        return;
+    }
+
+    // Subtree totals, and child lists in start order; children always
+    // come after their parents
+    int *processes = malloc(span_count * sizeof(int));
+    uint64_t *bytes = malloc(span_count * sizeof(uint64_t));
+    int *first_child = malloc(span_count * sizeof(int));
+    int *next_sibling = malloc(span_count * sizeof(int));
+    for (int i = 0; i < span_count; i++) {
+        processes[i] = spans[i].processes;
+        bytes[i] = spans[i].bytes;
+        first_child[i] = -1;
+    }
+    int first_root = -1;
+    for (int i = span_count - 1; i >= 0; i--) {
+        int parent = spans[i].parent;
+        if (parent >= 0) {
+            processes[parent] += processes[i];
+            bytes[parent] += bytes[i];
+            next_sibling[i] = first_child[parent];
+            first_child[parent] = i;
+        } else {
+            next_sibling[i] = first_root;
+            first_root = i;
+        }
+    }
+
+    printf("\n" BOLD "  Timings" RESET "\n");
+    for (int root = first_root; root >= 0; root = next_sibling[root]) {
+        print_span_tree(root, 0, first_child, next_sibling, processes, bytes);
+    }
+
+    free(processes);
+    free(bytes);
+    free(first_child);
+    free(next_sibling);
+}
+
+// Name the trace's process or one of its tracks
+static void write_trace_name(FILE *out, int pid, int tid, const char *kind, const char *name)
+{
+    fprintf(out, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"args\":{\"name\":", pid, tid, kind);
+    write_json_string(out, name, strlen(name));
+    fputs("}}", out);
+}
+
+int write_trace(const char *path, const char *command)
+{
+    if (!enabled) return -1;
+    close_open_spans();
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    // Track 0 is the main thread. Detached spans take the first track
+    // free by the time they start; ids are already in start order.
+    int *tracks = malloc((span_count ? span_count : 1) * sizeof(int));
+    long *track_ends = malloc((span_count + 1) * sizeof(long));
+    int track_count = 1;
+    for (int i = 0; i < span_count; i++) {
+        tracks[i] = 0;
+        if (!spans[i].detached) continue;
+        int track = 1;
+        while (track < track_count && track_ends[track] > spans[i].start_us) track++;
+        if (track == track_count) track_count++;
+        track_ends[track] = spans[i].end_us;
+        tracks[i] = track;
+    }
+
+    int pid = getpid();
+    char name[256];
+    snprintf(name, sizeof(name), "lime-apt %s", command);
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+    write_trace_name(out, pid, 0, "process_name", name);
+    fputs(",\n", out);
+    write_trace_name(out, pid, 0, "thread_name", "main");
+    for (int track = 1; track < track_count; track++) {
+        snprintf(name, sizeof(name), "jobs %d", track);
+        fputs(",\n", out);
+        write_trace_name(out, pid, track, "thread_name", name);
+    }
+
+    for (int i = 0; i < span_count; i++) {
+        const Span *span = &spans[i];
+        long duration_us = span->end_us - span->start_us;
+        fputs(",\n{\"ph\":\"X\",\"name\":", out);
+        write_json_string(out, span->name, strlen(span->name));
+        fprintf(out, ",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%ld,\"dur\":%ld,\"args\":{\"parent\":%d",
+                span->pid <= 0 ? "phase" : span->bytes > 0 ? "download" : "process",
+                pid, tracks[i], span->start_us, duration_us, span->parent);
+        if (span->pid > 0) fprintf(out, ",\"pid\":%d,\"exit_code\":%d", span->pid, span->exit_code);
+        if (span->processes > 0) fprintf(out, ",\"processes\":%d", span->processes);
+        if (span->bytes > 0) {
+            double seconds = duration_us > 0 ? duration_us / 1e6 : 1e-6;
+            fprintf(out, ",\"bytes\":%llu,\"bytes_per_second\":%.0f",
+                    (unsigned long long)span->bytes, span->bytes / seconds);
+        }
+        fputs("}}", out);
+    }
+    fputs("\n]}\n", out);
+
+    free(tracks);
+    free(track_ends);
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,68 @@
+/**
+ * lime-apt Phase Timings
+ *
+ * Monotonic-clock spans around the phases of a run and the child
+ * processes it starts. A span begun while another is open nests inside
+ * it; a detached span, such as a supervised job running beside others,
+ * hangs under whatever was open when it started without becoming the
+ * parent of what follows. Each span counts the child processes started
+ * and the bytes transferred inside it. Nothing is recorded until
+ * timings are enabled, so the calls cost a branch otherwise.
+ *
+ * The spans print as a tree for --timings, or are written as a Chrome
+ * trace-event file for LIME_APT_TRACE, with the main thread's phases
+ * on one track and detached spans spread over tracks of their own so
+ * overlapping jobs show side by side.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+typedef struct {
+    char *name;
+    int parent;                 // -1 for a top-level span
+    long start_us;              // Since timings were enabled
+    long end_us;                // -1 while open
+    int processes;              // Child processes started directly inside
+    uint64_t bytes;
+    int detached;               // Opened with open_span()
+    int pid;                    // The child process the span ran, or 0
+    int exit_code;
+} Span;
+
+void enable_timings(void);
+int are_timings_enabled(void);
+
+// Open a span inside the innermost open one. Returns its id, or -1
+// when timings are off.
+int begin_span(const char *name);
+
+// Open a span under the innermost open one without nesting later spans
+// in it
+int open_span(const char *name);
+
+// Close a span, and any opened inside it that are still open
+void end_span(int span);
+
+// Count a started child process or transferred bytes against a span;
+// -1 means the innermost open one. Safe to call from worker threads.
+void add_span_process(int span);
+void add_span_bytes(int span, uint64_t bytes);
+
+// Record the child process a span ran and how it exited
+void set_span_exit(int span, int pid, int exit_code);
+
+// Recorded spans, parents before their children
+const Span *get_spans(int *out_count);
+
+// Close whatever is open and print the spans as a tree, or as "span"
+// records in --json mode
+void print_timings(void);
+
+// Close whatever is open and write the spans as Chrome trace-event
+// JSON. Returns 0 on success.
+int write_trace(const char *path, const char *command);
+
+#endif // TIMING_H
@@ -0,0 +1,70 @@
+/**
+ * lime-apt Upgrade Preview
+ */
+
+#include <string.h>
+
+#include "upgrade.h"
+#include "version.h"
+
+// Compare an index name with a dpkg name slice, strcmp-style
+static int compare_names(const char *name, size_t name_length, DpkgField other)
+{
+    int result = memcmp(name, other.data, name_length < other.length ? name_length : other.length);
+    if (result != 0) return result;
+    return name_length < other.length ? -1 : name_length > other.length;
+}
+
+// The index only holds native and "all" packages; an installed foreign
+// architecture copy has no candidate there
+static int is_same_architecture(const DpkgPackage *installed, const char *architecture)
+{
+    return compare_dpkg_field(installed->architecture, architecture) == 0 ||
+           compare_dpkg_field(installed->architecture, "all") == 0 ||
+           strcmp(architecture, "all") == 0;
+}
+
+int find_upgradable_packages(const PackageIndex *index, const DpkgStatus *status,
+                             UpgradeCallback callback, void *context)
+{
+    uint32_t package_count = index->header->package_count;
+    uint32_t id = 0;
+    int found = 0;
+
+    for (size_t i = 0; i < status->count && id < package_count; i++) {
+        const DpkgPackage *installed = &status->packages[i];
+        if (!installed->installed) continue;
+
+        // Advance the index side to this name
+        const IndexPackage *package = &index->packages[id];
+        const char *name = get_index_string(index, package->name);
+        int order;
+        while ((order = compare_names(name, package->name_length, installed->name)) < 0) {
+            if (++id == package_count) return found;
+            package = &index->packages[id];
+            name = get_index_string(index, package->name);
+        }
+        if (order != 0) continue;
+
+        const char *architecture = get_index_string(index, package->architecture);
+        if (!is_same_architecture(installed, architecture)) continue;
+
+        const char *version = get_index_string(index, package->version);
+        if (compare_debian_versions_n(installed->version.data, installed->version.length,
+                                      version, strlen(version)) >= 0) {
+            continue;
+        }
+
+        UpgradablePackage upgrade;
+        upgrade.name = name;
+        upgrade.installed_version = installed->version;
+        upgrade.version = version;
+        upgrade.architecture = architecture;
+        upgrade.section = get_index_string(index, package->section);
+        upgrade.size = package->size;
+        upgrade.installed_size = package->installed_size;
+        found++;
+        if (callback(&upgrade, context)) break;
+    }
+    return found;
+}
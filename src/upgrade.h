@@ -0,0 +1,37 @@
+/**
+ * lime-apt Upgrade Preview
+ *
+ * Joins the dpkg status database with the package index to find
+ * installed packages whose candidate version is newer. Both sides are
+ * sorted by name, so this is a single merge pass with no lookups.
+ */
+
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <stdint.h>
+
+#include "index.h"
+#include "dpkg.h"
+
+// An installed package with a newer candidate. Points into the index
+// and the status mapping, valid while both stay open.
+typedef struct {
+    const char *name;
+    DpkgField installed_version;
+    const char *version;            // Candidate version
+    const char *architecture;
+    const char *section;
+    uint64_t size;                  // Download size in bytes
+    uint64_t installed_size;        // Installed size of the candidate in KiB
+} UpgradablePackage;
+
+// Receives each upgradable package; return non-zero to stop
+typedef int (*UpgradeCallback)(const UpgradablePackage *package, void *context);
+
+// Report upgradable packages in name order. Returns the number delivered
+// to the callback.
+int find_upgradable_packages(const PackageIndex *index, const DpkgStatus *status,
+                             UpgradeCallback callback, void *context);
+
+#endif // UPGRADE_H
@@ -0,0 +1,114 @@
+/**
+ * lime-apt Debian Versions
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "version.h"
+
+// ASCII only: versions never depend on the locale
+static int is_version_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int is_version_letter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Sort weight of a non-digit: "~" first, then the end of the string,
+// then letters, then everything else
+static int get_char_order(char c)
+{
+    if (is_version_digit(c)) return 0;
+    if (is_version_letter(c)) return (unsigned char)c;
+    if (c == '~') return -1;
+    return (unsigned char)c + 256;
+}
+
+// Compare one upstream version or revision, alternating between
+// non-digit runs (by character order) and digit runs (numerically)
+static int compare_version_part(const char *left, const char *left_end,
+                                const char *right, const char *right_end)
+{
+    while (left < left_end || right < right_end) {
+        while ((left < left_end && !is_version_digit(*left)) ||
+               (right < right_end && !is_version_digit(*right))) {
+            int left_order = left < left_end ? get_char_order(*left) : 0;
+            int right_order = right < right_end ? get_char_order(*right) : 0;
+            if (left_order != right_order) return left_order - right_order;
+            left++;
+            right++;
+        }
+
+        // Leading zeros do not count; then the longer run is larger,
+        // and equal lengths are decided by the first differing digit
+        while (left < left_end && *left == '0') left++;
+        while (right < right_end && *right == '0') right++;
+        int first_difference = 0;
+        while (left < left_end && is_version_digit(*left) &&
+               right < right_end && is_version_digit(*right)) {
+            if (!first_difference) first_difference = *left - *right;
+            left++;
+            right++;
+        }
+        if (left < left_end && is_version_digit(*left)) return 1;
+        if (right < right_end && is_version_digit(*right)) return -1;
+        if (first_difference) return first_difference;
+    }
+    return 0;
+}
+
+// Split a version into its epoch and the bounds of upstream and revision
+static unsigned long split_version(const char *version, size_t length, const char **out_upstream,
+                                   const char **out_revision, const char **out_end)
+{
+    const char *end = version + length;
+    const char *colon = memchr(version, ':', length);
+    unsigned long epoch = 0;
+    const char *upstream = version;
+    if (colon) {
+        for (const char *c = version; c < colon && is_version_digit(*c); c++) {
+            epoch = epoch * 10 + (unsigned long)(*c - '0');
+        }
+        upstream = colon + 1;
+    }
+
+    // The revision follows the last hyphen; without one it is empty
+    const char *hyphen = memrchr(upstream, '-', end - upstream);
+
+    *out_upstream = upstream;
+    *out_revision = hyphen ? hyphen : end;
+    *out_end = end;
+    return epoch;
+}
+
+int compare_debian_versions_n(const char *left, size_t left_length,
+                              const char *right, size_t right_length)
+{
+    // Identical strings are the common case when checking for no-ops
+    if (left_length == right_length && memcmp(left, right, left_length) == 0) return 0;
+
+    const char *left_upstream, *left_revision, *left_end;
+    const char *right_upstream, *right_revision, *right_end;
+    unsigned long left_epoch = split_version(left, left_length, &left_upstream, &left_revision, &left_end);
+    unsigned long right_epoch = split_version(right, right_length, &right_upstream, &right_revision, &right_end);
+
+    if (left_epoch != right_epoch) return left_epoch < right_epoch ? -1 : 1;
+
+    int result = compare_version_part(left_upstream, left_revision, right_upstream, right_revision);
+    if (result != 0) return result;
+
+    // Skip the hyphens themselves
+    if (left_revision < left_end) left_revision++;
+    if (right_revision < right_end) right_revision++;
+    return compare_version_part(left_revision, left_end, right_revision, right_end);
+}
+
+int compare_debian_versions(const char *left, const char *right)
+{
+    return compare_debian_versions_n(left, strlen(left), right, strlen(right));
+}
@@ -0,0 +1,21 @@
+/**
+ * lime-apt Debian Versions
+ *
+ * dpkg-compatible ordering of "[epoch:]upstream[-revision]" strings,
+ * including "~" sorting before everything, even the end of the string.
+ * Works on length-delimited slices so versions can be compared straight
+ * out of mapped files without copying or allocating.
+ */
+
+#ifndef VERSION_H
+#define VERSION_H
+
+#include <stddef.h>
+
+// Compare two versions. Returns <0, 0 or >0 like strcmp.
+int compare_debian_versions_n(const char *left, size_t left_length,
+                              const char *right, size_t right_length);
+
+int compare_debian_versions(const char *left, const char *right);
+
+#endif // VERSION_H